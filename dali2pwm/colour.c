@@ -0,0 +1,48 @@
+#include "colour.h"
+
+
+// Mix of a colour temperature, clamped to the physical limits
+uint16_t colourTcToMix(uint16_t tc)
+{
+    if (tc <= COLOUR_TC_PHYSICAL_COOLEST) {
+        return COLOUR_MIX_COOL;
+    }
+    if (tc >= COLOUR_TC_PHYSICAL_WARMEST) {
+        return COLOUR_MIX_WARM;
+    }
+    return ((uint32_t)(tc - COLOUR_TC_PHYSICAL_COOLEST) * COLOUR_MIX_GAIN) >> 8;
+}
+
+
+// Colour temperature of a mix, rounded to the nearest mirek
+// colourMixToTc(colourTcToMix(tc)) is tc within the physical limits.
+uint16_t colourMixToTc(uint16_t mix)
+{
+    return COLOUR_TC_PHYSICAL_COOLEST + (((uint32_t)mix * COLOUR_TC_RANGE + 0x8000) >> 16);
+}
+
+
+// Colour temperature stored in one eeprom byte: offset from the physical coolest,
+// 0xff for COLOUR_MASK. Saturated to the physical limits.
+uint8_t colourEncode(uint16_t tc)
+{
+    if (tc == COLOUR_MASK) {
+        return 0xff;
+    }
+    if (tc <= COLOUR_TC_PHYSICAL_COOLEST) {
+        return 0;
+    }
+    if (tc >= COLOUR_TC_PHYSICAL_WARMEST) {
+        return COLOUR_TC_RANGE;
+    }
+    return tc - COLOUR_TC_PHYSICAL_COOLEST;
+}
+
+
+uint16_t colourDecode(uint8_t code)
+{
+    if (code == 0xff) {
+        return COLOUR_MASK;
+    }
+    return COLOUR_TC_PHYSICAL_COOLEST + code;
+}
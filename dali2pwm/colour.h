@@ -0,0 +1,41 @@
+#ifndef _COLOUR_H_
+#define _COLOUR_H_
+
+#include <inttypes.h>
+
+// Tunable white (DALI device type 8, colour temperature Tc), built with DALI_DT8
+// Two led strings share the arc power level: warm white on PSCOUT00 (PD0), cool
+// white on PSCOUT20 (PB0, see pwm.c). Colour temperatures are in mirek (1000000 / K).
+//
+// The mix is the share of the warm string in the duty, in 0.16 fixed point. It is
+// linear in mirek between the physical limits (the colour temperatures of the
+// strings): equal steps in mirek are close to equal perceived colour differences.
+// The two duties add up to the duty of the arc power level: the light output does
+// not change with the colour.
+
+// Colour temperature of each string, in mirek
+#ifndef COLOUR_TC_PHYSICAL_COOLEST
+    #define COLOUR_TC_PHYSICAL_COOLEST  153     // 6500K
+#endif
+#ifndef COLOUR_TC_PHYSICAL_WARMEST
+    #define COLOUR_TC_PHYSICAL_WARMEST  370     // 2700K
+#endif
+
+#define COLOUR_TC_RANGE         (COLOUR_TC_PHYSICAL_WARMEST - COLOUR_TC_PHYSICAL_COOLEST)
+#if (COLOUR_TC_RANGE < 1) || (COLOUR_TC_RANGE > 254)
+    #error "The Tc range must be 1 to 254 mirek (stored as one byte, see colourEncode())"
+#endif
+
+#define COLOUR_MASK             0xffff      // No colour temperature (DALI MASK)
+#define COLOUR_MIX_COOL         0x0000      // Cool string only
+#define COLOUR_MIX_WARM         0xffff      // Warm string only
+
+// Mix per mirek, 24.8 fixed point
+#define COLOUR_MIX_GAIN         ((uint32_t)(0xffffUL << 8) / COLOUR_TC_RANGE)
+
+uint16_t colourTcToMix(uint16_t tc);
+uint16_t colourMixToTc(uint16_t mix);
+uint8_t colourEncode(uint16_t tc);
+uint16_t colourDecode(uint8_t code);
+
+#endif
@@ -0,0 +1,156 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "main.h"
+#include "dali.h"
+#include "current.h"
+#include "pwm.h"
+#include "scheduler.h"
+#include "temperature.h"
+#include "entropy.h"
+
+static int16_t currentIntegral = PWM_GAIN_ONE;     // Integral term, in gain units
+static uint16_t currentGain = PWM_GAIN_ONE;
+static uint8_t currentChannel = CURRENT_ADC_CHANNEL;    // Channel of the conversion in progress
+static uint16_t currentCycles = TEMPERATURE_SAMPLE_PERIOD;     // Conversions until the next temperature one
+static uint16_t currentSample = 0;                  // Last I_LAMP sample
+
+static uint8_t currentFailure = 0;                  // Failure being debounced (DALI_FAILURE_xxx)
+static uint8_t currentFailureCount = 0;
+static volatile uint8_t currentLampState = 0;       // Debounced failure (DALI_FAILURE_xxx)
+
+
+// PI regulator, on a led current sample
+// The on phase current does not depend on the duty: the corrected current
+// (sample * gain) must be CURRENT_NOMINAL.
+static void currentRegulate(uint16_t sample)
+{
+    int16_t error;
+    int16_t gain;
+
+    // sample < 1024 and gain < 2^14: the product fits in 24 bits
+    error = CURRENT_NOMINAL - (int16_t)(((uint32_t)sample * currentGain) >> PWM_GAIN_SHIFT);
+
+    // Integral, clamped to the correction range (anti-windup)
+    // |error| < 2048: all the terms fit in 16 bits
+    currentIntegral += error * CURRENT_KI;
+    if (currentIntegral < CURRENT_GAIN_MIN) {
+        currentIntegral = CURRENT_GAIN_MIN;
+    }
+    else if (currentIntegral > CURRENT_GAIN_MAX) {
+        currentIntegral = CURRENT_GAIN_MAX;
+    }
+
+    gain = currentIntegral + error * CURRENT_KP;
+    if (gain < CURRENT_GAIN_MIN) {
+        gain = CURRENT_GAIN_MIN;
+    }
+    else if (gain > CURRENT_GAIN_MAX) {
+        gain = CURRENT_GAIN_MAX;
+    }
+
+    if (gain != currentGain) {
+        currentGain = gain;
+        pwmSetGain(gain);
+    }
+}
+
+
+// Open or shorted string, on a string voltage sample and the last current sample
+// A new state is reported after CURRENT_FAILURE_DEBOUNCE identical detections:
+// the main loop is woken up at once (SCHEDULER_LAMP_FAILURE).
+static void currentCheckLamp(uint16_t voltage)
+{
+    uint8_t failure = 0;
+
+    if (currentSample < CURRENT_ADC(CURRENT_OPEN_MA)) {
+        if (voltage >= CURRENT_VOLTAGE_ADC(CURRENT_OPEN_MV)) {
+            failure = DALI_FAILURE_OPEN_CIRCUIT;
+        }
+    }
+    else if (voltage < CURRENT_VOLTAGE_ADC(CURRENT_SHORT_MV)) {
+        failure = DALI_FAILURE_SHORT_CIRCUIT;
+    }
+
+    if (failure != currentFailure) {
+        currentFailure = failure;
+        currentFailureCount = 0;
+    }
+    if (currentFailureCount < CURRENT_FAILURE_DEBOUNCE) {
+        currentFailureCount++;
+        if ((currentFailureCount == CURRENT_FAILURE_DEBOUNCE) && (failure != currentLampState)) {
+            currentLampState = failure;
+            schedulerPost(SCHEDULER_LAMP_FAILURE);
+        }
+    }
+}
+
+
+// Conversion is complete (once per PWM cycle)
+// I_LAMP and V_LAMP are converted alternately; every TEMPERATURE_SAMPLE_PERIOD
+// cycles, the temperature is converted instead. Integer only, ~150 cycles out of
+// the 1024 (PSC) or 4096 (Timer1) cycles of a PWM period.
+ISR(ADC_vect)
+{
+    uint16_t sample = ADC;
+    uint8_t channel = currentChannel;
+
+    CURRENT_TRIGGER_ACK();
+    ENTROPY_ADD(sample);        // Noise of the low bits
+
+    // Channel of the next conversion
+    if (--currentCycles == 0) {
+        currentCycles = TEMPERATURE_SAMPLE_PERIOD;
+        currentChannel = TEMPERATURE_ADC_CHANNEL;
+    }
+    else if (channel == CURRENT_ADC_CHANNEL) {
+        currentChannel = CURRENT_VOLTAGE_CHANNEL;
+    }
+    else {
+        currentChannel = CURRENT_ADC_CHANNEL;
+    }
+    ADMUX = CURRENT_ADC_REFERENCE | currentChannel;
+
+    if (channel == TEMPERATURE_ADC_CHANNEL) {
+        temperatureSample(sample);
+        return;
+    }
+
+    // Led off or on phase too short: the sample is not the led current, hold the
+    // gain and the lamp state
+    // Tunable white: the samples are synchronised to the warm string (PSCOUT00)
+    // Several instances: only the string of channel 0 (PSCOUT00) is measured
+#ifdef DALI_DT8
+    if (pwmDutyWarm() < CURRENT_MIN_DUTY) {
+#else
+    if (pwmDuty(0) < CURRENT_MIN_DUTY) {
+#endif
+        return;
+    }
+
+    if (channel == CURRENT_ADC_CHANNEL) {
+        currentSample = sample;
+        currentRegulate(sample);
+    }
+    else {
+        currentCheckLamp(sample);
+    }
+}
+
+
+// ADC converts I_LAMP and V_LAMP at each PWM cycle, started by the PWM (auto trigger)
+// ADC clock must be enabled (PRR) and the PWM initialized
+void currentInit(void)
+{
+    DIDR0 |= (1 << ADC4D) | (1 << ADC7D);   // Analog inputs, digital buffers off
+    ADMUX = CURRENT_ADC_REFERENCE | CURRENT_ADC_CHANNEL;
+    ADCSRB = CURRENT_ADC_TRIGGER;
+    ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) | (1 << ADIF) | CURRENT_ADC_PRESCALER;
+}
+
+
+// Debounced lamp failure, DALI_FAILURE_xxx bits (0: none)
+uint8_t currentLampFailure(void)
+{
+    return currentLampState;
+}
@@ -0,0 +1,70 @@
+#ifndef _CURRENT_H_
+#define _CURRENT_H_
+
+#include <inttypes.h>
+
+#include "pwm.h"
+
+// Led current regulation and lamp failure detection
+// I_LAMP (PB7/ADC4) is the voltage of the led current shunt, V_LAMP (PB6/ADC7) the
+// voltage of the led string through a divider. They are sampled alternately, one
+// per PWM cycle, at the start of the on phase.
+// A PI regulator corrects the duty (see pwmSetGain()) so that the average current
+// is the one requested by the dimming curve, whatever the supply voltage and the
+// led string. An open or shorted string is detected from the two readings.
+
+// Board (adjust to the shunt and the led string)
+#define CURRENT_SHUNT_MOHM      2000        // I_LAMP shunt resistor, mOhm
+#define CURRENT_NOMINAL_MA      350         // Led current during the on phase, at the nominal supply
+#define CURRENT_VREF_MV         2560        // ADC reference (internal)
+#define CURRENT_VOLTAGE_DIVIDER 16          // V_LAMP = string voltage / CURRENT_VOLTAGE_DIVIDER
+
+// ADC readings
+#define CURRENT_ADC(mA)         ((uint16_t)((uint32_t)(mA) * CURRENT_SHUNT_MOHM / 1000 * 1024 / CURRENT_VREF_MV))
+#define CURRENT_VOLTAGE_ADC(mV) ((uint16_t)((uint32_t)(mV) / CURRENT_VOLTAGE_DIVIDER * 1024 / CURRENT_VREF_MV))
+
+// Nominal current: the dimming curve output is a duty for this current
+#define CURRENT_NOMINAL         ((int16_t)CURRENT_ADC(CURRENT_NOMINAL_MA))
+
+// PI regulator, on the error in ADC counts, output is the gain (4.12 fixed point)
+// Settles in ~20 samples (2.6ms with the PSC) after a 2x step of the led current
+#define CURRENT_KP              2                       // Proportional gain, gain units per count
+#define CURRENT_KI              4                       // Integral gain, gain units per count and sample
+#define CURRENT_GAIN_MIN        (PWM_GAIN_ONE / 2)      // Correction range
+#define CURRENT_GAIN_MAX        (PWM_GAIN_ONE * 2)
+
+// Lamp failure (open or shorted led string)
+// Open: no current while the string voltage is up (a supply loss is not a lamp failure)
+// Short: string voltage below one led forward voltage while the current flows
+#define CURRENT_OPEN_MA         35          // Less is no current
+#define CURRENT_OPEN_MV         20000       // String voltage of an open string (supply)
+#define CURRENT_SHORT_MV        2000        // String voltage of a shorted string
+// Reported after CURRENT_FAILURE_DEBOUNCE samples, not within one PWM period: V_LAMP
+// is converted every other period (I_LAMP in between), and single samples of the
+// turn on and dimming transients would be reported as failures. 16 samples are 32
+// periods, ~2ms with the PSC (8ms with Timer1), well within a DALI forward frame
+// (~16ms) before a QUERY LAMP FAILURE. See host/lampFailureTest.c.
+#define CURRENT_FAILURE_DEBOUNCE 16         // Consecutive V_LAMP samples
+
+// The sample is valid if the on phase is longer than the sample and hold delay
+// (1.5 ADC clock) plus the rise time of the led current
+#define CURRENT_SETTLING_US     5
+#define CURRENT_MIN_DUTY        ((uint16_t)(F_PWM_CLK / 1000000UL * CURRENT_SETTLING_US))
+
+// ADC configuration
+#define CURRENT_ADC_REFERENCE   (1 << REFS1) | (1 << REFS0)                     // Internal 2.56V
+#define CURRENT_ADC_CHANNEL     ((0 << MUX3) | (1 << MUX2) | (0 << MUX1) | (0 << MUX0))   // ADC4
+#define CURRENT_VOLTAGE_CHANNEL ((0 << MUX3) | (1 << MUX2) | (1 << MUX1) | (1 << MUX0))   // ADC7
+#define CURRENT_ADC_PRESCALER   (1 << ADPS2) | (0 << ADPS1) | (1 << ADPS0)      // :32, 500kHz, conversion 26us
+#ifdef PWM_USE_TIMER1
+    #define CURRENT_ADC_TRIGGER (0 << ADTS3) | (1 << ADTS2) | (1 << ADTS1) | (0 << ADTS0)   // Timer1 overflow (BOTTOM)
+    #define CURRENT_TRIGGER_ACK()   (TIFR1 = (1 << TOV1))   // TOV1 must be cleared for the next trigger
+#else
+    #define CURRENT_ADC_TRIGGER (1 << ADTS3) | (0 << ADTS2) | (0 << ADTS1) | (0 << ADTS0)   // PSC0ASY (see PSC_SYNC_ON_START)
+    #define CURRENT_TRIGGER_ACK()
+#endif
+
+void currentInit(void);
+uint8_t currentLampFailure(void);
+
+#endif
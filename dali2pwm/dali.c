@@ -1,54 +1,183 @@
 #include <avr/interrupt.h>
 #include <stdlib.h>
-#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 
 #include "main.h"
 #include "dali.h"
+#include "eepromCache.h"
 #include "daliCmd.h"
-
-// This array contains fade times, in ms
-// The fade period will be multiplied by 2 in software for this value.
-// Last value (FADE_TIME[15]) is actually 90.510s.
-uint16_t FADE_TIME[16] = {    0,   707,  1000,  1414,  2000,  2828,  4000,  5657,
-                           8000, 11314, 16000, 22627, 32000, 45255, 64000, 45255
-                           };
+#include "dimmingCurve.h"
+#include "fade.h"
+#include "scheduler.h"
+#include "temperature.h"
+#include "entropy.h"
+#include "colour.h"
+#include "manchester.h"
+
+// This array contains fade times, in PWM cycles (0.707s to 90.510s)
+const uint32_t FADE_TIME[16] PROGMEM = {
+    0,                  FADE_CYCLES(707),   FADE_CYCLES(1000),  FADE_CYCLES(1414),
+    FADE_CYCLES(2000),  FADE_CYCLES(2828),  FADE_CYCLES(4000),  FADE_CYCLES(5657),
+    FADE_CYCLES(8000),  FADE_CYCLES(11314), FADE_CYCLES(16000), FADE_CYCLES(22627),
+    FADE_CYCLES(32000), FADE_CYCLES(45255), FADE_CYCLES(64000), FADE_CYCLES(90510)
+};
+
+// This array contains extended fade time multipliers, in PWM cycles
+const uint32_t EXTENDED_FADE_TIME[5] PROGMEM = {
+    0, FADE_CYCLES(100), FADE_CYCLES(1000), FADE_CYCLES(10000), FADE_CYCLES(60000)
+};
 
 // This array contains the fade rate, in steps/200ms
 uint8_t FADE_RATE[16] = { 0, 72, 51, 36, 25, 18, 13, 9,
                           6,  4,  3,  2,  2,  1,  1, 0
                           };
 
-uint8_t newDaliAddress = 0;
-uint8_t newDaliCommand = 0;
-volatile uint8_t newRx = 0;
+// This array contains the period of a fade rate step, in PWM cycles (24.8 fixed point)
+// Fade rate is 506 / sqrt(2)^n steps/s
+const uint32_t FADE_RATE_PERIOD[16] PROGMEM = {
+    0,                          FADE_STEP_PERIOD(357.796),  FADE_STEP_PERIOD(253.000),  FADE_STEP_PERIOD(178.898),
+    FADE_STEP_PERIOD(126.500),  FADE_STEP_PERIOD(89.449),   FADE_STEP_PERIOD(63.250),   FADE_STEP_PERIOD(44.725),
+    FADE_STEP_PERIOD(31.625),   FADE_STEP_PERIOD(22.362),   FADE_STEP_PERIOD(15.813),   FADE_STEP_PERIOD(11.181),
+    FADE_STEP_PERIOD(7.906),    FADE_STEP_PERIOD(5.591),    FADE_STEP_PERIOD(3.953),    FADE_STEP_PERIOD(2.795)
+};
+
+// Received frames queue
+// Single producer (daliReceive(), interrupt) / single consumer (daliAnalyse())
+DaliFrame rxQueue[DALI_RX_QUEUE_SIZE];
+volatile uint8_t rxHead = 0;            // Written by the ISR only
+volatile uint8_t rxTail = 0;            // Written by the main loop only
+volatile uint16_t rxFrameCount = 0;     // Frames received (see daliMemory.h)
+volatile uint16_t rxErrorCount = 0;     // Frames with an error
+volatile uint16_t rxOverflowCount = 0;  // Frames lost because the queue was full
+volatile uint16_t rxDropCount = 0;      // Frames ignored (BW frame pending, bus failure)
+static volatile uint8_t rxOtherGear = 0;   // A frame for other gear was dropped since the last queued frame
+uint16_t rxLatencyMax = 0;              // Worst case from reception to processing, in Timer0 periods
+uint16_t bootTime = 0;                  // Clock setup to the first output update, in us (measured by main())
 static uint8_t daliRunning = 0;
 
-volatile uint8_t tick1msCounter = 0;    // Incremented every ms.
-volatile uint8_t timeout = 0;           // Used to generate a delay between 1 and 255 milliseconds
-// TODO: find a better name (generalTimeout)
-uint16_t specialModeTimeout = 0;        // Long time delay (1-65535), in 1/4th seconds.
-// when this timer is decounting, dali is in "special mode" (for 15 minutes).
-// when specialModeTimeout is equal to 0, all special modes shall be terminated
+// Instances addressed by each short address [0-63] and group [64-79], bit n: daliGears[n]
+// (see daliUpdateAddressTable() and daliAddressedGears())
+static uint8_t addressTable[DALI_ADDRESS_TABLE_SIZE];
+
+// Bus failure detection
+// Default: input capture of Timer1 on PD4 (ICP1A), failure at the compare match
+// BUS_FAILURE_TICKS after the falling edge.
+// PWM_USE_TIMER1: bus sampled every tick, failure at the end of SCHEDULER_BUS_FAILURE.
+#ifdef PWM_USE_TIMER1
+static uint8_t busLow = 0;              // Bus sampled low at the last tick
+#endif
+volatile uint8_t busFailure = 0;        // Bus is down (low for more than BUS_FAILURE_TIMEOUT)
+volatile uint16_t busFailureCount = 0;  // Bus failures since power up
+volatile uint16_t busRecoveryCount = 0; // Bus recoveries since power up
+volatile uint16_t busRecoveryTime = 0;  // schedulerTime of the last recovery
+
+uint16_t rxFrameTime = 0;               // Arrival time of the frame being processed (schedulerTime)
+
+// Backward frame transmitter (driven by daliTick())
+volatile uint8_t txState = DALI_TX_IDLE;
+volatile uint8_t txData;                // Byte to send in the BW frame (SCHEDULER_TX: start or end of the frame)
+
+uint8_t requestedLevel = 0;             // Target level of arc power commands
+uint8_t enabledDeviceType = DALI_MASK;  // Set by ENABLE DEVICE TYPE X, for the next command only
 
-uint16_t fadePeriod;                    // Period between each fade step. = fadeTime/(actualLevel - requestedLevel) or = 1/fadeRate.
-uint8_t requestedLevel = 0;             // Counter, decremented every 1ms, used for fading...
-uint8_t dimSens = DOWN;                 // Indicates wether the power must increase or decrease.
-uint8_t compareMode = 0;
-uint8_t physicalSelectionMode = 0;
+// Registers of the instances; the commands and the main loop work on the selected one
+// (dali), the interrupts do not select an instance.
+DaliRegisters daliGears[DALI_GEAR_COUNT];
+DaliRegisters *dali = &daliGears[0];
+DaliCmd daliCmd;
 
-DaliRegisters dali;
+// Levels saved at the last power failure, for powerOnLevel DALI_LAST_ACTIVE_LEVEL
+// (see daliPowerOnLastLevel())
+static uint8_t powerOnLevels[EEPROM_POWER_FAIL_LEVELS];
+static uint8_t powerOnRestore = 0;      // powerOnLevels are valid, while daliInit() runs only
+
+static void daliFade(uint32_t cycles);
+
+
+// Time in Timer0 periods (TIMER0_PERIOD_US), wraps every 262ms
+// Interrupts must be disabled
+static uint16_t daliTimestamp(void)
+{
+    uint16_t time = schedulerTime;
+    uint8_t count = TCNT0;
+
+    // Tick interrupt pending (Timer0 cleared, schedulerTime not incremented yet)
+    if ((TIFR0 & (1 << OCF0A)) && (count < TIMER0_TOP / 2)) {
+        time++;
+    }
+    return time * (TIMER0_TOP + 1) + count;
+}
+
+
+// Instances addressed by an address byte, 0 if none
+// One table lookup whatever the number of instances: filtering and decoding a frame
+// take the same time for one gear or DALI_GEAR_COUNT.
+static uint8_t daliAddressedGears(uint8_t address)
+{
+    if ((address >= DALI_BROADCAST) ||                                  // Broadcast (1111 111x)
+        ((address & DALI_SPECIAL_CMD_MASK) == DALI_SPECIAL_CMD_1) ||    // Special commands (101x xxx1)
+        ((address & DALI_SPECIAL_CMD_MASK) == DALI_SPECIAL_CMD_2)) {    // and 110x xxx1
+        return DALI_ALL_GEARS;
+    }
+    if (address < 0xa0) {
+        return addressTable[address >> 1];      // Short address (0aaa aaax), group (100g gggx)
+    }
+    return 0;
+}
+
+
+// Forward frame received, from USART_RX_vect or the Manchester decoder (manchester.c)
+// Interrupts must be disabled
+void daliReceive(uint8_t address, uint8_t command)
+{
+    uint8_t head;
+
+    rxFrameCount++;
+    head = rxHead;
+    rxQueue[head].address = address;
+    rxQueue[head].command = command;
+    rxQueue[head].time = schedulerTime;
+    rxQueue[head].stamp = daliTimestamp();
+    ENTROPY_ADD(rxQueue[head].stamp);   // Frame arrival, 4us resolution
+
+    if (daliAddressedGears(address) == 0) {
+
+        // Frame for other gear: not queued, but it still cancels
+        // a pending send twice command or ENABLE DEVICE TYPE X
+        rxOtherGear = 1;
+    }
+    else if (txState != DALI_TX_IDLE) {
+
+        // Frames received while a BW frame is pending or being sent are ignored
+        rxDropCount++;
+    }
+    else {
+        rxQueue[head].otherGear = rxOtherGear;
+        head = (head + 1) & (DALI_RX_QUEUE_SIZE - 1);
+        if (head == rxTail) {
+            rxOverflowCount++;      // Queue is full, frame is lost
+        }
+        else {
+            rxHead = head;
+            rxOtherGear = 0;
+        }
+    }
+    daliRunning = 1;
+}
 
 
+#ifndef DALI_SOFT_MANCHESTER
 // This interrupt routine is called each time a new dali frame is received
 ISR(USART_RX_vect)
 {
 
     // Check if the 2 stop bits value are 1, frame is 16 bits long and no frame error occured
+    uint8_t address;
+
     if ((EUCSRC & (1 << FEM | 1 << F1617 | 3 << STP0)) == (3 << STP0)) {
-        newDaliAddress = EUDR;
-        newDaliCommand = UDR;
-        newRx = 1;
-        daliRunning = 1;
+        address = EUDR;
+        daliReceive(address, UDR);
     }
     else {
 
@@ -57,10 +186,12 @@ ISR(USART_RX_vect)
         // an error for the next valid frame... (hardware problem ?)
         // To avoid this problem, disabling receiver and renabling it clears flag
         // and all error flags!
+        rxErrorCount++;
         DALI_DISABLE_RX();
     }
     DALI_ENABLE_RX();
 }
+#endif
 
 // Dali base timing
 ISR(TIMER0_COMP_A_vect)
@@ -69,6 +200,70 @@ ISR(TIMER0_COMP_A_vect)
 }
 
 
+// Bus is down (interrupt), SCHEDULER_BUS_FAILURE is due: daliControlGear() applies
+// systemFailureLevel. The outputs are not changed here, the main loop may be
+// starting a fade.
+static void daliBusFailure(void)
+{
+    busFailure = 1;
+    busFailureCount++;
+}
+
+
+// Bus is back (first rising edge after a failure)
+static void daliBusRecovery(void)
+{
+    if (busFailure == 1) {
+        busFailure = 0;
+        busRecoveryCount++;
+        busRecoveryTime = schedulerTime;
+    }
+}
+
+
+#ifndef PWM_USE_TIMER1
+// DALI RX edge (ICP1A)
+// Every edge is captured: DALI_SOFT_MANCHESTER decodes the frames from them.
+ISR(TIMER1_CAPT_vect)
+{
+    if (TCCR1B & (1 << ICES1)) {
+
+        // Rising edge: bus is high
+        ENTROPY_ADD(ICR1L);     // Edge time, 16us resolution
+        TCCR1B &= ~(1 << ICES1);
+        TIMSK1 &= ~(1 << OCIE1A);
+        daliBusRecovery();
+#ifdef DALI_SOFT_MANCHESTER
+        manchesterEdge(ICR1, 1);
+#endif
+    }
+    else {
+
+        // Falling edge: bus failure if still low after BUS_FAILURE_TIMEOUT
+        ENTROPY_ADD(ICR1L);
+        TCCR1B |= (1 << ICES1);
+        OCR1A = ICR1 + BUS_FAILURE_TICKS;
+        TIFR1 = (1 << OCF1A);
+        TIMSK1 |= (1 << OCIE1A);
+#ifdef DALI_SOFT_MANCHESTER
+        manchesterEdge(ICR1, 0);
+#endif
+    }
+    TIFR1 = (1 << ICF1);        // Edge select changed
+}
+
+
+// Bus low for BUS_FAILURE_TIMEOUT
+ISR(TIMER1_COMPA_vect)
+{
+    TIMSK1 &= ~(1 << OCIE1A);
+    daliBusFailure();
+    schedulerPost(SCHEDULER_BUS_FAILURE);
+}
+#endif
+
+
+#ifndef DALI_SOFT_MANCHESTER
 // Configure EUSART
 void daliInitEUSART(void)
 {
@@ -96,8 +291,32 @@ void daliInitEUSART(void)
     DALI_DISABLE_RX();
     DALI_ENABLE_RX();
 }
+#endif
+
 
 
+// Configure Timer1 for the bus failure detection (input capture on DALI RX)
+// With PWM_USE_TIMER1, Timer1 is used by the PWM and the bus is sampled by daliTick()
+void daliInitBusMonitor(void)
+{
+#ifndef PWM_USE_TIMER1
+    TCCR1A = 0;                             // Normal mode
+    TCCR1B = (1 << ICNC1) |                 // Noise canceler
+             (0 << ICES1) |                 // Falling edge
+             BUS_TIMER_DIVIDER;
+    TIFR1 = (1 << ICF1) | (1 << OCF1A);
+    TIMSK1 = (1 << ICIE1);
+
+    // Bus already low at power up
+    if (DALI_RX() == 0) {
+        TCCR1B |= (1 << ICES1);
+        OCR1A = TCNT1 + BUS_FAILURE_TICKS;
+        TIFR1 = (1 << ICF1) | (1 << OCF1A);
+        TIMSK1 |= (1 << OCIE1A);
+    }
+#endif
+}
+
 
 // Configure Timer0
 void daliInitTimer0(void)
@@ -106,162 +325,375 @@ void daliInitTimer0(void)
     // Clear timer/counter on compareA match
     TCCR0A = (1 << WGM01);
 
-    // Timer0 divider :8
-    TCCR0B = TIMER0_DIVIDER_8;
+    // Timer0 divider :64
+    TCCR0B = TIMER0_DIVIDER_64;
 
     // Set CTC max value
-    OCR0A = (uint8_t)((F_CLKIO / (2 * 8 * F_DALI_TICK)) - 1);
+    OCR0A = (uint8_t)TIMER0_TOP;
 
     // Enable Timer/Counter1, Output Compare A Match Interrupt
     TIMSK0 = (1 << OCIE0A);
 }
 
 
-// Initialise DALI registers
+// Rebuild the table of the instances addressed by each short address and group
+// Must be called each time a short address or the groups change
+void daliUpdateAddressTable(void)
+{
+    DaliRegisters *gear;
+    uint8_t n;
+    uint8_t group;
+
+    for (n = 0; n < DALI_ADDRESS_TABLE_SIZE; n++) {
+        addressTable[n] = 0;
+    }
+
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        gear = &daliGears[n];
+
+        // Short address (0aaa aaax), instances may share one
+        if (gear->shortAddress < 64) {
+            addressTable[gear->shortAddress] |= 1 << n;
+        }
+
+        // Groups (100g gggx), a gear may belong to several groups
+        for (group = 0; group < 16; group++) {
+            if (gear->group & ((uint16_t)1 << group)) {
+                addressTable[64 + group] |= 1 << n;
+            }
+        }
+    }
+}
+
+
+// Registers of the selected instance in the eeprom record (see ADD_xxx)
+void daliEepromWrite(uint8_t address, uint8_t value)
+{
+    eepromCacheWrite(dali->channel * DALI_EEPROM_SIZE + address, value);
+}
+
+
+static uint8_t daliEepromRead(uint8_t address)
+{
+    return eepromCacheRead(dali->channel * DALI_EEPROM_SIZE + address);
+}
+
+
+// Power on at the last active level (DALI-2, powerOnLevel DALI_LAST_ACTIVE_LEVEL)
+// The output starts at the level it had when the supply failed, then resumes the fade
+// that was interrupted. Nothing saved (or RESET): maximum level.
+static void daliPowerOnLastLevel(void)
+{
+    uint8_t level = powerOnLevels[2 * dali->channel];
+    uint8_t target = powerOnLevels[2 * dali->channel + 1];
+
+    if (powerOnRestore == 0) {
+        dali->actualDimLevel = 0xfe;
+        return;
+    }
+
+    dali->actualDimLevel = level;
+    if (target != level) {
+        fadeOutput(dali->channel, level);       // The fade starts from the saved level
+        requestedLevel = target;
+        daliFade(daliFadeTimeCycles());
+    }
+}
+
+
+// Initialise the registers of the selected instance (power up, RESET)
 // Load eeprom if previous values exist
-void daliInit(void)
+void daliInitGear(void)
 {
     uint8_t n;
 
-    dali.cmdType = DALI_CMD_TYPE_NONE;
-    dali.addressByte = 0;
-    dali.commandByte = 0;
-    dali.dtr = 0;
+    dali->dtr = 0;
+    dali->dtr1 = 0;
+    dali->dtr2 = 0;
 
     // The following reset values are determined by dali standard
-    dali.actualDimLevel     = 0xfe;
-    dali.powerOnLevel       = 0xfe;
-    dali.systemFailureLevel = 0xfe;
-    dali.minLevel           = DALI_PHYSICAL_MIN_LEVEL;
-    dali.maxLevel           = 0xfe;
-    dali.fadeRate           = 0x07;
-    dali.fadeTime           = 0;
-//     dali.shortAddress       = 0;
-    dali.searchAddressH     = 0xff;
-    dali.searchAddressM     = 0xff;
-    dali.searchAddressL     = 0xff;
-    dali.randomAddressH     = 0xff;
-    dali.randomAddressM     = 0xff;
-    dali.randomAddressL     = 0xff;
-    dali.group              = 0x0000;
+    dali->actualDimLevel     = 0xfe;
+    dali->powerOnLevel       = 0xfe;
+    dali->systemFailureLevel = 0xfe;
+    dali->minLevel           = DALI_PHYSICAL_MIN_LEVEL;
+    dali->maxLevel           = 0xfe;
+    dali->fadeRate           = 0x07;
+    dali->fadeTime           = 0;
+    dali->extendedFadeTime   = 0;
+    dali->fastFadeTime       = 0;
+//     dali->shortAddress       = 0;
+    dali->searchAddressH     = 0xff;
+    dali->searchAddressM     = 0xff;
+    dali->searchAddressL     = 0xff;
+    dali->randomAddressH     = 0xff;
+    dali->randomAddressM     = 0xff;
+    dali->randomAddressL     = 0xff;
+    dali->group              = 0x0000;
+    for (n = 0; n < 16; n++) {
+        dali->scene[n]         = 0xff;
+    }
+    dali->dimmingCurve       = DIMMING_CURVE_LOGARITHMIC;
+#ifdef DALI_DT8
+    dali->temporaryColourTemperature = COLOUR_MASK;
+    dali->colourTemperatureCoolest   = COLOUR_TC_PHYSICAL_COOLEST;
+    dali->colourTemperatureWarmest   = COLOUR_TC_PHYSICAL_WARMEST;
+    dali->powerOnColourTemperature   = COLOUR_TC_PHYSICAL_WARMEST;
     for (n = 0; n < 16; n++) {
-        dali.scene[n]         = 0xff;
-    }
-    dali.status.powerFailure        = 1;    // MSB
-    dali.status.missingShortAddress = 1;
-    dali.status.resetState          = 1;
-    dali.status.fadeRunning         = 0;
-    dali.status.limitError          = 0;
-    dali.status.lampOn              = 1;
-    dali.status.lampFailure         = 0;
-    dali.status.ballastFailure      = 0;    // LSB
-//     dali.status.statusInformation = 0xe4;   // As described above
+        dali->sceneColourTemperature[n] = COLOUR_MASK;
+    }
+    dali->gearFeatures       = DALI_GEAR_FEATURE_AUTO_ACTIVATION;
+    dali->colourStatus       = 0;
+#endif
+    dali->status.powerFailure        = 1;    // MSB
+    dali->status.missingShortAddress = 1;
+    dali->status.resetState          = 1;
+    dali->status.fadeRunning         = 0;
+    dali->status.limitError          = 0;
+    dali->status.lampOn              = 1;
+    dali->status.lampFailure         = 0;
+    dali->status.ballastFailure      = 0;    // LSB
+//     dali->status.statusInformation = 0xe4;   // As described above
+    dali->specialModeTimeout = 0;
+    dali->compareMode = 0;
+    dali->physicalSelectionMode = PHYSICAL_SELECTION_DISABLED;
+    dali->memoryWriteEnabled = 0;
 
     // TODO: add a procedure to reset the eeprom if a switch is on at startup
-    if (eeprom_read_byte(ADD_EEPROM_STATUS) == EEPROM_INITIALIZED) {
+    if (daliEepromRead(ADD_EEPROM_STATUS) == EEPROM_INITIALIZED) {
 
         // eeprom contains previsously saved values, load
-        dali.powerOnLevel = eeprom_read_byte((const uint8_t*)ADD_POWER_ON_LEVEL);
-        dali.systemFailureLevel = eeprom_read_byte((const uint8_t*)ADD_SYSTEM_FAILURE_LEVEL);
-        dali.minLevel = eeprom_read_byte((const uint8_t*)ADD_MIN_LEVEL);
-        dali.maxLevel = eeprom_read_byte((const uint8_t*)ADD_MAX_LEVEL);
-        dali.fadeRate = eeprom_read_byte((const uint8_t*)ADD_FADE_RATE);
-        dali.fadeTime = eeprom_read_byte((const uint8_t*)ADD_FADE_TIME);
-        dali.shortAddress = eeprom_read_byte((const uint8_t*)ADD_SHORT_ADD);
-        dali.randomAddressH = eeprom_read_byte((const uint8_t*)ADD_RANDOM_ADDH);
-        dali.randomAddressM = eeprom_read_byte((const uint8_t*)ADD_RANDOM_ADDM);
-        dali.randomAddressL = eeprom_read_byte((const uint8_t*)ADD_RANDOM_ADDL);
-        dali.group |= (eeprom_read_byte((const uint8_t*)ADD_GROUPH)) << 8;
-        dali.group |= (eeprom_read_byte((const uint8_t*)ADD_GROUPL));
+        dali->powerOnLevel = daliEepromRead(ADD_POWER_ON_LEVEL);
+        dali->systemFailureLevel = daliEepromRead(ADD_SYSTEM_FAILURE_LEVEL);
+        dali->minLevel = daliEepromRead(ADD_MIN_LEVEL);
+        dali->maxLevel = daliEepromRead(ADD_MAX_LEVEL);
+        dali->fadeRate = daliEepromRead(ADD_FADE_RATE);
+        dali->fadeTime = daliEepromRead(ADD_FADE_TIME);
+        dali->extendedFadeTime = daliEepromRead(ADD_EXTENDED_FADE_TIME);
+        dali->fastFadeTime = daliEepromRead(ADD_FAST_FADE_TIME);
+        dali->shortAddress = daliEepromRead(ADD_SHORT_ADD);
+        dali->randomAddressH = daliEepromRead(ADD_RANDOM_ADDH);
+        dali->randomAddressM = daliEepromRead(ADD_RANDOM_ADDM);
+        dali->randomAddressL = daliEepromRead(ADD_RANDOM_ADDL);
+        dali->group |= (daliEepromRead(ADD_GROUPH)) << 8;
+        dali->group |= (daliEepromRead(ADD_GROUPL));
         for (n = 0; n < 16; n++) {
-            dali.scene[n] = eeprom_read_byte((const uint8_t*)(ADD_SCENE_0 + n));
+            dali->scene[n] = daliEepromRead(ADD_SCENE_0 + n);
         }
+        dali->dimmingCurve = daliEepromRead(ADD_DIMMING_CURVE);
+#ifdef DALI_DT8
+        dali->colourTemperatureCoolest = colourDecode(daliEepromRead(ADD_TC_COOLEST));
+        dali->colourTemperatureWarmest = colourDecode(daliEepromRead(ADD_TC_WARMEST));
+        dali->powerOnColourTemperature = colourDecode(daliEepromRead(ADD_TC_POWER_ON));
+        for (n = 0; n < 16; n++) {
+            dali->sceneColourTemperature[n] = colourDecode(daliEepromRead(ADD_TC_SCENE_0 + n));
+        }
+        dali->gearFeatures = daliEepromRead(ADD_GEAR_FEATURES);
+#endif
 
         // If eeprom is loaded, the device is not in reset state any more.
-        dali.status.resetState = 0;
+        dali->status.resetState = 0;
     }
     else {
 
         // eeprom is empty, save
-        eeprom_write_byte((uint8_t*)ADD_POWER_ON_LEVEL, dali.powerOnLevel);
-        eeprom_write_byte((uint8_t*)ADD_SYSTEM_FAILURE_LEVEL, dali.systemFailureLevel);
-        eeprom_write_byte((uint8_t*)ADD_MIN_LEVEL, dali.minLevel);
-        eeprom_write_byte((uint8_t*)ADD_MAX_LEVEL, dali.maxLevel);
-        eeprom_write_byte((uint8_t*)ADD_FADE_RATE, dali.fadeRate);
-        eeprom_write_byte((uint8_t*)ADD_FADE_TIME, dali.fadeTime);
-        eeprom_write_byte((uint8_t*)ADD_SHORT_ADD, dali.shortAddress);      // TODO: Read from dip switches?
-        eeprom_write_byte((uint8_t*)ADD_RANDOM_ADDH, dali.randomAddressH);
-        eeprom_write_byte((uint8_t*)ADD_RANDOM_ADDM, dali.randomAddressM);
-        eeprom_write_byte((uint8_t*)ADD_RANDOM_ADDL, dali.randomAddressL);
-        eeprom_write_byte((uint8_t*)ADD_GROUPH, ((uint8_t)(dali.group >> 8)));
-        eeprom_write_byte((uint8_t*)ADD_GROUPL, ((uint8_t)(dali.group)));
+        daliEepromWrite(ADD_POWER_ON_LEVEL, dali->powerOnLevel);
+        daliEepromWrite(ADD_SYSTEM_FAILURE_LEVEL, dali->systemFailureLevel);
+        daliEepromWrite(ADD_MIN_LEVEL, dali->minLevel);
+        daliEepromWrite(ADD_MAX_LEVEL, dali->maxLevel);
+        daliEepromWrite(ADD_FADE_RATE, dali->fadeRate);
+        daliEepromWrite(ADD_FADE_TIME, dali->fadeTime);
+        daliEepromWrite(ADD_EXTENDED_FADE_TIME, dali->extendedFadeTime);
+        daliEepromWrite(ADD_FAST_FADE_TIME, dali->fastFadeTime);
+        daliEepromWrite(ADD_SHORT_ADD, dali->shortAddress);      // TODO: Read from dip switches?
+        daliEepromWrite(ADD_RANDOM_ADDH, dali->randomAddressH);
+        daliEepromWrite(ADD_RANDOM_ADDM, dali->randomAddressM);
+        daliEepromWrite(ADD_RANDOM_ADDL, dali->randomAddressL);
+        daliEepromWrite(ADD_GROUPH, ((uint8_t)(dali->group >> 8)));
+        daliEepromWrite(ADD_GROUPL, ((uint8_t)(dali->group)));
+        for (n = 0; n < 16; n++) {
+            daliEepromWrite(ADD_SCENE_0 + n, dali->scene[n]);
+        }
+        daliEepromWrite(ADD_DIMMING_CURVE, dali->dimmingCurve);
+#ifdef DALI_DT8
+        daliEepromWrite(ADD_TC_COOLEST, colourEncode(dali->colourTemperatureCoolest));
+        daliEepromWrite(ADD_TC_WARMEST, colourEncode(dali->colourTemperatureWarmest));
+        daliEepromWrite(ADD_TC_POWER_ON, colourEncode(dali->powerOnColourTemperature));
         for (n = 0; n < 16; n++) {
-            eeprom_write_byte(((uint8_t*)(ADD_SCENE_0 + n)), dali.scene[n]);
+            daliEepromWrite(ADD_TC_SCENE_0 + n, colourEncode(dali->sceneColourTemperature[n]));
         }
-        eeprom_write_byte((uint8_t*)ADD_EEPROM_STATUS, (uint8_t)EEPROM_INITIALIZED);
+        daliEepromWrite(ADD_GEAR_FEATURES, dali->gearFeatures);
+#endif
+        daliEepromWrite(ADD_EEPROM_STATUS, (uint8_t)EEPROM_INITIALIZED);
     }
 
     // Check if short address exists :
-    if (dali.shortAddress == 0xff) {
-        dali.status.missingShortAddress = 1;
+    if (dali->shortAddress == 0xff) {
+        dali->status.missingShortAddress = 1;
     }
     else {
-        dali.status.missingShortAddress = 0;
+        dali->status.missingShortAddress = 0;
     }
 
+    // Unknown curve (not built in this firmware) falls back to logarithmic
+    dali->dimmingCurve = dimmingCurveSelect(dali->channel, dali->dimmingCurve);
+
+    fadeStop(dali->channel);
+#ifdef DALI_DT8
+    daliColourSet(dali->powerOnColourTemperature, 0);
+#endif
+    if (dali->powerOnLevel == DALI_LAST_ACTIVE_LEVEL) {
+        daliPowerOnLastLevel();
+    }
+    else {
+        dali->actualDimLevel = dali->powerOnLevel;
+    }
+}
+
+
+// Initialise the registers of all the instances
+// Without eeprom, the short address of an instance is its index
+void daliInitRegisters(void)
+{
+    uint8_t n;
+
+    daliCmd.type = DALI_CMD_TYPE_NONE;
+    daliCmd.addressByte = 0;
+    daliCmd.commandByte = 0;
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        dali = &daliGears[n];
+        dali->channel = n;
+        dali->shortAddress = n;
+        daliInitGear();
+    }
+    daliUpdateAddressTable();
     daliRunning = 0;
-    dali.actualDimLevel = dali.powerOnLevel;
+}
+
+
+// Initialise DALI at power up
+void daliInit(void)
+{
+
+    // Load the newest valid eeprom record (one block read), and the levels saved
+    // at the last power failure
+    eepromCacheInit();
+    powerOnRestore = eepromCachePowerFailRead(powerOnLevels);
+    daliInitRegisters();
+    powerOnRestore = 0;
 
+    // The eeprom is written once the output is lit and the supply has settled
+    schedulerStart(SCHEDULER_BOOT, BOOT_BACKGROUND_DELAY, 0);
+
+#ifdef DALI_SOFT_MANCHESTER
+    manchesterInit();
+#else
     daliInitEUSART();
+#endif
     daliInitTimer0();
+    daliInitBusMonitor();
 }
 
 
 // This function must be called every 1 ms
-// Update counters
+// Update timers, handle the ones which need an immediate action
 void daliTick(void)
 {
-    tick1msCounter++;       // Increase counter
-    if (timeout != 0) {
-        timeout--;
+    uint8_t due;
+
+    due = schedulerTick();
+
+    // Backward frame transmission
+    if (due & SCHEDULER_MASK(SCHEDULER_TX)) {
+        if (txState == DALI_TX_WAIT) {
+#ifdef DALI_SOFT_MANCHESTER
+            manchesterSend(txData);
+#else
+            UDR = txData;           // Writing UDR starts byte transmission
+#endif
+            txState = DALI_TX_SENDING;
+            schedulerStart(SCHEDULER_TX, DALI_BW_FRAME_DURATION, 0);
+        }
+        else {
+            txState = DALI_TX_IDLE;
+        }
+    }
+
+#ifdef PWM_USE_TIMER1
+    // Bus failure: bus low (idle state is high) during BUS_FAILURE_TIMEOUT
+    if (due & SCHEDULER_MASK(SCHEDULER_BUS_FAILURE)) {
+        daliBusFailure();
+    }
+    if (DALI_RX() == 0) {
+        if (busLow == 0) {
+            busLow = 1;
+            schedulerStart(SCHEDULER_BUS_FAILURE, BUS_FAILURE_TIMEOUT, 0);
+        }
     }
+    else if (busLow == 1) {
+        busLow = 0;
+        schedulerStop(SCHEDULER_BUS_FAILURE);
+        daliBusRecovery();
+    }
+#endif
     return;
 }
 
 
-// Updates actualDimLevel during fading
-void daliStepOutputPower(uint8_t sense)
+// Fade to requestedLevel in 'cycles' PWM cycles (0 : immediately)
+// actualDimLevel is updated by daliControlGear() while fading
+// Tunable white: the temporary colour fades with the level (automatic activation)
+static void daliFade(uint32_t cycles)
 {
-  dali.status.fadeRunning = 1;
+    if (cycles != 0) {
+        fadeStart(dali->channel, requestedLevel, dali->minLevel, cycles);
+        dali->status.fadeRunning = 1;
+        schedulerStart(SCHEDULER_FADE, FADE_UPDATE_PERIOD, FADE_UPDATE_PERIOD);
+    }
+    else {
+        daliStopFade();
+        dali->actualDimLevel = requestedLevel;
+    }
+#ifdef DALI_DT8
+    if (dali->gearFeatures & DALI_GEAR_FEATURE_AUTO_ACTIVATION) {
+        daliColourActivate(cycles);
+    }
+#endif
+}
 
-    if (sense == UP) {
 
-        // Step up arc power level
-        if (dali.actualDimLevel == 0) {
-            dali.actualDimLevel = dali.minLevel;
-        }
-        else {
-            if (dali.actualDimLevel < dali.maxLevel) {
-                dali.actualDimLevel++;
-            }
-        }
+// Stop fading, actualDimLevel is the level reached
+// SCHEDULER_FADE is stopped by daliControlGear() once no instance is fading
+void daliStopFade(void)
+{
+    fadeStop(dali->channel);
+    if (dali->status.fadeRunning == 1) {
+        dali->actualDimLevel = fadeLevel(dali->channel);
+#ifdef DALI_DT8
+        dali->colourTemperature = colourMixToTc(fadeMix());
+#endif
+        dali->status.fadeRunning = 0;
     }
-    else {
+}
 
-        // Step down arc power level
-        if (dali.actualDimLevel > dali.minLevel) {
-            dali.actualDimLevel--;
-        }
-        else {
-            dali.actualDimLevel = 0;
-        }
+
+// Fade time, in PWM cycles
+// fadeTime is used if not 0, then fastFadeTime, then extendedFadeTime
+uint32_t daliFadeTimeCycles(void)
+{
+    uint8_t multiplier;
+
+    if (dali->fadeTime != 0) {
+        return pgm_read_dword(&FADE_TIME[dali->fadeTime]);
+    }
+    if (dali->fastFadeTime != 0) {
+        return dali->fastFadeTime * FADE_CYCLES(DALI_FAST_FADE_STEP);
     }
 
-    // Disable fading if requested level is reached
-    if (dali.actualDimLevel == requestedLevel) {
-        fadePeriod = 0;
-        dali.status.fadeRunning = 0;
+    multiplier = dali->extendedFadeTime >> 4;
+    if ((multiplier == 0) || (dali->extendedFadeTime > DALI_EXTENDED_FADE_TIME_MAX)) {
+        return 0;
     }
+    return ((dali->extendedFadeTime & 0x0f) + 1) * pgm_read_dword(&EXTENDED_FADE_TIME[multiplier]);
 }
 
 
@@ -271,92 +703,84 @@ void daliChangeOutputWithFadeTime(void)
     if (requestedLevel != 0xff) {
 
         // Limits checking
-        dali.status.limitError = 0;
-        if (requestedLevel < dali.minLevel && requestedLevel != 0) {
-            requestedLevel = dali.minLevel;
-            dali.status.limitError = 1;
+        dali->status.limitError = 0;
+        if (requestedLevel < dali->minLevel && requestedLevel != 0) {
+            requestedLevel = dali->minLevel;
+            dali->status.limitError = 1;
         }
-        if (requestedLevel > dali.maxLevel){
-            requestedLevel = dali.maxLevel;
-            dali.status.limitError = 1;
+        if (requestedLevel > dali->maxLevel){
+            requestedLevel = dali->maxLevel;
+            dali->status.limitError = 1;
         }
 
-        // Fading != 0?
-        if (dali.fadeTime != 0) {
-            if (requestedLevel >  dali.actualDimLevel+1) {   // Minimum of 2 steps (avoid fadePeriod > maxuint16_t)
-                if (dali.actualDimLevel == 0) {
-                    fadePeriod = FADE_TIME[dali.fadeTime] / (requestedLevel - dali.minLevel+1);
-                }
-                else {
-                    fadePeriod = FADE_TIME[dali.fadeTime] / (requestedLevel - dali.actualDimLevel);
-                }
-
-                dimSens = UP;
-            }
-            else {
-                if (requestedLevel <  dali.actualDimLevel-1) {   // Minimum of 2 steps (avoid fadePeriod > maxuint16_t)
-                    if (dali.commandByte == 0) {
-                        fadePeriod = FADE_TIME[dali.fadeTime] / (dali.actualDimLevel - dali.minLevel+1);
-                    }
-                    else {
-                        fadePeriod = FADE_TIME[dali.fadeTime] / (dali.actualDimLevel - requestedLevel);
-                    }
-
-                    dimSens = DOWN;
-                }
-                else {
-
-                    // Requested level is closed to actual level, fading will not be enabled
-                    fadePeriod = 0;    // setting fadePeriod to 0 disables fading!
-                    dali.actualDimLevel = requestedLevel;
-                }
-            }
-            if (dali.fadeTime == 15) {
-
-                // 90.510s value does not fit in uint16_t.
-                // FADE_TIME[15] = 45.255 and is then multiplied by 2
-                fadePeriod = fadePeriod<<1;
-            }
-        }
-        else{
-            fadePeriod = 0;    // Setting fadePeriod to 0 disables fading!
-            dali.actualDimLevel = requestedLevel;
-        }
+        // Fade time is the same whatever the distance to the requested level
+        daliFade(daliFadeTimeCycles());
     }
     else {
 
-        // fade time == 0, immediately set the requested level
-        requestedLevel = dali.actualDimLevel;
-        fadePeriod = 0;
+        // Mask: stop fading
+        daliStopFade();
+        requestedLevel = dali->actualDimLevel;
+    }
+}
+
+
+#ifdef DALI_DT8
+
+// Colour temperature 'tc' (mirek), within the limits, fading in 'cycles' PWM cycles
+// (0: immediately). With the cycles of a level fade, both fade in lockstep.
+void daliColourSet(uint16_t tc, uint32_t cycles)
+{
+    dali->colourStatus &= ~DALI_COLOUR_STATUS_TC_OUT_OF_RANGE;
+    if (tc < dali->colourTemperatureCoolest) {
+        tc = dali->colourTemperatureCoolest;
+        dali->colourStatus |= DALI_COLOUR_STATUS_TC_OUT_OF_RANGE;
+    }
+    if (tc > dali->colourTemperatureWarmest) {
+        tc = dali->colourTemperatureWarmest;
+        dali->colourStatus |= DALI_COLOUR_STATUS_TC_OUT_OF_RANGE;
+    }
+
+    dali->colourTemperature = tc;
+    fadeMixStart(colourTcToMix(tc), cycles);
+    if (cycles != 0) {
+        dali->status.fadeRunning = 1;
+        schedulerStart(SCHEDULER_FADE, FADE_UPDATE_PERIOD, FADE_UPDATE_PERIOD);
+    }
+}
+
+
+// Apply the temporary colour (ACTIVATE, automatic activation, scenes)
+void daliColourActivate(uint32_t cycles)
+{
+    uint16_t tc = dali->temporaryColourTemperature;
+
+    if (tc != COLOUR_MASK) {
+        dali->temporaryColourTemperature = COLOUR_MASK;
+        daliColourSet(tc, cycles);
     }
 }
 
+#endif
+
 
 // Used with 'DALI_CMD_UP_200ms' command
 void daliUpOutputWithFadeRate(void)
 {
 
     // Check if the lamp is on, and fade rate is != 0
-    if ((dali.fadeRate != 0) && (dali.status.lampOn == 1)) {
+    if ((dali->fadeRate != 0) && (dali->status.lampOn == 1)) {
+        daliStopFade();
 
         // Check limits
-        if (dali.actualDimLevel < (dali.maxLevel - FADE_RATE[dali.fadeRate])) {
-            requestedLevel = FADE_RATE[dali.fadeRate] + dali.actualDimLevel;
+        if (dali->actualDimLevel < (dali->maxLevel - FADE_RATE[dali->fadeRate])) {
+            requestedLevel = FADE_RATE[dali->fadeRate] + dali->actualDimLevel;
         }
         else {
-            requestedLevel = dali.maxLevel;
+            requestedLevel = dali->maxLevel;
         }
 
-        if (requestedLevel != dali.actualDimLevel) {
-            fadePeriod = 200 / (requestedLevel - dali.actualDimLevel);
-            dimSens = UP;
-        }
-        else {
-            fadePeriod = 0;
-        }
-    }
-    else {
-      fadePeriod = 0;  // Setting fadePeriod to 0 disables fading!
+        daliFade(((requestedLevel - dali->actualDimLevel) * pgm_read_dword(&FADE_RATE_PERIOD[dali->fadeRate])) >> 8);
     }
 }
 
@@ -365,252 +789,305 @@ void daliUpOutputWithFadeRate(void)
 void daliDownOutputWithFadeRate(void)
 {
     // Check if the lamp is on, and fade rate is != 0
-    if ((dali.fadeRate != 0) && (dali.status.lampOn == 1)) {
+    if ((dali->fadeRate != 0) && (dali->status.lampOn == 1)) {
+        daliStopFade();
 
         // check limits
-        if (dali.actualDimLevel > (dali.minLevel + FADE_RATE[dali.fadeRate])) {
-            requestedLevel =  dali.actualDimLevel - FADE_RATE[dali.fadeRate];
+        if (dali->actualDimLevel > (dali->minLevel + FADE_RATE[dali->fadeRate])) {
+            requestedLevel =  dali->actualDimLevel - FADE_RATE[dali->fadeRate];
         }
         else {
-            requestedLevel = dali.minLevel;
+            requestedLevel = dali->minLevel;
         }
 
-        if (requestedLevel != dali.actualDimLevel) {
-            fadePeriod = 200 / (dali.actualDimLevel - requestedLevel);
-            dimSens = DOWN;
-        }
-        else {
-            fadePeriod = 0;
-        }
-    }
-    else {
-        fadePeriod = 0;    // Setting fadePeriod to 0 disables fading!
+        daliFade(((dali->actualDimLevel - requestedLevel) * pgm_read_dword(&FADE_RATE_PERIOD[dali->fadeRate])) >> 8);
     }
 }
 
 
 // Sends a byte in a BW frame
-// TODO: use _delay_ms() from avr-lib
+// Does not wait: the frame is sent by daliTick() DALI_BW_DELAY ms after the FW frame arrival (rxFrameTime).
+// The answer is dropped if it is too late to start in the response window.
 void daliAnswer(uint8_t answer)
 {
-    timeout = 3;            // Delay of 3ms (minimum time between forward & backward frames)
-    while (timeout != 0) {
-    }
+    uint8_t elapsed;
 
-    UDR = answer;           // Writing UDR starts byte transmission
+    if (txState != DALI_TX_IDLE) {
+        return;
+    }
 
-    timeout = 10;           // Delay of 10ms (backward frame duration)
-    while (timeout != 0) {
+    elapsed = (uint8_t)schedulerTime - (uint8_t)rxFrameTime;
+    if (elapsed >= DALI_BW_MAX_DELAY) {
+        return;
     }
 
-    newRx = 0;
+    // txState is set first: the timer may expire at the next tick
+    txData = answer;
+    txState = DALI_TX_WAIT;
+    if (elapsed >= DALI_BW_DELAY) {
+        schedulerStart(SCHEDULER_TX, 1, 0);
+    }
+    else {
+        schedulerStartAt(SCHEDULER_TX, rxFrameTime + DALI_BW_DELAY, 0);
+    }
 }
 
 
-// Update arc power level
+// Update arc power level of the instance 'gear' (selected)
 // Returns the output level required (1 - 254)
-uint8_t daliOutputPower(void)
+uint8_t daliOutputPower(uint8_t gear)
 {
+    dali = &daliGears[gear];
 
-    // Output power level is contained in dali.actualDimLevel
-    // If dali.actualDimLevel < dali.minLevel, the lamp is off
-    if (dali.actualDimLevel >= dali.minLevel) {
-        if (dali.actualDimLevel > dali.maxLevel) {
-            dali.actualDimLevel = dali.maxLevel;
+    // Output power level is contained in dali->actualDimLevel
+    // If dali->actualDimLevel < dali->minLevel, the lamp is off
+    if (dali->actualDimLevel >= dali->minLevel) {
+        if (dali->actualDimLevel > dali->maxLevel) {
+            dali->actualDimLevel = dali->maxLevel;
         }
-        dali.status.lampOn = 1;
-        return dali.actualDimLevel;
+        dali->status.lampOn = 1;
+        return dali->actualDimLevel;
     }
     else {
-        dali.status.lampOn = 0;
+        dali->status.lampOn = 0;
         return 0;
     }
 }
 
+// Send twice commands
+// Returns 1 if the frame repeats the previous one within SEND_TWICE_WINDOW (arrival times)
+// Otherwise the frame is stored as the first one
+// The window ends at the deadline of SCHEDULER_SEND_TWICE
+static uint8_t storedDaliAddress = 0x00;
+static uint8_t storedDaliCommand = 0x00;
+static uint8_t sendTwicePending = 0;
+uint16_t sendTwiceTimeoutCount = 0;     // First frames not repeated in time (see daliMemory.h)
+
+static uint8_t daliSendTwice(uint8_t pending)
+{
+    if (pending &&
+        (daliCmd.addressByte == storedDaliAddress) && (daliCmd.commandByte == storedDaliCommand) &&
+        ((int16_t)(rxFrameTime - schedulerDeadline(SCHEDULER_SEND_TWICE)) <= 0)) {
+        schedulerStop(SCHEDULER_SEND_TWICE);
+        return 1;
+    }
+
+    // first time command is received
+    storedDaliAddress = daliCmd.addressByte;
+    storedDaliCommand = daliCmd.commandByte;
+    sendTwicePending = 1;
+    schedulerStartAt(SCHEDULER_SEND_TWICE, rxFrameTime + SEND_TWICE_WINDOW, 0);
+    return 0;
+}
+
+
 // Address_byte processing.
-// Updates cmdType value
+// Takes the oldest frame from the queue, looks up its command descriptor
+// and updates cmdType value (DALI_CMD_TYPE_NONE if the command is ignored)
 void daliAnalyse(void)
 {
-    static uint8_t storedDaliAddress = 0x00;
-    static uint8_t storedDaliCommand = 0x00;
+    uint8_t tail = rxTail;
+    uint8_t pending = sendTwicePending;
+    uint8_t deviceType = enabledDeviceType;
+    const DaliCommand *command;
+    uint8_t flags;
+    uint16_t latency;
+
+    // Time from reception to processing (main loop wake up included)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        latency = daliTimestamp() - rxQueue[tail].stamp;
+    }
+    if (latency > rxLatencyMax) {
+        rxLatencyMax = latency;
+    }
+
+    daliCmd.addressByte = rxQueue[tail].address;
+    daliCmd.commandByte = rxQueue[tail].command;
+    rxFrameTime = rxQueue[tail].time;
+    if (rxQueue[tail].otherGear) {
+        pending = 0;
+        deviceType = DALI_MASK;
+    }
+    rxTail = (tail + 1) & (DALI_RX_QUEUE_SIZE - 1);
+
+    // Any frame in between cancels a pending send twice command or ENABLE DEVICE TYPE X
+    sendTwicePending = 0;
+    enabledDeviceType = DALI_MASK;
+    daliCmd.type = DALI_CMD_TYPE_NONE;
+    daliCmd.gears = daliAddressedGears(daliCmd.addressByte);
 
-    dali.addressByte = newDaliAddress;
-    dali.commandByte = newDaliCommand;
+    if (daliCmd.gears == 0) {
 
-    if (((dali.addressByte & DALI_SPECIAL_CMD_MASK) == DALI_SPECIAL_CMD_1) ||
-        ((dali.addressByte & DALI_SPECIAL_CMD_MASK) == DALI_SPECIAL_CMD_2)) {
+        // Frames are filtered in USART_RX_vect, but the table may have changed since
+        // (e.g. new short address while frames are queued)
+        return;
+    }
+    else if (((daliCmd.addressByte & DALI_SPECIAL_CMD_MASK) == DALI_SPECIAL_CMD_1) ||
+             ((daliCmd.addressByte & DALI_SPECIAL_CMD_MASK) == DALI_SPECIAL_CMD_2)) {
 
         // Special command received (101x xxx1 or 110x xxx1)
-        if ((dali.addressByte == DALI_CMD_INITIALIZE) || (dali.addressByte == DALI_CMD_RANDOMISE)) {
-            if (timeout == 0) {            // first time command is received
-                timeout = FW_FW_DELAY;     // 100ms delay (84 + FW frame duration)
-                storedDaliAddress = dali.addressByte;
-                storedDaliCommand = dali.commandByte;
-                dali.cmdType = DALI_CMD_TYPE_NONE;
-            }
-            else {              // second time command is received
-                timeout = 0;    // disable 100ms timer
-                if ((dali.addressByte == storedDaliAddress) && (dali.commandByte == storedDaliCommand)) {
-                    dali.cmdType = DALI_CMD_TYPE_SPECIAL_CMD;
-                }
-                else {
-                    dali.cmdType = DALI_CMD_TYPE_NONE;
-                }
-            }
-        }
-        else {
-            dali.cmdType = DALI_CMD_TYPE_SPECIAL_CMD;
+        command = &DALI_SPECIAL_COMMANDS[DALI_SPECIAL_CMD_INDEX(daliCmd.addressByte)];
+    }
+    else if ((daliCmd.addressByte & DALI_SELECTOR_BIT_MASK) == DALI_DIRECT_ARC_POWER_CMD) {
+        if (daliCmd.commandByte != MASK) {
+            daliCmd.type = DALI_CMD_TYPE_DIRECT_ARC_POWER;
         }
         return;
     }
     else {
-        if (((dali.addressByte & DALI_BROADCAST) == DALI_BROADCAST) ||
-            (((dali.addressByte & 0x80) == 0x00) && (((dali.addressByte >> 1) & 0x3f) == dali.shortAddress)) ||
-            (((dali.addressByte & 0x80) == 0x80) && (((dali.addressByte >> 1) & 0x0f) == dali.group))) {
-
-            // Address is accepted
-            switch (dali.addressByte & DALI_SELECTOR_BIT_MASK) {
-                case DALI_DIRECT_ARC_POWER_CMD:
-                    if (dali.commandByte == 0xff) {
-                        dali.cmdType = DALI_CMD_TYPE_NONE;
-                        return;
-                    }
-                    dali.cmdType = DALI_CMD_TYPE_DIRECT_ARC_POWER;
-                    return;
-                    break;
+        command = &DALI_COMMANDS[daliCmd.commandByte];
+    }
 
-                case DALI_COMAND_FOLLOWING_CMD:
-                   if (dali.commandByte < DALI_CMD_RESET) {
-                        dali.cmdType = DALI_CMD_TYPE_INDIRECT_ARC_POWER;
-                        return;
-                    }
-                    else {
-                        if (dali.commandByte <= DALI_CMD_STORE_DTR_AS_SHORT_ADDRESS) {
-
-                            // Config. command receive (first)
-                            // Command needs to be confirmed within 100ms
-                            if (timeout == 0) {    // first time command is received
-                                timeout = FW_FW_DELAY;
-                                storedDaliAddress = dali.addressByte;
-                                storedDaliCommand = dali.commandByte;
-                                dali.cmdType = DALI_CMD_TYPE_NONE;
-                            }
-                            else {              // second time command is received
-                                timeout = 0;    // disable 100ms timer
-                                if ((dali.addressByte == storedDaliAddress) && (dali.commandByte == storedDaliCommand)) {
-                                    dali.cmdType = DALI_CMD_TYPE_CONFIG_CMD;
-                                }
-                                else {
-                                    dali.cmdType = DALI_CMD_TYPE_NONE;
-                                }
-                            }
-                            return;
-                        }
-                        else {
-                            if (dali.commandByte <= DALI_CMD_QUERY_RANDOM_ADDRESS_L) {
-
-                                // Qurey command received
-                                dali.cmdType = DALI_CMD_TYPE_QUERY_CMD;
-                                return;
-                            }
-                        }
-                    }
-                    break;
-            }   // switch
-        }
+    daliCmd.handler = (void (*)(void))pgm_read_ptr(&command->handler);
+    flags = pgm_read_byte(&command->flags);
+    daliCmd.flags = flags;
+
+    if (daliCmd.handler == 0) {
+        return;     // Reserved command
+    }
+    if ((flags & DALI_CMD_FLAG_DEVICE_TYPE) && (deviceType != DALI_DEVICE_TYPE)) {
+        return;     // Application extended command of another device type
     }
+    if ((flags & DALI_CMD_FLAG_ANSWER) && ((uint8_t)((uint8_t)schedulerTime - (uint8_t)rxFrameTime) >= DALI_BW_MAX_DELAY)) {
+        return;     // Too late to answer (frames waited in the queue)
+    }
+    if (flags & DALI_CMD_FLAG_SEND_TWICE) {
 
-    dali.cmdType = DALI_CMD_TYPE_NONE;
-    return;
+        // Command needs to be confirmed within 100ms
+        if (!daliSendTwice(pending)) {
+            if (flags & DALI_CMD_FLAG_DEVICE_TYPE) {
+                enabledDeviceType = deviceType;     // Still enabled for the repeated command
+            }
+            return;
+        }
+    }
+    daliCmd.type = DALI_CMD_TYPE_COMMAND;
 }
 
 
 // Dali main function
 // Shall be called every 1 ms ???!!!???
-uint8_t daliControlGear(uint8_t lampFailure)
+// lampFailure: DALI_FAILURE_xxx bits of the string of the first instance (the
+// only one measured), 0 if the lamp is working
+// The outputs are then updated by daliOutputPower()
+void daliControlGear(uint8_t lampFailure)
 {
-    uint8_t outputLevel;
-    static uint16_t timeCounter = 0;    // Counts nb of ms elapsed...
-    static uint8_t prediv = 0;
-    static uint16_t busFailureCounter = 0;
+    uint8_t due;
+    uint8_t thermal = TEMPERATURE_NORMAL;
+    uint8_t fading = 0;             // Bit 0: an instance was fading, bit 1: still fading
+    uint8_t special = 0;
+    uint8_t n;
 
-    if (tick1msCounter != 0) {
+    due = schedulerTakeDue();
 
-        // A new tick occured
-        if (prediv >= tick1msCounter) {
-            prediv -= tick1msCounter;
-        }
-        else {
+    if (due & SCHEDULER_MASK(SCHEDULER_BUS_FAILURE)) {
 
-            // Here every 1/4th second
-            prediv = 250;
-            if (specialModeTimeout != 0) {
-                specialModeTimeout--;
+        // Bus is not present (low during BUS_FAILURE_TIMEOUT): systemFailureLevel,
+        // limited by daliOutputPower()
+        // Flush received frames to avoid erroneous detection
+        rxDropCount += (uint8_t)(rxHead - rxTail) & (DALI_RX_QUEUE_SIZE - 1);
+        rxTail = rxHead;
+        for (n = 0; n < DALI_GEAR_COUNT; n++) {
+            dali = &daliGears[n];
+            if (dali->systemFailureLevel != MASK) {
+                daliStopFade();
+                dali->actualDimLevel = dali->systemFailureLevel;
             }
         }
+    }
 
-        if (fadePeriod != 0) {
-
-            // Check if fading is enabled
-            timeCounter += tick1msCounter;
-            if (timeCounter >= fadePeriod) {
+    // Process received frames (without frame error), in arrival order
+    // (before the send twice window is closed: frames may have waited in the queue)
+    while (rxTail != rxHead) {
+        daliAnalyse();
+        daliExecute();
+    }
 
-                // Update arc power level for fading
-                daliStepOutputPower(dimSens);
-                timeCounter = 0;
-            }
+    if (due & SCHEDULER_MASK(SCHEDULER_SEND_TWICE)) {
+        if (sendTwicePending) {
+            sendTwiceTimeoutCount++;
         }
+        sendTwicePending = 0;   // Not repeated within SEND_TWICE_WINDOW
+    }
 
-        if (DALI_RX() == 0) {   // ???!!!???
+    if (due & SCHEDULER_MASK(SCHEDULER_BOOT)) {
 
-            // Check if bus is present (idle state is high)
-            newRx = 0;     // Disable reception to avoid erroneous detection
-            if (busFailureCounter < BUS_FAILURE_TIMEOUT) {
-                busFailureCounter += tick1msCounter;
-            }
-            else {
-                if (dali.systemFailureLevel != MASK) {
-                    dali.actualDimLevel = dali.systemFailureLevel;
-                }
+        // Registers changed since the power up (default values of a new device,
+        // commands received meanwhile) are written from now on
+        eepromCacheRelease();
+    }
+
+    if (due & SCHEDULER_MASK(SCHEDULER_TEMPERATURE)) {
+
+        // Thermal derating, the limit is applied by the PWM to all the outputs
+        // (the arc power levels are unchanged)
+        thermal = temperatureUpdate();
+    }
+
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        dali = &daliGears[n];
+
+        if (due & SCHEDULER_MASK(SCHEDULER_SPECIAL_MODE)) {
+
+            // Here every 1/4th second
+            if (dali->specialModeTimeout != 0) {
+                dali->specialModeTimeout--;
             }
         }
-        else {
-//             if ((busFailureCounter != 0) && (savedCounter == 0)) {
-//                 savedCounter = busFailureCounter;
-//             }
-            busFailureCounter = 0;
+        special |= (dali->specialModeTimeout != 0);
+
+        // Fading runs in the PWM interrupt, follow the level reached
+        // (SCHEDULER_FADE wakes the main loop while fading)
+        if (dali->status.fadeRunning == 1) {
+            dali->status.fadeRunning = fadeIsRunning(n);
+            dali->actualDimLevel = fadeLevel(n);
+#ifdef DALI_DT8
+            dali->colourTemperature = colourMixToTc(fadeMix());
+#endif
+            fading |= 1 | (dali->status.fadeRunning << 1);
         }
 
-        tick1msCounter = 0;
+        if (due & SCHEDULER_MASK(SCHEDULER_TEMPERATURE)) {
+            switch (thermal) {
+                case TEMPERATURE_OVERHEAT:
+                    dali->failureStatus.thermalShutdown = 1;
+                    dali->failureStatus.thermalOverload = 0;
+                    break;
+                case TEMPERATURE_DERATING:
+                    dali->failureStatus.thermalShutdown = 0;
+                    dali->failureStatus.thermalOverload = 1;
+                    break;
+                default:
+                    dali->failureStatus.thermalShutdown = 0;
+                    dali->failureStatus.thermalOverload = 0;
+                    break;
+            }
+        }
     }
-
-    // If a new frame is received,
-    // if there was no frame error,
-    // then process
-    if (newRx == 1) {
-        newRx = 0;
-        daliAnalyse();
-        daliExecute();
+    if ((due & SCHEDULER_MASK(SCHEDULER_SPECIAL_MODE)) && !special) {
+        schedulerStop(SCHEDULER_SPECIAL_MODE);
+    }
+    if (fading == 1) {
+        schedulerStop(SCHEDULER_FADE);
     }
 
-    outputLevel = daliOutputPower();
-
-    // Check if a lamp is physically disconnected
-    // TODO: how and where to check
-    if (lampFailure == 1) {
-        dali.status.lampFailure = 1;
-        if (physicalSelectionMode == PHYSICAL_SELECTION_REQUESTED) {
-            physicalSelectionMode = PHYSICAL_SELECTION_ENABLED;
+    // Lamp failure detected by the led current and voltage measurement
+    // (SCHEDULER_LAMP_FAILURE wakes the main loop when it changes)
+    dali = &daliGears[0];
+    dali->failureStatus.shortCircuit = (lampFailure & DALI_FAILURE_SHORT_CIRCUIT) != 0;
+    dali->failureStatus.openCircuit = (lampFailure & DALI_FAILURE_OPEN_CIRCUIT) != 0;
+    if (lampFailure != 0) {
+        dali->status.lampFailure = 1;
+        if (dali->physicalSelectionMode == PHYSICAL_SELECTION_REQUESTED) {
+            dali->physicalSelectionMode = PHYSICAL_SELECTION_ENABLED;
         }
     }
     else {
-        dali.status.lampFailure = 0;
-        if (physicalSelectionMode == PHYSICAL_SELECTION_ENABLED) {
-            physicalSelectionMode = PHYSICAL_SELECTION_REQUESTED;
+        dali->status.lampFailure = 0;
+        if (dali->physicalSelectionMode == PHYSICAL_SELECTION_ENABLED) {
+            dali->physicalSelectionMode = PHYSICAL_SELECTION_REQUESTED;
         }
     }
-
-    return outputLevel;
 }
 
 
@@ -618,3 +1095,39 @@ uint8_t isDaliRunning(void)
 {
     return daliRunning;
 }
+
+
+// Something to do for daliControlGear(): frame received or timer expired
+uint8_t daliIsPending(void)
+{
+    return (rxTail != rxHead) || schedulerIsDue();
+}
+
+
+#ifdef POWER_FAIL_SENSE
+
+// Supply failing (ANALOG_COMP_0_vect, the outputs are off): save the output level and
+// the fade target of each instance, for powerOnLevel DALI_LAST_ACTIVE_LEVEL
+// (interrupt: does not change the selected instance)
+void daliPowerFail(void)
+{
+    uint8_t levels[EEPROM_POWER_FAIL_LEVELS];
+    uint8_t n;
+
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        levels[2 * n] = fadeLevel(n);
+        levels[2 * n + 1] = fadeTarget(n);
+    }
+    eepromCachePowerFailWrite(levels);
+}
+
+#endif
+
+
+// Select the dimming curve used to convert arc power levels to PWM
+// The selection is stored in eeprom
+void daliSetDimmingCurve(uint8_t curve)
+{
+    dali->dimmingCurve = dimmingCurveSelect(dali->channel, curve);
+    daliEepromWrite(ADD_DIMMING_CURVE, dali->dimmingCurve);
+}
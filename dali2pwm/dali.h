@@ -5,12 +5,15 @@
 
 // Timer0 confirguration
 #define F_DALI_TICK     1000    // 1kHz -> tick every 1ms
+#define TIMER0_TOP      ((F_CLKIO / (64 * F_DALI_TICK)) - 1)
+#define TIMER0_PERIOD_US    (64 * 1000000UL / F_CLKIO)     // Timer0 count period (4us), latency measurement unit
 
 #define TIMER0_DIVIDER_1    (0 << CS02) | (0 << CS01) | (1 << CS00)     // Timer0 frequency devider :1
 #define TIMER0_DIVIDER_8    (0 << CS02) | (1 << CS01) | (0 << CS00)     // Timer0 frequency devider :8
 #define TIMER0_DIVIDER_64   (0 << CS02) | (1 << CS01) | (1 << CS00)     // Timer0 frequency devider :64
 
 // EUSART configuration and macros
+// DALI_SOFT_MANCHESTER: the frames are decoded and encoded with Timer1 instead (see manchester.h)
 #define DALI_BAUD_RATE  1200
 #define MUBRR           (F_CLKIO / DALI_BAUD_RATE)
 #define UBRR            (F_CLKIO / (16 * DALI_BAUD_RATE) - 1)
@@ -22,15 +25,65 @@
 // General
 #define DOWN                    0
 #define UP                      1
-#define FW_FW_DELAY             84      // (84ms + FW frame duration) = 100ms
+#define SEND_TWICE_WINDOW       100     // 100ms max between arrival of the 2 frames
 #define BUS_FAILURE_TIMEOUT     500     // 500ms
+#define BUS_TIMER_DIVIDER       (1 << CS12)                                         // Timer1 :256 (16us)
+#define BUS_TIMER_PERIOD_US     (256 * 1000000UL / F_CLKIO)                         // Timer1 count period (16us)
+#define BUS_FAILURE_TICKS       ((uint16_t)(F_CLKIO / 256 * BUS_FAILURE_TIMEOUT / 1000)) // In Timer1 periods
+#if defined(DALI_SOFT_MANCHESTER) && defined(PWM_USE_TIMER1)
+    #error "DALI_SOFT_MANCHESTER needs Timer1 (input capture), PWM_USE_TIMER1 uses it for the PWM"
+#endif
+#define SPECIAL_MODE_PERIOD     250     // specialModeTimeout unit (1/4s)
+#define FADE_UPDATE_PERIOD      10      // actualDimLevel update period while fading (ms)
+#define BOOT_BACKGROUND_DELAY   200     // Eeprom records held after power up (ms), see eepromCacheInit()
+
+// Boot time: from the clock setup in main() to the first output update, the duty the PWM
+// loads at the end of its cycle (DALI_MEMORY_DIAG_BOOT_TIME, checked on the host by
+// powerFailTest). Not counted: the start-up delay of the reset (SUT/CKSEL fuses), the C
+// runtime init at the CKDIV8 clock, and the rest of the PWM cycle (64us, 256us with Timer1).
+#define BOOT_TIME_TARGET_US     1000
+#define BOOT_TIME_OVER          0xffff  // Boot time out of range (1ms or more with PWM_USE_TIMER1)
+
+// Backward frame timing (in ms ticks, tick phase adds up to -1ms)
+// BW frame shall start 2.92 to 9.17ms after the end of the FW frame
+#define DALI_BW_DELAY           4       // 3-4ms after FW frame
+#define DALI_BW_MAX_DELAY       7       // Too late to answer (6-7ms after FW frame)
+#define DALI_BW_FRAME_DURATION  10      // 9.2ms (11 bits at 1200 bauds)
+
+#define DALI_RX_QUEUE_SIZE      8       // Received frames queue length (power of 2)
+#define DALI_ADDRESS_TABLE_SIZE 80      // Short addresses (64) and groups (16), see daliAddressedGears()
+
+// Logical control gear on this board (registers in daliGears, see dali.c)
+// Each instance has its own short address, groups, scenes, random address, eeprom
+// block and output (PWM channel n, see pwm.c). Frames are decoded once and executed
+// by every instance addressed.
+#ifndef DALI_GEAR_COUNT
+    #define DALI_GEAR_COUNT     1
+#endif
+#define DALI_ALL_GEARS          ((uint8_t)((1 << DALI_GEAR_COUNT) - 1))
+
+#if (DALI_GEAR_COUNT < 1) || (DALI_GEAR_COUNT > 3)
+    #error "DALI_GEAR_COUNT must be 1 to 3 (PSC outputs, see pwm.c)"
+#endif
+#if (DALI_GEAR_COUNT > 1) && (defined(DALI_DT8) || defined(PWM_USE_TIMER1))
+    #error "Several gear instances need the PSC outputs (DALI_DT8 and PWM_USE_TIMER1 use one gear)"
+#endif
+
+#define DALI_TX_IDLE            0
+#define DALI_TX_WAIT            1       // BW frame is scheduled
+#define DALI_TX_SENDING         2
 #define MASK                    0xff
 
 #define PHYSICAL_SELECTION_DISABLED     0
 #define PHYSICAL_SELECTION_REQUESTED    1
 #define PHYSICAL_SELECTION_ENABLED      2
 
-// EEPROM Addresses of stored DALI Registers
+// Lamp failures reported to daliControlGear() (same bits as DaliFailureStatus)
+#define DALI_FAILURE_SHORT_CIRCUIT      0x01
+#define DALI_FAILURE_OPEN_CIRCUIT       0x02
+
+// Offsets of stored DALI Registers in the eeprom block of an instance (see daliEepromWrite())
+// Blocks follow each other in the eeprom record (cached in RAM, see eepromCache.h)
 #define ADD_EEPROM_STATUS           0
 #define ADD_POWER_ON_LEVEL          1
 #define ADD_SYSTEM_FAILURE_LEVEL    2
@@ -45,8 +98,30 @@
 #define ADD_GROUPH                  11
 #define ADD_GROUPL                  12
 #define ADD_SCENE_0                 13
+#define ADD_DIMMING_CURVE           29
+#define ADD_EXTENDED_FADE_TIME      30
+#define ADD_FAST_FADE_TIME          31
+#ifdef DALI_DT8
+#define ADD_TC_COOLEST              32      // Colour temperatures, see colourEncode()
+#define ADD_TC_WARMEST              33
+#define ADD_TC_POWER_ON             34
+#define ADD_TC_SCENE_0              35
+#define ADD_GEAR_FEATURES           51
+#endif
+
+// Eeprom block of an instance, layout version (see EEPROM_RECORD_VERSION)
+#ifdef DALI_DT8
+    #define DALI_EEPROM_SIZE        52      // Colour registers from ADD_TC_COOLEST
+    #define DALI_EEPROM_VERSION     2
+#else
+    #define DALI_EEPROM_SIZE        32
+    #define DALI_EEPROM_VERSION     1
+#endif
+
+#define EEPROM_INITIALIZED          0xAA    // if register 0 == 0xAA : registers have been stored at least once
 
-#define EEPROM_INITIALIZED          0xAA    // if eeprom(0) == 0xAA : eeprom has been written at least once
+// powerOnLevel: level at the last power failure (DALI-2 last active level, see powerFail.h)
+#define DALI_LAST_ACTIVE_LEVEL      0xff
 
 #ifndef DALI_PHYSICAL_LEVEL
     #define DALI_PHYSICAL_LEVEL     0
@@ -57,17 +132,40 @@
 
 #define DALI_VERSION_NUMBER         0x00
 #define DALI_PHYSICAL_MIN_LEVEL     50      // Why not 0?
-#define DALI_DEVICE_TYPE            0
+#ifdef DALI_DT8
+    #define DALI_DEVICE_TYPE        8       // Colour control, tunable white (see colour.h)
+#else
+    #define DALI_DEVICE_TYPE        6       // LED modules (application extended commands 0xE0-0xFF)
+#endif
+
+// LED modules (device type 6), fixed answers of the IEC 62386-207 queries
+#define DALI_DT6_EXTENDED_VERSION   1
+#define DALI_DT6_GEAR_TYPE          0x08    // DC supply, led string and its supply external
+#define DALI_DT6_OPERATING_MODES    0x01    // PWM (the current regulation corrects the duty)
+#define DALI_DT6_FEATURES           0xe3    // Short and open circuit, thermal shutdown and derating, physical selection
+#define DALI_DT6_MODE_NON_LOG       0x10    // QUERY OPERATING MODE: dimming curve is not the logarithmic one
+
+// Fast fade time (DALI-2, device type 6), in 25ms steps
+#define DALI_FAST_FADE_STEP         25
+#define DALI_MIN_FAST_FADE_TIME     1       // 25ms
+#define DALI_MAX_FAST_FADE_TIME     27      // 675ms
+
+// Extended fade time (DALI-2) : bits 6-4 multiplier, bits 3-0 base value (1-16)
+#define DALI_EXTENDED_FADE_TIME_MAX 0x4f    // 16 * 1min
+
+// Colour control (device type 8), colour temperature Tc only
+#define DALI_DT8_EXTENDED_VERSION           2
+#define DALI_COLOUR_TYPE_FEATURES           0x02    // Tc capable
+#define DALI_GEAR_FEATURE_AUTO_ACTIVATION   0x01    // Arc power commands activate the temporary colour
+#define DALI_COLOUR_STATUS_TC_OUT_OF_RANGE  0x02    // Last colour activated was beyond a limit
+#define DALI_COLOUR_STATUS_TC_ACTIVE        0x20
 
 
 // Type of DALI Command received
 typedef enum {
     DALI_CMD_TYPE_NONE,
     DALI_CMD_TYPE_DIRECT_ARC_POWER,
-    DALI_CMD_TYPE_CONFIG_CMD,
-    DALI_CMD_TYPE_QUERY_CMD,
-    DALI_CMD_TYPE_SPECIAL_CMD,
-    DALI_CMD_TYPE_INDIRECT_ARC_POWER
+    DALI_CMD_TYPE_COMMAND                   // See cmdHandler and cmdFlags
 } DaliCmdType;
 
 // 'STATUS REGISTER' uint8_ts
@@ -86,12 +184,47 @@ typedef union
     char statusInformation;
 } DaliStatus;
 
-// DALI Registers
+// 'FAILURE STATUS' (device type 6)
+typedef union
+{
+    struct {
+        unsigned shortCircuit         :1;     // Led string shorted (see current.c)
+        unsigned openCircuit          :1;     // Led string open
+        unsigned loadDecrease         :1;
+        unsigned loadIncrease         :1;
+        unsigned currentProtector     :1;
+        unsigned thermalShutdown      :1;     // Output off (see temperature.h)
+        unsigned thermalOverload      :1;     // Output limited by the derating curve
+        unsigned referenceFailed      :1;
+    };
+    uint8_t failureInformation;
+} DaliFailureStatus;
+
+// Received FW frame
 typedef struct {
-    DaliCmdType     cmdType;
+    uint8_t         address;                // 1st byte of received frame
+    uint8_t         command;                // 2nd byte of received frame
+    uint16_t        time;                   // Arrival time (schedulerTime, ms)
+    uint16_t        stamp;                  // Arrival time, in Timer0 periods (see daliTimestamp())
+    uint8_t         otherGear;              // Frames for other gear were received before this one
+} DaliFrame;
+
+// Command of the frame being processed (see daliAnalyse()), shared by the instances
+typedef struct {
+    DaliCmdType     type;
+    void            (*handler)(void);       // Command descriptor (see DALI_COMMANDS in daliExecute.c)
+    uint8_t         flags;
     uint8_t         addressByte;            // 1st byte of received frame
     uint8_t         commandByte;            // 2nd byte of received frame
+    uint8_t         gears;                  // Instances addressed, bit n: daliGears[n]
+} DaliCmd;
+
+// DALI Registers, one set per instance
+typedef struct {
+    uint8_t         channel;                // Index in daliGears: PWM, fade and dimming curve channel
     uint8_t         dtr;                    // Data Transfer Register
+    uint8_t         dtr1;                   // Memory bank (see daliMemory.h), MSB of 16-bit values
+    uint8_t         dtr2;                   // Selector (STORE COLOUR TEMPERATURE LIMIT)
     uint8_t         actualDimLevel;         // See DALI Standard
     uint8_t         powerOnLevel;
     uint8_t         systemFailureLevel;
@@ -99,6 +232,8 @@ typedef struct {
     uint8_t         maxLevel;
     uint8_t         fadeRate;
     uint8_t         fadeTime;
+    uint8_t         extendedFadeTime;       // Used when fadeTime = 0 and fastFadeTime = 0
+    uint8_t         fastFadeTime;           // Used when fadeTime = 0
     uint8_t         shortAddress;
     uint8_t         searchAddressH;
     uint8_t         searchAddressM;
@@ -108,23 +243,57 @@ typedef struct {
     uint8_t         randomAddressL;
     uint16_t        group;                  // MSB : group 15    LSB : group 0. If set, device belongs to group x
     uint8_t         scene[16];
+    uint8_t         dimmingCurve;           // See DIMMING_CURVE_xxx in dimmingCurve.h
+#ifdef DALI_DT8
+    uint16_t        colourTemperature;      // Tc in mirek (see colour.h), follows the output while fading
+    uint16_t        temporaryColourTemperature;     // Applied by daliColourActivate(), COLOUR_MASK if none
+    uint16_t        colourTemperatureCoolest;       // Limits, within the physical ones
+    uint16_t        colourTemperatureWarmest;
+    uint16_t        powerOnColourTemperature;
+    uint16_t        sceneColourTemperature[16];     // COLOUR_MASK: the scene keeps the colour
+    uint8_t         gearFeatures;           // DALI_GEAR_FEATURE_xxx
+    uint8_t         colourStatus;           // DALI_COLOUR_STATUS_xxx
+#endif
     DaliStatus      status;
+    DaliFailureStatus failureStatus;        // Measured by the gear, not stored
+    uint16_t        specialModeTimeout;     // Special mode (INITIALISE), in 1/4th seconds, 0: disabled
+    uint8_t         compareMode;
+    uint8_t         physicalSelectionMode;
+    uint8_t         memoryWriteEnabled;     // Set by ENABLE WRITE MEMORY, cleared by the next command but memory accesses
 } DaliRegisters;
 
 
 // General functions
+#ifndef DALI_SOFT_MANCHESTER
 void daliInitEUSART(void);
+#endif
+void daliInitBusMonitor(void);
+void daliReceive(uint8_t address, uint8_t command);
+void daliInitGear(void);
+void daliInitRegisters(void);
 void daliInit(void);
 void daliTick(void);
 void daliAnalyse(void);
-void daliStepOutputPower(uint8_t sense);
+void daliUpdateAddressTable(void);
+void daliStopFade(void);
 void daliChangeOutputWithFadeTime(void);
 void daliUpOutputWithFadeRate(void);
 void daliDownOutputWithFadeRate(void);
+uint32_t daliFadeTimeCycles(void);
+#ifdef DALI_DT8
+void daliColourSet(uint16_t tc, uint32_t cycles);
+void daliColourActivate(uint32_t cycles);
+#endif
 void daliAnswer(uint8_t answer);
 void daliExecute(void);
-uint8_t daliOutputPower(void);
-uint8_t daliControlGear(uint8_t);
+void daliEepromWrite(uint8_t address, uint8_t value);
+uint8_t daliOutputPower(uint8_t gear);
+void daliControlGear(uint8_t);
 uint8_t isDaliRunning(void);
+uint8_t daliIsPending(void);
+void daliSetDimmingCurve(uint8_t curve);
+#ifdef POWER_FAIL_SENSE
+void daliPowerFail(void);
+#endif
 
 #endif
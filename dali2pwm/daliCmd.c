@@ -1,20 +1,23 @@
-#include <stdlib.h>
-#include <avr/eeprom.h>
+#include <avr/io.h>
 
 #include "dali.h"
 #include "daliCmd.h"
-
-extern DaliRegisters dali;
+#include "scheduler.h"
+#include "entropy.h"
+#include "daliMemory.h"
+#include "colour.h"
+#include "dimmingCurve.h"
+
+extern DaliRegisters *dali;
+extern DaliCmd daliCmd;
 extern uint8_t requestedLevel;
-extern uint16_t specialModeTimeout;
-extern uint8_t compareMode;
-extern uint8_t physicalSelectionMode;
+extern uint8_t enabledDeviceType;
 
 
 // Indirect arc power commands
 void daliCmdImmediateOff(void)
 {
-    dali.actualDimLevel = 0;
+    dali->actualDimLevel = 0;
     return;
 }
 
@@ -35,8 +38,8 @@ void daliCmdDown200ms(void)
 
 void daliCmdStepUp(void)
 {
-    if (dali.actualDimLevel < dali.maxLevel && dali.status.lampOn == 1) {
-        dali.actualDimLevel++;
+    if (dali->actualDimLevel < dali->maxLevel && dali->status.lampOn == 1) {
+        dali->actualDimLevel++;
     }
     return;
 }
@@ -44,8 +47,8 @@ void daliCmdStepUp(void)
 
 void daliCmdStepDown(void)
 {
-    if (dali.actualDimLevel > dali.minLevel && dali.status.lampOn == 1) {
-        dali.actualDimLevel--;
+    if (dali->actualDimLevel > dali->minLevel && dali->status.lampOn == 1) {
+        dali->actualDimLevel--;
     }
     return;
 }
@@ -53,26 +56,26 @@ void daliCmdStepDown(void)
 
 void daliCmdRecallMaxLevel(void)
 {
-    dali.actualDimLevel = dali.maxLevel;
+    dali->actualDimLevel = dali->maxLevel;
     return;
 }
 
 
 void daliCmdRecallMinLevel(void)
 {
-    dali.actualDimLevel = dali.minLevel;
+    dali->actualDimLevel = dali->minLevel;
     return;
 }
 
 
 void daliCmdStepDownAndOff(void)
 {
-    if (dali.status.lampOn == 1) {
-        if (dali.actualDimLevel > dali.minLevel) {
-            dali.actualDimLevel--;
+    if (dali->status.lampOn == 1) {
+        if (dali->actualDimLevel > dali->minLevel) {
+            dali->actualDimLevel--;
         }
         else {
-            dali.actualDimLevel = 0;
+            dali->actualDimLevel = 0;
         }
     }
     return;
@@ -81,13 +84,13 @@ void daliCmdStepDownAndOff(void)
 
 void daliCmdOnAndStepUp(void)
 {
-    if (dali.status.lampOn == 1) {
-        if (dali.actualDimLevel < dali.maxLevel) {
-            dali.actualDimLevel++;
+    if (dali->status.lampOn == 1) {
+        if (dali->actualDimLevel < dali->maxLevel) {
+            dali->actualDimLevel++;
         }
     }
     else {
-        dali.actualDimLevel = dali.minLevel;
+        dali->actualDimLevel = dali->minLevel;
     }
     return;
 }
@@ -95,7 +98,17 @@ void daliCmdOnAndStepUp(void)
 
 void daliCmdGoToScene(void)
 {
-    requestedLevel = dali.scene[(dali.commandByte & 0x0f)];
+    requestedLevel = dali->scene[(daliCmd.commandByte & 0x0f)];
+#ifdef DALI_DT8
+    if ((requestedLevel != MASK) && (dali->sceneColourTemperature[(daliCmd.commandByte & 0x0f)] != COLOUR_MASK)) {
+
+        // The scene colour fades with the level, even without automatic activation
+        dali->temporaryColourTemperature = dali->sceneColourTemperature[(daliCmd.commandByte & 0x0f)];
+        daliChangeOutputWithFadeTime();
+        daliColourActivate(daliFadeTimeCycles());
+        return;
+    }
+#endif
     daliChangeOutputWithFadeTime();
     return;
 }
@@ -104,125 +117,172 @@ void daliCmdGoToScene(void)
 // Settings commands
 void daliCmdReset(void)
 {
-    eeprom_write_byte((uint8_t*)ADD_EEPROM_STATUS, 0);  // clears the flag EEPROM_INITIALIZED
-    daliInit();                                         // reset values will be stored in eeprom
-    dali.status.resetState = 1;
-    dali.status.powerFailure = 0;
+    daliEepromWrite(ADD_EEPROM_STATUS, 0);      // clears the flag EEPROM_INITIALIZED
+    daliInitGear();                             // reset values will be stored in eeprom
+    daliUpdateAddressTable();
+    dali->status.resetState = 1;
+    dali->status.powerFailure = 0;
 }
 
 
 void daliCmdStoreActualLevelInDTR(void)
 {
-    dali.dtr = dali.actualDimLevel;
+    dali->dtr = dali->actualDimLevel;
 }
 
 
 void daliCmdStoreTheDTRAsMaxLevel(void)
 {
-    dali.maxLevel = dali.dtr;
-    if (dali.maxLevel <= dali.minLevel) {
-        dali.maxLevel = dali.minLevel + 1;
+    dali->maxLevel = dali->dtr;
+    if (dali->maxLevel <= dali->minLevel) {
+        dali->maxLevel = dali->minLevel + 1;
     }
-    if (dali.actualDimLevel > dali.maxLevel) {
-        dali.actualDimLevel = dali.maxLevel;
+    if (dali->actualDimLevel > dali->maxLevel) {
+        dali->actualDimLevel = dali->maxLevel;
     }
-    eeprom_write_byte((uint8_t*)ADD_MAX_LEVEL, dali.maxLevel);
+    daliEepromWrite(ADD_MAX_LEVEL, dali->maxLevel);
 }
 
 
 void daliCmdStoreTheDTRAsMinLevel(void)
 {
-    dali.minLevel = dali.dtr;
-    if (dali.minLevel >= dali.maxLevel) {
-        dali.minLevel = dali.maxLevel - 1;
+    dali->minLevel = dali->dtr;
+    if (dali->minLevel >= dali->maxLevel) {
+        dali->minLevel = dali->maxLevel - 1;
     }
-    if (dali.actualDimLevel < dali.minLevel) {
-        dali.actualDimLevel = dali.minLevel;
+    if (dali->actualDimLevel < dali->minLevel) {
+        dali->actualDimLevel = dali->minLevel;
     }
-    eeprom_write_byte((uint8_t*)ADD_MIN_LEVEL, dali.minLevel);
+    daliEepromWrite(ADD_MIN_LEVEL, dali->minLevel);
 }
 
 
 void daliCmdStoreTheDTRAsSystemFailureLevel(void)
 {
-    dali.systemFailureLevel = dali.dtr;
-    eeprom_write_byte((uint8_t*)ADD_SYSTEM_FAILURE_LEVEL, dali.systemFailureLevel);
+    dali->systemFailureLevel = dali->dtr;
+    daliEepromWrite(ADD_SYSTEM_FAILURE_LEVEL, dali->systemFailureLevel);
 }
 
 
+// MASK is DALI_LAST_ACTIVE_LEVEL (DALI-2)
 void daliCmdStoreTheDTRAsPowerOnLevel()
 {
-    dali.powerOnLevel = dali.dtr;
-    if (dali.powerOnLevel > 254) {
-        dali.powerOnLevel = 254;
+    dali->powerOnLevel = dali->dtr;
+    daliEepromWrite(ADD_POWER_ON_LEVEL, dali->powerOnLevel);
+#ifdef DALI_DT8
+
+    // Power on colour: the temporary colour, the actual one if none
+    if (dali->temporaryColourTemperature != COLOUR_MASK) {
+        dali->powerOnColourTemperature = dali->temporaryColourTemperature;
     }
-    eeprom_write_byte((uint8_t*)ADD_POWER_ON_LEVEL, dali.powerOnLevel);
+    else {
+        dali->powerOnColourTemperature = dali->colourTemperature;
+    }
+    daliEepromWrite(ADD_TC_POWER_ON, colourEncode(dali->powerOnColourTemperature));
+#endif
 }
 
 
 void daliCmdStoreTheDTRAsFadeTime(void)
 {
-    dali.fadeTime = dali.dtr & 0xf;
-    eeprom_write_byte((uint8_t*)ADD_FADE_TIME, dali.fadeTime);
+    dali->fadeTime = dali->dtr & 0xf;
+    daliEepromWrite(ADD_FADE_TIME, dali->fadeTime);
 }
 
 
 void daliCmdStoreTheDTRAsFadeRate(void)
 {
-    if (dali.dtr != 0) {    // value 0 is not allowed for fadeRate
-        dali.fadeRate = dali.dtr & 0xf;
-        eeprom_write_byte((uint8_t*)ADD_FADE_RATE, dali.fadeRate);
+    if (dali->dtr != 0) {    // value 0 is not allowed for fadeRate
+        dali->fadeRate = dali->dtr & 0xf;
+        daliEepromWrite(ADD_FADE_RATE, dali->fadeRate);
     }
 }
 
+void daliCmdSetExtendedFadeTime(void)
+{
+    if (dali->dtr > DALI_EXTENDED_FADE_TIME_MAX) {
+        dali->extendedFadeTime = 0;
+    }
+    else {
+        dali->extendedFadeTime = dali->dtr;
+    }
+    daliEepromWrite(ADD_EXTENDED_FADE_TIME, dali->extendedFadeTime);
+}
+
+
 void daliCmdStoreTheDTRAsShortAddress(void)
 {
-    if (dali.dtr == 0xff) {
-        dali.shortAddress = 0xff;
-        dali.status.missingShortAddress = 1;
+    if (dali->dtr == 0xff) {
+        dali->shortAddress = 0xff;
+        dali->status.missingShortAddress = 1;
     }
     else {
-        dali.shortAddress = dali.dtr & 0x3f;
-        dali.status.missingShortAddress = 0;
+        dali->shortAddress = dali->dtr & 0x3f;
+        dali->status.missingShortAddress = 0;
     }
-    eeprom_write_byte((uint8_t*)ADD_SHORT_ADD, dali.shortAddress);
+    daliEepromWrite(ADD_SHORT_ADD, dali->shortAddress);
+    daliUpdateAddressTable();
+}
+
+
+void daliCmdEnableWriteMemory(void)
+{
+    dali->memoryWriteEnabled = 1;     // Cleared by daliExecute() at the next command but memory accesses
 }
 
 
 void daliCmdStoreTheDTRAsScene(void)
 {
-    dali.scene[(dali.commandByte & 0x0f)] = dali.dtr;
-    eeprom_write_byte((uint8_t*)(ADD_SCENE_0 + (dali.commandByte & 0x0f)), dali.scene[(dali.commandByte & 0xf)]);
+    dali->scene[(daliCmd.commandByte & 0x0f)] = dali->dtr;
+    daliEepromWrite(ADD_SCENE_0 + (daliCmd.commandByte & 0x0f), dali->scene[(daliCmd.commandByte & 0xf)]);
+#ifdef DALI_DT8
+
+    // Scene colour: the temporary colour, the actual one if none
+    if (dali->temporaryColourTemperature != COLOUR_MASK) {
+        dali->sceneColourTemperature[(daliCmd.commandByte & 0x0f)] = dali->temporaryColourTemperature;
+    }
+    else {
+        dali->sceneColourTemperature[(daliCmd.commandByte & 0x0f)] = dali->colourTemperature;
+    }
+    daliEepromWrite(ADD_TC_SCENE_0 + (daliCmd.commandByte & 0x0f),
+                     colourEncode(dali->sceneColourTemperature[(daliCmd.commandByte & 0x0f)]));
+#endif
 }
 
 
 void daliCmdRemoveFromScene(void)
 {
-    dali.scene[(dali.commandByte & 0x0f)] = 0xff;
-    eeprom_write_byte((uint8_t*)(ADD_SCENE_0 + (dali.commandByte & 0x0f)), 0xff);
+    dali->scene[(daliCmd.commandByte & 0x0f)] = 0xff;
+    daliEepromWrite(ADD_SCENE_0 + (daliCmd.commandByte & 0x0f), 0xff);
+#ifdef DALI_DT8
+    dali->sceneColourTemperature[(daliCmd.commandByte & 0x0f)] = COLOUR_MASK;
+    daliEepromWrite(ADD_TC_SCENE_0 + (daliCmd.commandByte & 0x0f), colourEncode(COLOUR_MASK));
+#endif
 }
 
 
 void daliCmdAddToGroup(void)
 {
-    dali.group = 1 << (dali.commandByte & 0xf);
-    eeprom_write_byte((uint8_t*)ADD_GROUPH, ((uint8_t)(dali.group >> 8)));
-    eeprom_write_byte((uint8_t*)ADD_GROUPL, ((uint8_t)(dali.group)));
+    dali->group |= (uint16_t)1 << (daliCmd.commandByte & 0xf);
+    daliEepromWrite(ADD_GROUPH, ((uint8_t)(dali->group >> 8)));
+    daliEepromWrite(ADD_GROUPL, ((uint8_t)(dali->group)));
+    daliUpdateAddressTable();
 }
 
 
 void daliCmdRemoveFromGroup(void)
 {
-    dali.group = 0x0000;
-    eeprom_write_byte((uint8_t*)ADD_GROUPH, 0);
-    eeprom_write_byte((uint8_t*)ADD_GROUPL, 0);
+    dali->group &= ~((uint16_t)1 << (daliCmd.commandByte & 0xf));
+    daliEepromWrite(ADD_GROUPH, ((uint8_t)(dali->group >> 8)));
+    daliEepromWrite(ADD_GROUPL, ((uint8_t)(dali->group)));
+    daliUpdateAddressTable();
 }
 
 
 // Query commands
 void daliCmdQueryStatus(void)
 {
-    daliAnswer(dali.status.statusInformation);
+    daliAnswer(dali->status.statusInformation);
     return;
 }
 
@@ -236,7 +296,7 @@ void daliCmdQueryBallast(void)
 
 void daliCmdQueryLampFailure(void)
 {
-    if (dali.status.lampFailure == 1) {
+    if (dali->status.lampFailure == 1) {
         daliAnswer(DALI_YES);
     }
     // no answer means 'DALI_NO'
@@ -246,7 +306,7 @@ void daliCmdQueryLampFailure(void)
 
 void daliCmdQueryLampPowerOn(void)
 {
-    if (dali.status.lampOn == 1) {
+    if (dali->status.lampOn == 1) {
         daliAnswer(DALI_YES);
     }
     // no answer means 'DALI_NO'
@@ -256,7 +316,7 @@ void daliCmdQueryLampPowerOn(void)
 
 void daliCmdqueryLimitError(void)
 {
-    if (dali.status.limitError == 1) {
+    if (dali->status.limitError == 1) {
         daliAnswer(DALI_YES);
     }
     // no answer means 'DALI_NO'
@@ -266,7 +326,7 @@ void daliCmdqueryLimitError(void)
 
 void daliCmdQueryResetState(void)
 {
-    if (dali.status.resetState == 1) {
+    if (dali->status.resetState == 1) {
         daliAnswer(DALI_YES);
     }
     // no answer means 'DALI_NO'
@@ -276,7 +336,7 @@ void daliCmdQueryResetState(void)
 
 void daliCmdQueryMissingShortAddress(void)
 {
-    if (dali.status.missingShortAddress == 1) {
+    if (dali->status.missingShortAddress == 1) {
         daliAnswer(DALI_YES);
     }
     // no answer means 'DALI_NO'
@@ -293,7 +353,7 @@ void daliCmdQueryVersionNumber(void)
 
 void daliCmdQueryContentDTR(void)
 {
-    daliAnswer(dali.dtr);
+    daliAnswer(dali->dtr);
     return;
 }
 
@@ -314,118 +374,487 @@ void daliCmdQueryPhysicalMinimumLevel(void)
 
 void daliCmdQueryPowerFailure(void)
 {
-    daliAnswer(dali.status.powerFailure);
+    daliAnswer(dali->status.powerFailure);
+    return;
+}
+
+
+void daliCmdQueryContentDTR1(void)
+{
+    daliAnswer(dali->dtr1);
+    return;
+}
+
+
+void daliCmdQueryContentDTR2(void)
+{
+    daliAnswer(dali->dtr2);
     return;
 }
 
 
 void daliCmdQueryActualLevel(void)
 {
-    daliAnswer(dali.actualDimLevel);
+    daliAnswer(dali->actualDimLevel);
     return;
 }
 
 
 void daliCmdQueryMaxLevel(void)
 {
-    daliAnswer(dali.maxLevel);
+    daliAnswer(dali->maxLevel);
     return;
 }
 
 
 void daliCmdQueryMinLevel(void)
 {
-    daliAnswer(dali.minLevel);
+    daliAnswer(dali->minLevel);
     return;
 }
 
 
 void daliCmdQueryPowerOnLevel(void)
 {
-    daliAnswer(dali.powerOnLevel);
+    daliAnswer(dali->powerOnLevel);
     return;
 }
 
 
 void daliCmdQuerySystemFailureLevel(void)
 {
-    daliAnswer(dali.systemFailureLevel);
+    daliAnswer(dali->systemFailureLevel);
     return;
 }
 
 
 void daliCmdQueryFadeSettings(void)
 {
-    daliAnswer(dali.fadeTime << 4 | dali.fadeRate);
+    daliAnswer(dali->fadeTime << 4 | dali->fadeRate);
+    return;
+}
+
+
+void daliCmdQueryExtendedFadeTime(void)
+{
+    daliAnswer(dali->extendedFadeTime);
     return;
 }
 
 
 void daliCmdQuerySceneLevel(void)
 {
-    daliAnswer(dali.scene[(dali.commandByte & 0x0f)]);
+    daliAnswer(dali->scene[(daliCmd.commandByte & 0x0f)]);
     return;
 }
 
 
 void daliCmdQueryGroups0_7(void)
 {
-    daliAnswer((uint8_t)(dali.group));
+    daliAnswer((uint8_t)(dali->group));
     return;
 }
 
 
 void daliCmdQueryGroups8_15(void)
 {
-    daliAnswer((uint8_t)(dali.group >> 8));
+    daliAnswer((uint8_t)(dali->group >> 8));
      return;
 }
 
 
 void daliCmdQueryRandomAddressH(void)
 {
-    daliAnswer(dali.randomAddressH);
+    daliAnswer(dali->randomAddressH);
     return;
 }
 
 void daliCmdQueryRandomAddressM(void)
 {
-    daliAnswer(dali.randomAddressM);
+    daliAnswer(dali->randomAddressM);
     return;
 }
 
 
 void daliCmdQueryRandomAddressL(void)
 {
-    daliAnswer(dali.randomAddressL);
+    daliAnswer(dali->randomAddressL);
+    return;
+}
+
+
+// Location 'dtr' of memory bank 'dtr1', then next location
+void daliCmdReadMemoryLocation(void)
+{
+    int16_t data = daliMemoryRead(dali->dtr1, dali->dtr);
+
+    if (data != DALI_MEMORY_NONE) {
+        dali->dtr++;
+        daliAnswer(data);
+    }
+}
+
+
+#ifndef DALI_DT8
+
+// Application extended commands (device type 6)
+// Reference measurement and current protector (0xE0-0xE2, 0xF9, 0xFB): the gear has
+// neither (see DALI_DT6_FEATURES), the commands are ignored and the queries answer NO
+void daliCmdNotSupported(void)
+{
+    return;
+}
+
+
+void daliCmdSelectDimmingCurve(void)
+{
+    daliSetDimmingCurve(dali->dtr);
+}
+
+
+void daliCmdStoreDTRAsFastFadeTime(void)
+{
+    if (dali->dtr == 0) {
+        dali->fastFadeTime = 0;
+    }
+    else if (dali->dtr < DALI_MIN_FAST_FADE_TIME) {
+        dali->fastFadeTime = DALI_MIN_FAST_FADE_TIME;
+    }
+    else if (dali->dtr > DALI_MAX_FAST_FADE_TIME) {
+        dali->fastFadeTime = DALI_MAX_FAST_FADE_TIME;
+    }
+    else {
+        dali->fastFadeTime = dali->dtr;
+    }
+    daliEepromWrite(ADD_FAST_FADE_TIME, dali->fastFadeTime);
+}
+
+
+void daliCmdQueryGearType(void)
+{
+    daliAnswer(DALI_DT6_GEAR_TYPE);
+    return;
+}
+
+
+void daliCmdQueryDimmingCurve(void)
+{
+    daliAnswer(dali->dimmingCurve);
+    return;
+}
+
+
+void daliCmdQueryPossibleOperatingModes(void)
+{
+    daliAnswer(DALI_DT6_OPERATING_MODES);
+    return;
+}
+
+
+void daliCmdQueryFeatures(void)
+{
+    daliAnswer(DALI_DT6_FEATURES);
+    return;
+}
+
+
+void daliCmdQueryFailureStatus(void)
+{
+    daliAnswer(dali->failureStatus.failureInformation);
+    return;
+}
+
+
+void daliCmdQueryShortCircuit(void)
+{
+    if (dali->failureStatus.shortCircuit == 1) {
+        daliAnswer(DALI_YES);
+    }
+    return;
+}
+
+
+void daliCmdQueryOpenCircuit(void)
+{
+    if (dali->failureStatus.openCircuit == 1) {
+        daliAnswer(DALI_YES);
+    }
+    return;
+}
+
+
+// Not detected: the bits stay 0 (QUERY FEATURES)
+void daliCmdQueryLoadDecrease(void)
+{
+    if (dali->failureStatus.loadDecrease == 1) {
+        daliAnswer(DALI_YES);
+    }
+    return;
+}
+
+
+void daliCmdQueryLoadIncrease(void)
+{
+    if (dali->failureStatus.loadIncrease == 1) {
+        daliAnswer(DALI_YES);
+    }
+    return;
+}
+
+
+void daliCmdQueryCurrentProtectorActive(void)
+{
+    if (dali->failureStatus.currentProtector == 1) {
+        daliAnswer(DALI_YES);
+    }
+    return;
+}
+
+
+void daliCmdQueryThermalShutdown(void)
+{
+    if (dali->failureStatus.thermalShutdown == 1) {
+        daliAnswer(DALI_YES);
+    }
+    return;
+}
+
+
+void daliCmdQueryThermalOverload(void)
+{
+    if (dali->failureStatus.thermalOverload == 1) {
+        daliAnswer(DALI_YES);
+    }
     return;
 }
 
 
+void daliCmdQueryReferenceMeasurementFailed(void)
+{
+    if (dali->failureStatus.referenceFailed == 1) {
+        daliAnswer(DALI_YES);
+    }
+    return;
+}
+
+
+void daliCmdQueryOperatingMode(void)
+{
+    if (dali->dimmingCurve != DIMMING_CURVE_LOGARITHMIC) {
+        daliAnswer(DALI_DT6_OPERATING_MODES | DALI_DT6_MODE_NON_LOG);
+    }
+    else {
+        daliAnswer(DALI_DT6_OPERATING_MODES);
+    }
+    return;
+}
+
+
+void daliCmdQueryFastFadeTime(void)
+{
+    daliAnswer(dali->fastFadeTime);
+    return;
+}
+
+
+void daliCmdQueryMinFastFadeTime(void)
+{
+    daliAnswer(DALI_MIN_FAST_FADE_TIME);
+    return;
+}
+
+#else
+
+// Application extended commands (device type 8)
+// Colour temperatures are 16-bit values in mirek, in 'dtr1' (MSB) and 'dtr' (LSB)
+void daliCmdActivate(void)
+{
+    daliColourActivate(daliFadeTimeCycles());
+}
+
+
+// Kept within the physical limits (MASK: no temporary colour)
+void daliCmdSetTemporaryColourTemperature(void)
+{
+    uint16_t tc = ((uint16_t)dali->dtr1 << 8) | dali->dtr;
+
+    if (tc != COLOUR_MASK) {
+        if (tc < COLOUR_TC_PHYSICAL_COOLEST) {
+            tc = COLOUR_TC_PHYSICAL_COOLEST;
+        }
+        if (tc > COLOUR_TC_PHYSICAL_WARMEST) {
+            tc = COLOUR_TC_PHYSICAL_WARMEST;
+        }
+    }
+    dali->temporaryColourTemperature = tc;
+}
+
+
+void daliCmdStepCooler(void)
+{
+    if (dali->colourTemperature > dali->colourTemperatureCoolest) {
+        daliColourSet(dali->colourTemperature - 1, 0);
+    }
+}
+
+
+void daliCmdStepWarmer(void)
+{
+    if (dali->colourTemperature < dali->colourTemperatureWarmest) {
+        daliColourSet(dali->colourTemperature + 1, 0);
+    }
+}
+
+
+void daliCmdCopyReportToTemporary(void)
+{
+    dali->temporaryColourTemperature = dali->colourTemperature;
+}
+
+
+// The limit is kept within the physical limits and the other limit,
+// the actual colour within the new limits
+void daliCmdStoreColourTemperatureLimit(void)
+{
+    uint16_t tc = ((uint16_t)dali->dtr1 << 8) | dali->dtr;
+
+    if (tc == COLOUR_MASK) {
+        return;
+    }
+    if (tc < COLOUR_TC_PHYSICAL_COOLEST) {
+        tc = COLOUR_TC_PHYSICAL_COOLEST;
+    }
+    if (tc > COLOUR_TC_PHYSICAL_WARMEST) {
+        tc = COLOUR_TC_PHYSICAL_WARMEST;
+    }
+
+    switch (dali->dtr2) {
+        case DALI_TC_LIMIT_COOLEST:
+            if (tc > dali->colourTemperatureWarmest) {
+                tc = dali->colourTemperatureWarmest;
+            }
+            dali->colourTemperatureCoolest = tc;
+            daliEepromWrite(ADD_TC_COOLEST, colourEncode(tc));
+            break;
+
+        case DALI_TC_LIMIT_WARMEST:
+            if (tc < dali->colourTemperatureCoolest) {
+                tc = dali->colourTemperatureCoolest;
+            }
+            dali->colourTemperatureWarmest = tc;
+            daliEepromWrite(ADD_TC_WARMEST, colourEncode(tc));
+            break;
+
+        default:
+            return;     // The physical limits are the ones of the led strings
+    }
+
+    if ((dali->colourTemperature < dali->colourTemperatureCoolest) ||
+        (dali->colourTemperature > dali->colourTemperatureWarmest)) {
+        daliColourSet(dali->colourTemperature, 0);
+    }
+}
+
+
+void daliCmdStoreGearFeatures(void)
+{
+    dali->gearFeatures = dali->dtr & DALI_GEAR_FEATURE_AUTO_ACTIVATION;
+    daliEepromWrite(ADD_GEAR_FEATURES, dali->gearFeatures);
+}
+
+
+void daliCmdQueryGearFeatures(void)
+{
+    daliAnswer(dali->gearFeatures);
+}
+
+
+void daliCmdQueryColourStatus(void)
+{
+    daliAnswer(dali->colourStatus | DALI_COLOUR_STATUS_TC_ACTIVE);
+}
+
+
+void daliCmdQueryColourTypeFeatures(void)
+{
+    daliAnswer(DALI_COLOUR_TYPE_FEATURES);
+}
+
+
+void daliCmdQueryColourValue(void)
+{
+    uint16_t value;
+
+    switch (dali->dtr) {
+        case DALI_COLOUR_VALUE_TC:
+        case DALI_COLOUR_VALUE_REPORT_TC:
+            value = dali->colourTemperature;
+            break;
+        case DALI_COLOUR_VALUE_TC_COOLEST:
+            value = dali->colourTemperatureCoolest;
+            break;
+        case DALI_COLOUR_VALUE_TC_PHYSICAL_COOLEST:
+            value = COLOUR_TC_PHYSICAL_COOLEST;
+            break;
+        case DALI_COLOUR_VALUE_TC_WARMEST:
+            value = dali->colourTemperatureWarmest;
+            break;
+        case DALI_COLOUR_VALUE_TC_PHYSICAL_WARMEST:
+            value = COLOUR_TC_PHYSICAL_WARMEST;
+            break;
+        case DALI_COLOUR_VALUE_TEMPORARY_TC:
+            value = dali->temporaryColourTemperature;
+            break;
+        default:
+            value = COLOUR_MASK;
+            break;
+    }
+    dali->dtr1 = value >> 8;
+    dali->dtr = value;
+    daliAnswer(dali->dtr1);
+}
+
+#endif
+
+
+// Application extended commands (device types 6 and 8)
+void daliCmdQueryExtendedVersionNumber(void)
+{
+#ifndef DALI_DT8
+    daliAnswer(DALI_DT6_EXTENDED_VERSION);
+#else
+    daliAnswer(DALI_DT8_EXTENDED_VERSION);
+#endif
+}
+
+
 // Extended commands
+// Commands flagged DALI_CMD_FLAG_SPECIAL_MODE are only called in special mode
 void daliCmdTerminate(void)
 {
-    specialModeTimeout = 0;
-    compareMode = 0;
-    physicalSelectionMode = PHYSICAL_SELECTION_DISABLED;
+    dali->specialModeTimeout = 0;
+    schedulerStop(SCHEDULER_SPECIAL_MODE);
+    dali->compareMode = 0;
+    dali->physicalSelectionMode = PHYSICAL_SELECTION_DISABLED;
     return;
 }
 
 
 void daliCmdDTR(void)
 {
-    dali.dtr = dali.commandByte;
+    dali->dtr = daliCmd.commandByte;
     return;
 }
 
 
 void daliCmdInitialize(void)
 {
-    if ((dali.commandByte == 0) ||                                             // Broadcast
-        ((dali.commandByte & 0xfe) == ((dali.shortAddress << 1) & 0xfe)) ||    // Short address OK ???
-        ((dali.commandByte == 0xff) && (dali.shortAddress == 0xff))) {         // No short address ???
-        specialModeTimeout = 3600;    // enables special commands for 3600 * 1/4th second = 15min.
-        compareMode = 1;
+    if ((daliCmd.commandByte == 0) ||                                             // Broadcast
+        ((daliCmd.commandByte & 0xfe) == ((dali->shortAddress << 1) & 0xfe)) ||    // Short address OK ???
+        ((daliCmd.commandByte == 0xff) && (dali->shortAddress == 0xff))) {         // No short address ???
+        dali->specialModeTimeout = 3600;    // enables special commands for 3600 * 1/4th second = 15min.
+        schedulerStart(SCHEDULER_SPECIAL_MODE, SPECIAL_MODE_PERIOD, SPECIAL_MODE_PERIOD);
+        dali->compareMode = 1;
     }
     return;
 }
@@ -433,35 +862,32 @@ void daliCmdInitialize(void)
 
 void daliCmdRandomise(void)
 {
-    if (specialModeTimeout != 0) {      // if specialModeTimeout > 0 , specialMode is enabled
-        srand(TCNT1L);                  // initialise the first random value of a list
-        dali.randomAddressH = rand();   // take the next random value
-        dali.randomAddressM = rand();
-        dali.randomAddressL = rand();
-        eeprom_write_byte((uint8_t*)ADD_RANDOM_ADDH, dali.randomAddressH);
-        eeprom_write_byte((uint8_t*)ADD_RANDOM_ADDM, dali.randomAddressM);
-        eeprom_write_byte((uint8_t*)ADD_RANDOM_ADDL, dali.randomAddressL);
-    }
+    uint32_t address = entropyRandomAddress();
+
+    dali->randomAddressH = address >> 16;
+    dali->randomAddressM = address >> 8;
+    dali->randomAddressL = address;
+    daliEepromWrite(ADD_RANDOM_ADDH, dali->randomAddressH);
+    daliEepromWrite(ADD_RANDOM_ADDM, dali->randomAddressM);
+    daliEepromWrite(ADD_RANDOM_ADDL, dali->randomAddressL);
     return;
 }
 
 
 void daliCmdCompare(void)
 {
-    if ((specialModeTimeout != 0) && (compareMode == 1)) {
-
-        // specialMode enabled && compareMode enabled
-        if (dali.randomAddressH > dali.searchAddressH) {
+    if (dali->compareMode == 1) {
+        if (dali->randomAddressH > dali->searchAddressH) {
             return;     // answer 'DALI_NO'
         }
         else {
-            if (dali.randomAddressH == dali.searchAddressH) {
-                if (dali.randomAddressM > dali.searchAddressM) {
+            if (dali->randomAddressH == dali->searchAddressH) {
+                if (dali->randomAddressM > dali->searchAddressM) {
                     return;     // answer 'DALI_NO'
                 }
                 else {
-                    if (dali.randomAddressM == dali.searchAddressM) {
-                        if (dali.randomAddressL > dali.searchAddressL) {
+                    if (dali->randomAddressM == dali->searchAddressM) {
+                        if (dali->randomAddressL > dali->searchAddressL) {
                             return;     // answer 'DALI_NO'
                         }
                     }
@@ -476,12 +902,10 @@ void daliCmdCompare(void)
 
 void daliCmdWithdraw(void)
 {
-    if (specialModeTimeout != 0) {  // specialMode enabled
-        if ((dali.randomAddressH == dali.searchAddressH) &&
-            (dali.randomAddressM == dali.searchAddressM) &&
-            (dali.randomAddressL == dali.searchAddressL)) {
-            compareMode = 0;   // disable compare
-        }
+    if ((dali->randomAddressH == dali->searchAddressH) &&
+        (dali->randomAddressM == dali->searchAddressM) &&
+        (dali->randomAddressL == dali->searchAddressL)) {
+        dali->compareMode = 0;   // disable compare
     }
     return;
 }
@@ -489,51 +913,44 @@ void daliCmdWithdraw(void)
 
 void daliCmdSearchAddressH(void)
 {
-    if (specialModeTimeout != 0) {   // specialMode enabled
-        dali.searchAddressH = dali.commandByte;
-    }
+    dali->searchAddressH = daliCmd.commandByte;
     return;
 }
 
 
 void daliCmdSearchAddressM(void)
 {
-    if (specialModeTimeout != 0) {  // specialMode enabled
-        dali.searchAddressM = dali.commandByte;
-    }
+    dali->searchAddressM = daliCmd.commandByte;
     return;
 }
 
 
 void daliCmdSearchAddressL(void)
 {
-    if (specialModeTimeout != 0) {  // specialMode enabled
-        dali.searchAddressL = dali.commandByte;
-    }
+    dali->searchAddressL = daliCmd.commandByte;
     return;
 }
 
 
 void daliCmdProgramShortAddress(void)
 {
-    if (specialModeTimeout != 0) {  // specialMode enabled
-        if (((dali.randomAddressH == dali.searchAddressH) &&
-            (dali.randomAddressM == dali.searchAddressM) &&
-            (dali.randomAddressL == dali.searchAddressL) &&
-            (physicalSelectionMode == PHYSICAL_SELECTION_DISABLED)) ||  // ???!!!???
-            (physicalSelectionMode == PHYSICAL_SELECTION_ENABLED)) {    // ???!!!???
-            if (dali.commandByte == 0xff) {
-
-                // clear short address
-                dali.shortAddress = 0xff;
-                dali.status.missingShortAddress = 1;
-            }
-            else {
-                dali.shortAddress = dali.commandByte >> 1;
-                dali.status.missingShortAddress = 0;
-            }
-            eeprom_write_byte((uint8_t*)ADD_SHORT_ADD, dali.shortAddress);
+    if (((dali->randomAddressH == dali->searchAddressH) &&
+        (dali->randomAddressM == dali->searchAddressM) &&
+        (dali->randomAddressL == dali->searchAddressL) &&
+        (dali->physicalSelectionMode == PHYSICAL_SELECTION_DISABLED)) ||  // ???!!!???
+        (dali->physicalSelectionMode == PHYSICAL_SELECTION_ENABLED)) {    // ???!!!???
+        if (daliCmd.commandByte == 0xff) {
+
+            // clear short address
+            dali->shortAddress = 0xff;
+            dali->status.missingShortAddress = 1;
         }
+        else {
+            dali->shortAddress = daliCmd.commandByte >> 1;
+            dali->status.missingShortAddress = 0;
+        }
+        daliEepromWrite(ADD_SHORT_ADD, dali->shortAddress);
+        daliUpdateAddressTable();
     }
     return;
 }
@@ -541,10 +958,8 @@ void daliCmdProgramShortAddress(void)
 
 void daliCmdVerifyShortAddress(void)
 {
-    if (specialModeTimeout != 0) {  // specialMode enabled
-        if ((dali.commandByte & 0xfe) == ((dali.shortAddress << 1) & 0xfe)) {
-            daliAnswer(DALI_YES);
-        }
+    if ((daliCmd.commandByte & 0xfe) == ((dali->shortAddress << 1) & 0xfe)) {
+        daliAnswer(DALI_YES);
     }
     return;
 }
@@ -552,14 +967,12 @@ void daliCmdVerifyShortAddress(void)
 
 void daliCmdQueryShortAddress(void)
 {
-    if (specialModeTimeout != 0) {   // specialMode enabled
-        if (((dali.randomAddressH == dali.searchAddressH) &&
-            (dali.randomAddressM == dali.searchAddressM) &&
-            (dali.randomAddressL == dali.searchAddressL) &&
-            (physicalSelectionMode == PHYSICAL_SELECTION_DISABLED)) ||  // ???!!!???
-            (physicalSelectionMode == PHYSICAL_SELECTION_ENABLED)) {    // ???!!!???
-            daliAnswer((dali.shortAddress << 1) | 1);
-        }
+    if (((dali->randomAddressH == dali->searchAddressH) &&
+        (dali->randomAddressM == dali->searchAddressM) &&
+        (dali->randomAddressL == dali->searchAddressL) &&
+        (dali->physicalSelectionMode == PHYSICAL_SELECTION_DISABLED)) ||  // ???!!!???
+        (dali->physicalSelectionMode == PHYSICAL_SELECTION_ENABLED)) {    // ???!!!???
+        daliAnswer((dali->shortAddress << 1) | 1);
     }
     return;
 }
@@ -567,15 +980,13 @@ void daliCmdQueryShortAddress(void)
 
 void daliCmdPhysicalSelection(void)
 {
-    if (specialModeTimeout != 0) {  // specialMode enabled
-        if (physicalSelectionMode == PHYSICAL_SELECTION_DISABLED) {
-            physicalSelectionMode = PHYSICAL_SELECTION_REQUESTED;     // toggles physical selection mode
-            compareMode = 0;
-        }
-        else {
-            physicalSelectionMode = PHYSICAL_SELECTION_DISABLED;
-            compareMode = 1;   // reactivate search & random address comparison
-        }
+    if (dali->physicalSelectionMode == PHYSICAL_SELECTION_DISABLED) {
+        dali->physicalSelectionMode = PHYSICAL_SELECTION_REQUESTED;     // toggles physical selection mode
+        dali->compareMode = 0;
+    }
+    else {
+        dali->physicalSelectionMode = PHYSICAL_SELECTION_DISABLED;
+        dali->compareMode = 1;   // reactivate search & random address comparison
     }
     return;
 }
@@ -583,5 +994,30 @@ void daliCmdPhysicalSelection(void)
 
 void daliCmdEnableDeviceTypeX(void)
 {
+    enabledDeviceType = daliCmd.commandByte;   // Valid for the next command only
+    return;
+}
+
+
+void daliCmdDTR1(void)
+{
+    dali->dtr1 = daliCmd.commandByte;
+    return;
+}
+
+
+void daliCmdDTR2(void)
+{
+    dali->dtr2 = daliCmd.commandByte;
     return;
 }
+
+
+// 'commandByte' to location 'dtr' of memory bank 'dtr1', answered if written
+void daliCmdWriteMemoryLocation(void)
+{
+    if (dali->memoryWriteEnabled && daliMemoryWrite(dali->dtr1, dali->dtr, daliCmd.commandByte)) {
+        dali->dtr++;
+        daliAnswer(daliCmd.commandByte);
+    }
+}
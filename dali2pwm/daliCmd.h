@@ -1,6 +1,9 @@
 #ifndef _DALI_CMD_
 #define _DALI_CMD_
 
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+
 // Pre-defined response on query
 #define DALI_YES                                    0xFF
 #define DALI_NO                                     0x00
@@ -15,6 +18,24 @@
 #define DALI_SELECTOR_BIT_MASK                      0x01
 #define DALI_DIRECT_ARC_POWER_CMD                   0x00
 #define DALI_COMAND_FOLLOWING_CMD                   0x01
+#define DALI_SPECIAL_CMD_INDEX(address)             (((address) - DALI_SPECIAL_CMD_1) >> 1)   // 0-31
+
+// Command descriptor flags
+#define DALI_CMD_FLAG_ARC_POWER                     0x01    // Stops a running fade, clears the power failure state
+#define DALI_CMD_FLAG_SEND_TWICE                    0x02    // Executed when received twice within SEND_TWICE_WINDOW
+#define DALI_CMD_FLAG_ANSWER                        0x04    // May answer (BW frame), ignored when too late to answer
+#define DALI_CMD_FLAG_SPECIAL_MODE                  0x08    // Ignored out of special mode (see INITIALISE)
+#define DALI_CMD_FLAG_DEVICE_TYPE                   0x10    // Application extended command, after ENABLE DEVICE TYPE X
+#define DALI_CMD_FLAG_MEMORY                        0x20    // Memory bank access, keeps ENABLE WRITE MEMORY
+
+// Command descriptor (in flash)
+typedef struct {
+    void            (*handler)(void);       // NULL: reserved command
+    uint8_t         flags;                  // DALI_CMD_FLAG_xxx
+} DaliCommand;
+
+extern const DaliCommand DALI_COMMANDS[256] PROGMEM;            // Indexed by the command byte
+extern const DaliCommand DALI_SPECIAL_COMMANDS[32] PROGMEM;     // Indexed by DALI_SPECIAL_CMD_INDEX()
 
 // Arc power control commands
 #define DALI_CMD_IMMEDIATE_OFF                              0x00
@@ -41,6 +62,7 @@
 #define DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL            0x2D  // 'dtr' => "powerOnLevel"
 #define DALI_CMD_STORE_THE_DTR_AS_FADE_TIME                 0x2E  // 'dtr' => "fadeTime"
 #define DALI_CMD_STORE_THE_DTR_AS_FADE_RATE                 0x2F  // 'dtr' => "fadeRate"
+#define DALI_CMD_SET_EXTENDED_FADE_TIME                     0x30  // 'dtr' => "extendedFadeTime"
 #define DALI_CMD_STORE_THE_DTR_AS_SCENE                     0x40  // 'commandByte' => "scene", 'dtr' => new "sceneLevel"
 
 // System parameters settings
@@ -49,6 +71,7 @@
 #define DALI_CMD_ADD_TO_GROUP                               0x60  // 'commandByte' => "group"
 #define DALI_CMD_REMOVE_FROM_GROUP                          0x70  // 'commandByte' => "group"
 #define DALI_CMD_STORE_DTR_AS_SHORT_ADDRESS                 0x80  // 'dtr' => "shortAddress"
+#define DALI_CMD_ENABLE_WRITE_MEMORY                        0x81  // WRITE MEMORY LOCATION accepted until another command
 
 // Queries
 #define DALI_CMD_QUERY_STATUS                               0x90  // "DALI_YES" => 'commandByte' else nothing
@@ -63,21 +86,90 @@
 #define DALI_CMD_QUERY_DEVICE_TYPE                          0x99  // "deviceType" => 'commandByte'
 #define DALI_CMD_QUERY_PHYSICAL_MINIMUM_LEVEL               0x9A  // "physicalMinimumLevel" => 'commandByte'
 #define DALI_CMD_QUERY_POWER_FAILURE                        0x9B  // ... response (c.f. DALI standard) => 'commandByte'
+#define DALI_CMD_QUERY_CONTENT_DTR1                         0x9C  // 'dtr1' => 'commandByte'
+#define DALI_CMD_QUERY_CONTENT_DTR2                         0x9D  // 'dtr2' => 'commandByte'
 #define DALI_CMD_QUERY_ACTUAL_LEVEL                         0xA0  // "actualDimLevel" or "DALI_MASK" => 'commandByte'
 #define DALI_CMD_QUERY_MAX_LEVEL                            0xA1  // "maxLevel" => 'commandByte'
 #define DALI_CMD_QUERY_MIN_LEVEL                            0xA2  // "minLevel" => 'commandByte'
 #define DALI_CMD_QUERY_POWER_ON_LEVEL                       0xA3  // "powerOnLevel" => 'commandByte'
 #define DALI_CMD_QUERY_SYSTEM_FAILURE_LEVEL                 0xA4  // "systemFailureLevel" => 'commandByte'
 #define DALI_CMD_QUERY_FADE_SETTINGS                        0xA5  // "fadeTime, fadeRate" => 'commandByte'
+#define DALI_CMD_QUERY_EXTENDED_FADE_TIME                   0xA8  // "extendedFadeTime" => 'commandByte'
 #define DALI_CMD_QUERY_SCENE_LEVEL                          0xB0  // 'commandByte' => "scene", "scene_level" => 'commandByte'
 #define DALI_CMD_QUERY_GROUPS_0_7                           0xC0  // "group0_7" => 'commandByte'
 #define DALI_CMD_QUERY_GROUPS_8_15                          0xC1  // "group8_15" => 'commandByte'
 #define DALI_CMD_QUERY_RANDOM_ADDRESS_H                     0xC2  // "randomAddressH" => 'commandByte'
 #define DALI_CMD_QUERY_RANDOM_ADDRESS_M                     0xC3  // "randomAddressM" => 'commandByte'
 #define DALI_CMD_QUERY_RANDOM_ADDRESS_L                     0xC4  // "randomAddressHL" => 'commandByte'
+#define DALI_CMD_READ_MEMORY_LOCATION                       0xC5  // memory bank 'dtr1', location 'dtr' => 'commandByte' (see daliMemory.h)
 
-// Use of extended commands ???
-#define DALI_CMD_QUERY_APPLICATION_EXTENTED_COMMAND         0xE0  // for "deviceType" = 0, extended commands are not used
+// Application extended commands (0xE0-0xFF)
+// Only accepted after ENABLE DEVICE TYPE X with X = DALI_DEVICE_TYPE
+#define DALI_CMD_QUERY_APPLICATION_EXTENTED_COMMAND         0xE0
+
+// Application extended commands (device type 6)
+// Need to be received twice
+#define DALI_CMD_REFERENCE_SYSTEM_POWER                     0xE0  // Ignored, no reference measurement (see DALI_DT6_FEATURES)
+#define DALI_CMD_ENABLE_CURRENT_PROTECTOR                   0xE1  // Ignored, no current protector
+#define DALI_CMD_DISABLE_CURRENT_PROTECTOR                  0xE2  // Ignored, no current protector
+#define DALI_CMD_SELECT_DIMMING_CURVE                       0xE3  // 'dtr' => "dimmingCurve"
+#define DALI_CMD_STORE_DTR_AS_FAST_FADE_TIME                0xE4  // 'dtr' => "fastFadeTime"
+
+// Application extended queries (device type 6)
+#define DALI_CMD_QUERY_GEAR_TYPE                            0xED  // "DALI_DT6_GEAR_TYPE" => 'commandByte'
+#define DALI_CMD_QUERY_DIMMING_CURVE                        0xEE  // "dimmingCurve" => 'commandByte'
+#define DALI_CMD_QUERY_POSSIBLE_OPERATING_MODES             0xEF  // "DALI_DT6_OPERATING_MODES" => 'commandByte'
+#define DALI_CMD_QUERY_FEATURES                             0xF0  // "DALI_DT6_FEATURES" => 'commandByte'
+#define DALI_CMD_QUERY_FAILURE_STATUS                       0xF1  // "failureStatus" => 'commandByte'
+#define DALI_CMD_QUERY_SHORT_CIRCUIT                        0xF2
+#define DALI_CMD_QUERY_OPEN_CIRCUIT                         0xF3
+#define DALI_CMD_QUERY_LOAD_DECREASE                        0xF4
+#define DALI_CMD_QUERY_LOAD_INCREASE                        0xF5
+#define DALI_CMD_QUERY_CURRENT_PROTECTOR_ACTIVE             0xF6
+#define DALI_CMD_QUERY_THERMAL_SHUTDOWN                     0xF7
+#define DALI_CMD_QUERY_THERMAL_OVERLOAD                     0xF8
+#define DALI_CMD_QUERY_REFERENCE_RUNNING                    0xF9  // Never (no answer)
+#define DALI_CMD_QUERY_REFERENCE_MEASUREMENT_FAILED         0xFA
+#define DALI_CMD_QUERY_CURRENT_PROTECTOR_ENABLED            0xFB  // Never (no answer)
+#define DALI_CMD_QUERY_OPERATING_MODE                       0xFC  // "DALI_DT6_OPERATING_MODES", non-log dimming curve => 'commandByte'
+#define DALI_CMD_QUERY_FAST_FADE_TIME                       0xFD  // "fastFadeTime" => 'commandByte'
+#define DALI_CMD_QUERY_MIN_FAST_FADE_TIME                   0xFE  // "DALI_MIN_FAST_FADE_TIME" => 'commandByte'
+
+// Application extended commands (device type 8, colour temperature Tc only)
+#define DALI_CMD_ACTIVATE                                   0xE2  // "temporaryColourTemperature" => "colourTemperature", with the fade time
+#define DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE           0xE7  // 'dtr1':'dtr' => "temporaryColourTemperature"
+#define DALI_CMD_STEP_COOLER                                0xE8  // "colourTemperature" - 1 mirek, immediately
+#define DALI_CMD_STEP_WARMER                                0xE9  // "colourTemperature" + 1 mirek, immediately
+#define DALI_CMD_COPY_REPORT_TO_TEMPORARY                   0xEE  // "colourTemperature" => "temporaryColourTemperature"
+
+// Application extended commands (device type 8)
+// Need to be received twice
+#define DALI_CMD_STORE_COLOUR_TEMPERATURE_LIMIT             0xF2  // 'dtr1':'dtr' => limit 'dtr2' (DALI_TC_LIMIT_xxx)
+#define DALI_CMD_STORE_GEAR_FEATURES                        0xF3  // 'dtr' => "gearFeatures"
+
+// Application extended queries (device type 8)
+#define DALI_CMD_QUERY_GEAR_FEATURES                        0xF7  // "gearFeatures" => 'commandByte'
+#define DALI_CMD_QUERY_COLOUR_STATUS                        0xF8  // "colourStatus" => 'commandByte'
+#define DALI_CMD_QUERY_COLOUR_TYPE_FEATURES                 0xF9  // "DALI_COLOUR_TYPE_FEATURES" => 'commandByte'
+#define DALI_CMD_QUERY_COLOUR_VALUE                         0xFA  // value 'dtr' (DALI_COLOUR_VALUE_xxx) => 'dtr1':'dtr', MSB => 'commandByte'
+
+// Application extended query (device types 6 and 8)
+#define DALI_CMD_QUERY_EXTENDED_VERSION_NUMBER              0xFF  // "DALI_DT6_EXTENDED_VERSION" or "DALI_DT8_EXTENDED_VERSION" => 'commandByte'
+
+// STORE COLOUR TEMPERATURE LIMIT, selected by 'dtr2'
+#define DALI_TC_LIMIT_COOLEST                               0
+#define DALI_TC_LIMIT_WARMEST                               1
+#define DALI_TC_LIMIT_PHYSICAL_COOLEST                      2     // Led strings, not writable
+#define DALI_TC_LIMIT_PHYSICAL_WARMEST                      3
+
+// QUERY COLOUR VALUE, selected by 'dtr' (COLOUR_MASK for the others)
+#define DALI_COLOUR_VALUE_TC                                2
+#define DALI_COLOUR_VALUE_TC_COOLEST                        128
+#define DALI_COLOUR_VALUE_TC_PHYSICAL_COOLEST               129
+#define DALI_COLOUR_VALUE_TC_WARMEST                        130
+#define DALI_COLOUR_VALUE_TC_PHYSICAL_WARMEST               131
+#define DALI_COLOUR_VALUE_TEMPORARY_TC                      194
+#define DALI_COLOUR_VALUE_REPORT_TC                         210
 
 // Extended commands
 #define DALI_CMD_TERMINATE                                  0xA1
@@ -100,7 +192,10 @@
 #define DALI_CMD_PHYSICAL_SELECTION                         0xBD
 
 // Extended commands - Special extended command
-#define DALI_CMD_ENABLE_DEVICE_TYPE_X                       0xC1    // for "deviceType" = 0, extended commands are not used
+#define DALI_CMD_ENABLE_DEVICE_TYPE_X                       0xC1    // 'commandByte' => "enabledDeviceType"
+#define DALI_CMD_DTR1                                       0xC3    // received direct data => 'dtr1'
+#define DALI_CMD_DTR2                                       0xC5    // received direct data => 'dtr2'
+#define DALI_CMD_WRITE_MEMORY_LOCATION                      0xC7    // 'commandByte' => memory bank 'dtr1', location 'dtr'
 
 
 // Indirect arc power ocmmands
@@ -124,7 +219,9 @@ void daliCmdStoreTheDTRAsSystemFailureLevel(void);
 void daliCmdStoreTheDTRAsPowerOnLevel(void);
 void daliCmdStoreTheDTRAsFadeTime(void);
 void daliCmdStoreTheDTRAsFadeRate(void);
+void daliCmdSetExtendedFadeTime(void);
 void daliCmdStoreTheDTRAsShortAddress(void);
+void daliCmdEnableWriteMemory(void);
 void daliCmdStoreTheDTRAsScene(void);
 void daliCmdRemoveFromScene(void);
 void daliCmdAddToGroup(void);
@@ -143,18 +240,59 @@ void daliCmdQueryContentDTR(void);
 void daliCmdQueryDeviceType(void);
 void daliCmdQueryPhysicalMinimumLevel(void);
 void daliCmdQueryPowerFailure(void);
+void daliCmdQueryContentDTR1(void);
+void daliCmdQueryContentDTR2(void);
 void daliCmdQueryActualLevel(void);
 void daliCmdQueryMaxLevel(void);
 void daliCmdQueryMinLevel(void);
 void daliCmdQueryPowerOnLevel(void);
 void daliCmdQuerySystemFailureLevel(void);
 void daliCmdQueryFadeSettings(void);
+void daliCmdQueryExtendedFadeTime(void);
 void daliCmdQuerySceneLevel(void);
 void daliCmdQueryGroups0_7(void);
 void daliCmdQueryGroups8_15(void);
 void daliCmdQueryRandomAddressH(void);
 void daliCmdQueryRandomAddressM(void);
 void daliCmdQueryRandomAddressL(void);
+void daliCmdReadMemoryLocation(void);
+
+// Application extended commands (device type 6)
+void daliCmdNotSupported(void);
+void daliCmdSelectDimmingCurve(void);
+void daliCmdStoreDTRAsFastFadeTime(void);
+void daliCmdQueryGearType(void);
+void daliCmdQueryDimmingCurve(void);
+void daliCmdQueryPossibleOperatingModes(void);
+void daliCmdQueryFeatures(void);
+void daliCmdQueryFailureStatus(void);
+void daliCmdQueryShortCircuit(void);
+void daliCmdQueryOpenCircuit(void);
+void daliCmdQueryLoadDecrease(void);
+void daliCmdQueryLoadIncrease(void);
+void daliCmdQueryCurrentProtectorActive(void);
+void daliCmdQueryThermalShutdown(void);
+void daliCmdQueryThermalOverload(void);
+void daliCmdQueryReferenceMeasurementFailed(void);
+void daliCmdQueryOperatingMode(void);
+void daliCmdQueryFastFadeTime(void);
+void daliCmdQueryMinFastFadeTime(void);
+
+// Application extended commands (device type 8)
+void daliCmdActivate(void);
+void daliCmdSetTemporaryColourTemperature(void);
+void daliCmdStepCooler(void);
+void daliCmdStepWarmer(void);
+void daliCmdCopyReportToTemporary(void);
+void daliCmdStoreColourTemperatureLimit(void);
+void daliCmdStoreGearFeatures(void);
+void daliCmdQueryGearFeatures(void);
+void daliCmdQueryColourStatus(void);
+void daliCmdQueryColourTypeFeatures(void);
+void daliCmdQueryColourValue(void);
+
+// Application extended commands (device types 6 and 8)
+void daliCmdQueryExtendedVersionNumber(void);
 
 // Extended commands
 void daliCmdTerminate(void);
@@ -171,5 +309,8 @@ void daliCmdVerifyShortAddress(void);
 void daliCmdQueryShortAddress(void);
 void daliCmdPhysicalSelection(void);
 void daliCmdEnableDeviceTypeX(void);
+void daliCmdDTR1(void);
+void daliCmdDTR2(void);
+void daliCmdWriteMemoryLocation(void);
 
 #endif
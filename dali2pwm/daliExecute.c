@@ -1,299 +1,203 @@
+#include <avr/pgmspace.h>
+
 #include "dali.h"
 #include "daliCmd.h"
 
-extern DaliRegisters dali;
+extern DaliRegisters daliGears[DALI_GEAR_COUNT];
+extern DaliRegisters *dali;
+extern DaliCmd daliCmd;
 extern uint8_t requestedLevel;
 
-
-// Data_byte processing
-void daliExecute(void)
+// Flags shortcuts
+#define ARC     DALI_CMD_FLAG_ARC_POWER
+#define TWICE   DALI_CMD_FLAG_SEND_TWICE
+#define ANSWER  DALI_CMD_FLAG_ANSWER
+#define SPECIAL DALI_CMD_FLAG_SPECIAL_MODE
+#define DT      DALI_CMD_FLAG_DEVICE_TYPE
+#define MEMORY  DALI_CMD_FLAG_MEMORY
+
+// Flash and -Os listing of the dispatch (tables, daliAnalyse(), daliExecute()), against
+// an older revision: make dispatch DISPATCH_BASE=<revision> (see Makefile)
+
+// Commands following an address (2nd byte of the frame)
+// Missing entries are reserved commands: no handler, ignored.
+const DaliCommand DALI_COMMANDS[256] PROGMEM = {
+
+    // Indirect arc power commands
+    [DALI_CMD_IMMEDIATE_OFF]                            = { daliCmdImmediateOff,                    ARC },
+    [DALI_CMD_UP_200MS]                                 = { daliCmdUp200ms,                         ARC },
+    [DALI_CMD_DOWN_200MS]                               = { daliCmdDown200ms,                       ARC },
+    [DALI_CMD_STEP_UP]                                  = { daliCmdStepUp,                          ARC },
+    [DALI_CMD_STEP_DOWN]                                = { daliCmdStepDown,                        ARC },
+    [DALI_CMD_RECALL_MAX_LEVEL]                         = { daliCmdRecallMaxLevel,                  ARC },
+    [DALI_CMD_RECALL_MIN_LEVEL]                         = { daliCmdRecallMinLevel,                  ARC },
+    [DALI_CMD_STEP_DOWN_AND_OFF]                        = { daliCmdStepDownAndOff,                  ARC },
+    [DALI_CMD_ON_AND_STEP_UP]                           = { daliCmdOnAndStepUp,                     ARC },
+    [DALI_CMD_GO_TO_SCENE ... DALI_CMD_GO_TO_SCENE + 15] = { daliCmdGoToScene,                      ARC },
+
+    // Configuration commands
+    [DALI_CMD_RESET]                                    = { daliCmdReset,                           TWICE },
+    [DALI_CMD_STORE_ACTUAL_LEVEL_IN_DTR]                = { daliCmdStoreActualLevelInDTR,           TWICE },
+    [DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL]               = { daliCmdStoreTheDTRAsMaxLevel,           TWICE },
+    [DALI_CMD_STORE_THE_DTR_AS_MIN_LEVEL]               = { daliCmdStoreTheDTRAsMinLevel,           TWICE },
+    [DALI_CMD_STORE_THE_DTR_AS_SYSTEM_FAILURE_LEVEL]    = { daliCmdStoreTheDTRAsSystemFailureLevel, TWICE },
+    [DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL]          = { daliCmdStoreTheDTRAsPowerOnLevel,       TWICE },
+    [DALI_CMD_STORE_THE_DTR_AS_FADE_TIME]               = { daliCmdStoreTheDTRAsFadeTime,           TWICE },
+    [DALI_CMD_STORE_THE_DTR_AS_FADE_RATE]               = { daliCmdStoreTheDTRAsFadeRate,           TWICE },
+    [DALI_CMD_SET_EXTENDED_FADE_TIME]                   = { daliCmdSetExtendedFadeTime,             TWICE },
+    [DALI_CMD_STORE_THE_DTR_AS_SCENE ... DALI_CMD_STORE_THE_DTR_AS_SCENE + 15] = { daliCmdStoreTheDTRAsScene, TWICE },
+    [DALI_CMD_REMOVE_FROM_SCENE ... DALI_CMD_REMOVE_FROM_SCENE + 15]           = { daliCmdRemoveFromScene,    TWICE },
+    [DALI_CMD_ADD_TO_GROUP ... DALI_CMD_ADD_TO_GROUP + 15]                     = { daliCmdAddToGroup,         TWICE },
+    [DALI_CMD_REMOVE_FROM_GROUP ... DALI_CMD_REMOVE_FROM_GROUP + 15]           = { daliCmdRemoveFromGroup,    TWICE },
+    [DALI_CMD_STORE_DTR_AS_SHORT_ADDRESS]               = { daliCmdStoreTheDTRAsShortAddress,       TWICE },
+    [DALI_CMD_ENABLE_WRITE_MEMORY]                      = { daliCmdEnableWriteMemory,               TWICE },
+
+    // Queries
+    [DALI_CMD_QUERY_STATUS]                             = { daliCmdQueryStatus,                     ANSWER },
+    [DALI_CMD_QUERY_BALLAST]                            = { daliCmdQueryBallast,                    ANSWER },
+    [DALI_CMD_QUERY_LAMP_FAILURE]                       = { daliCmdQueryLampFailure,                ANSWER },
+    [DALI_CMD_QUERY_LAMP_POWER_ON]                      = { daliCmdQueryLampPowerOn,                ANSWER },
+    [DALI_CMD_QUERY_LIMIT_ERROR]                        = { daliCmdqueryLimitError,                 ANSWER },
+    [DALI_CMD_QUERY_RESET_STATE]                        = { daliCmdQueryResetState,                 ANSWER },
+    [DALI_CMD_QUERY_MISSING_SHORT_ADDRESS]              = { daliCmdQueryMissingShortAddress,        ANSWER },
+    [DALI_CMD_QUERY_VERSION_NUMBER]                     = { daliCmdQueryVersionNumber,              ANSWER },
+    [DALI_CMD_QUERY_CONTENT_DTR]                        = { daliCmdQueryContentDTR,                 ANSWER | MEMORY },
+    [DALI_CMD_QUERY_DEVICE_TYPE]                        = { daliCmdQueryDeviceType,                 ANSWER },
+    [DALI_CMD_QUERY_PHYSICAL_MINIMUM_LEVEL]             = { daliCmdQueryPhysicalMinimumLevel,       ANSWER },
+    [DALI_CMD_QUERY_POWER_FAILURE]                      = { daliCmdQueryPowerFailure,               ANSWER },
+    [DALI_CMD_QUERY_CONTENT_DTR1]                       = { daliCmdQueryContentDTR1,                ANSWER | MEMORY },
+    [DALI_CMD_QUERY_CONTENT_DTR2]                       = { daliCmdQueryContentDTR2,                ANSWER | MEMORY },
+    [DALI_CMD_QUERY_ACTUAL_LEVEL]                       = { daliCmdQueryActualLevel,                ANSWER },
+    [DALI_CMD_QUERY_MAX_LEVEL]                          = { daliCmdQueryMaxLevel,                   ANSWER },
+    [DALI_CMD_QUERY_MIN_LEVEL]                          = { daliCmdQueryMinLevel,                   ANSWER },
+    [DALI_CMD_QUERY_POWER_ON_LEVEL]                     = { daliCmdQueryPowerOnLevel,               ANSWER },
+    [DALI_CMD_QUERY_SYSTEM_FAILURE_LEVEL]               = { daliCmdQuerySystemFailureLevel,         ANSWER },
+    [DALI_CMD_QUERY_FADE_SETTINGS]                      = { daliCmdQueryFadeSettings,               ANSWER },
+    [DALI_CMD_QUERY_EXTENDED_FADE_TIME]                 = { daliCmdQueryExtendedFadeTime,           ANSWER },
+    [DALI_CMD_QUERY_SCENE_LEVEL ... DALI_CMD_QUERY_SCENE_LEVEL + 15] = { daliCmdQuerySceneLevel,   ANSWER },
+    [DALI_CMD_QUERY_GROUPS_0_7]                         = { daliCmdQueryGroups0_7,                  ANSWER },
+    [DALI_CMD_QUERY_GROUPS_8_15]                        = { daliCmdQueryGroups8_15,                 ANSWER },
+    [DALI_CMD_QUERY_RANDOM_ADDRESS_H]                   = { daliCmdQueryRandomAddressH,             ANSWER },
+    [DALI_CMD_QUERY_RANDOM_ADDRESS_M]                   = { daliCmdQueryRandomAddressM,             ANSWER },
+    [DALI_CMD_QUERY_RANDOM_ADDRESS_L]                   = { daliCmdQueryRandomAddressL,             ANSWER },
+    [DALI_CMD_READ_MEMORY_LOCATION]                     = { daliCmdReadMemoryLocation,              ANSWER | MEMORY },
+
+#ifndef DALI_DT8
+    // Application extended commands (device type 6, IEC 62386-207)
+    [DALI_CMD_REFERENCE_SYSTEM_POWER ... DALI_CMD_DISABLE_CURRENT_PROTECTOR] = { daliCmdNotSupported, DT | TWICE },
+    [DALI_CMD_SELECT_DIMMING_CURVE]                     = { daliCmdSelectDimmingCurve,              DT | TWICE },
+    [DALI_CMD_STORE_DTR_AS_FAST_FADE_TIME]              = { daliCmdStoreDTRAsFastFadeTime,          DT | TWICE },
+    [DALI_CMD_QUERY_GEAR_TYPE]                          = { daliCmdQueryGearType,                   DT | ANSWER },
+    [DALI_CMD_QUERY_DIMMING_CURVE]                      = { daliCmdQueryDimmingCurve,               DT | ANSWER },
+    [DALI_CMD_QUERY_POSSIBLE_OPERATING_MODES]           = { daliCmdQueryPossibleOperatingModes,     DT | ANSWER },
+    [DALI_CMD_QUERY_FEATURES]                           = { daliCmdQueryFeatures,                   DT | ANSWER },
+    [DALI_CMD_QUERY_FAILURE_STATUS]                     = { daliCmdQueryFailureStatus,              DT | ANSWER },
+    [DALI_CMD_QUERY_SHORT_CIRCUIT]                      = { daliCmdQueryShortCircuit,               DT | ANSWER },
+    [DALI_CMD_QUERY_OPEN_CIRCUIT]                       = { daliCmdQueryOpenCircuit,                DT | ANSWER },
+    [DALI_CMD_QUERY_LOAD_DECREASE]                      = { daliCmdQueryLoadDecrease,               DT | ANSWER },
+    [DALI_CMD_QUERY_LOAD_INCREASE]                      = { daliCmdQueryLoadIncrease,               DT | ANSWER },
+    [DALI_CMD_QUERY_CURRENT_PROTECTOR_ACTIVE]           = { daliCmdQueryCurrentProtectorActive,     DT | ANSWER },
+    [DALI_CMD_QUERY_THERMAL_SHUTDOWN]                   = { daliCmdQueryThermalShutdown,            DT | ANSWER },
+    [DALI_CMD_QUERY_THERMAL_OVERLOAD]                   = { daliCmdQueryThermalOverload,            DT | ANSWER },
+    [DALI_CMD_QUERY_REFERENCE_RUNNING]                  = { daliCmdNotSupported,                    DT | ANSWER },
+    [DALI_CMD_QUERY_REFERENCE_MEASUREMENT_FAILED]       = { daliCmdQueryReferenceMeasurementFailed, DT | ANSWER },
+    [DALI_CMD_QUERY_CURRENT_PROTECTOR_ENABLED]          = { daliCmdNotSupported,                    DT | ANSWER },
+    [DALI_CMD_QUERY_OPERATING_MODE]                     = { daliCmdQueryOperatingMode,              DT | ANSWER },
+    [DALI_CMD_QUERY_FAST_FADE_TIME]                     = { daliCmdQueryFastFadeTime,               DT | ANSWER },
+    [DALI_CMD_QUERY_MIN_FAST_FADE_TIME]                 = { daliCmdQueryMinFastFadeTime,            DT | ANSWER },
+#else
+    // Application extended commands (device type 8)
+    [DALI_CMD_ACTIVATE]                                 = { daliCmdActivate,                        DT },
+    [DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE]         = { daliCmdSetTemporaryColourTemperature,   DT },
+    [DALI_CMD_STEP_COOLER]                              = { daliCmdStepCooler,                      DT },
+    [DALI_CMD_STEP_WARMER]                              = { daliCmdStepWarmer,                      DT },
+    [DALI_CMD_COPY_REPORT_TO_TEMPORARY]                 = { daliCmdCopyReportToTemporary,           DT },
+    [DALI_CMD_STORE_COLOUR_TEMPERATURE_LIMIT]           = { daliCmdStoreColourTemperatureLimit,     DT | TWICE },
+    [DALI_CMD_STORE_GEAR_FEATURES]                      = { daliCmdStoreGearFeatures,               DT | TWICE },
+    [DALI_CMD_QUERY_GEAR_FEATURES]                      = { daliCmdQueryGearFeatures,               DT | ANSWER },
+    [DALI_CMD_QUERY_COLOUR_STATUS]                      = { daliCmdQueryColourStatus,               DT | ANSWER },
+    [DALI_CMD_QUERY_COLOUR_TYPE_FEATURES]               = { daliCmdQueryColourTypeFeatures,         DT | ANSWER },
+    [DALI_CMD_QUERY_COLOUR_VALUE]                       = { daliCmdQueryColourValue,                DT | ANSWER },
+#endif
+    [DALI_CMD_QUERY_EXTENDED_VERSION_NUMBER]            = { daliCmdQueryExtendedVersionNumber,      DT | ANSWER },
+};
+
+// Special commands, coded in the address byte (101x xxx1 and 110x xxx1)
+// Indexed by DALI_SPECIAL_CMD_INDEX(addressByte)
+const DaliCommand DALI_SPECIAL_COMMANDS[32] PROGMEM = {
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_TERMINATE)]                = { daliCmdTerminate,           0 },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_DTR)]                      = { daliCmdDTR,                 MEMORY },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_INITIALIZE)]               = { daliCmdInitialize,          TWICE },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_RANDOMISE)]                = { daliCmdRandomise,           TWICE | SPECIAL },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_COMPARE)]                  = { daliCmdCompare,             SPECIAL | ANSWER },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_WITHDRAW)]                 = { daliCmdWithdraw,            SPECIAL },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_SEARCH_ADDRESS_H)]         = { daliCmdSearchAddressH,      SPECIAL },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_SEARCH_ADDRESS_M)]         = { daliCmdSearchAddressM,      SPECIAL },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_SEARCH_ADDRESS_L)]         = { daliCmdSearchAddressL,      SPECIAL },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_PROGRAM_SHORT_ADDRESS)]    = { daliCmdProgramShortAddress, SPECIAL },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_VERIFY_SHORT_ADDRESS)]     = { daliCmdVerifyShortAddress,  SPECIAL | ANSWER },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_QUERY_SHORT_ADDRESS)]      = { daliCmdQueryShortAddress,   SPECIAL | ANSWER },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_PHYSICAL_SELECTION)]       = { daliCmdPhysicalSelection,   SPECIAL },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_ENABLE_DEVICE_TYPE_X)]     = { daliCmdEnableDeviceTypeX,   0 },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_DTR1)]                     = { daliCmdDTR1,                MEMORY },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_DTR2)]                     = { daliCmdDTR2,                MEMORY },
+    [DALI_SPECIAL_CMD_INDEX(DALI_CMD_WRITE_MEMORY_LOCATION)]    = { daliCmdWriteMemoryLocation, ANSWER | MEMORY },
+};
+
+
+// Data_byte processing, for the selected instance
+static void daliExecuteGear(void)
 {
-    uint8_t cmdNumber = 0;
-
-    switch (dali.cmdType) {
+    switch (daliCmd.type) {
         case DALI_CMD_TYPE_DIRECT_ARC_POWER:
-            requestedLevel = dali.commandByte;
+            dali->memoryWriteEnabled = 0;
+            requestedLevel = daliCmd.commandByte;
             daliChangeOutputWithFadeTime();
-            dali.status.resetState = 0;
-            dali.status.powerFailure = 0;
+            dali->status.resetState = 0;
+            dali->status.powerFailure = 0;
             break;
 
-        case DALI_CMD_TYPE_SPECIAL_CMD:
-            switch (dali.commandByte) {
-                case DALI_CMD_TERMINATE:
-                    daliCmdTerminate();
-                    break;
-
-                case DALI_CMD_DTR:
-                    daliCmdTerminate();
-                    break;
-
-                case DALI_CMD_INITIALIZE:
-                    daliCmdInitialize();
-                    break;
-
-                case DALI_CMD_RANDOMISE:
-                    daliCmdRandomise();
-                    break;
-
-                case DALI_CMD_COMPARE:
-                    daliCmdCompare();
-                    break;
-
-                case DALI_CMD_WITHDRAW:
-                    daliCmdWithdraw();
-                    break;
-
-                case DALI_CMD_SEARCH_ADDRESS_H:
-                    daliCmdSearchAddressH();
-                    break;
-
-                case DALI_CMD_SEARCH_ADDRESS_M:
-                    daliCmdSearchAddressM();
-                    break;
-
-                case DALI_CMD_SEARCH_ADDRESS_L:
-                    daliCmdSearchAddressL();
-                    break;
-
-                case DALI_CMD_PROGRAM_SHORT_ADDRESS:
-                    daliCmdProgramShortAddress();
-                    break;
-
-                case DALI_CMD_VERIFY_SHORT_ADDRESS:
-                    daliCmdVerifyShortAddress();
-                    break;
-
-                case DALI_CMD_QUERY_SHORT_ADDRESS:
-                    daliCmdQueryShortAddress();
-                    break;
-
-                case DALI_CMD_PHYSICAL_SELECTION:
-                    daliCmdPhysicalSelection();
-                    break;
-
-                case DALI_CMD_ENABLE_DEVICE_TYPE_X:
-                    daliCmdEnableDeviceTypeX();
-                    break;
+        case DALI_CMD_TYPE_COMMAND:
+            if ((daliCmd.flags & DALI_CMD_FLAG_SPECIAL_MODE) && (dali->specialModeTimeout == 0)) {
+                break;
             }
-            dali.status.resetState = 0;
-            break;
-
-        case DALI_CMD_TYPE_INDIRECT_ARC_POWER:
-            cmdNumber = dali.commandByte & 0x1f;
-            switch (cmdNumber) {
-                case DALI_CMD_IMMEDIATE_OFF:
-                    daliCmdImmediateOff();
-                    break;
-
-                case DALI_CMD_UP_200MS:
-                    daliCmdUp200ms();
-                    break;
-
-                case DALI_CMD_DOWN_200MS:
-                    daliCmdDown200ms();
-                    break;
-
-                case DALI_CMD_STEP_UP:
-                    daliCmdStepUp();
-                    break;
-
-                case DALI_CMD_STEP_DOWN:
-                    daliCmdStepDownAndOff();
-                    break;
-
-                case DALI_CMD_RECALL_MAX_LEVEL:
-                    daliCmdRecallMaxLevel();
-                    break;
-
-                case DALI_CMD_RECALL_MIN_LEVEL:
-                    daliCmdRecallMinLevel();
-                    break;
-
-                case DALI_CMD_STEP_DOWN_AND_OFF:
-                    daliCmdStepDownAndOff();
-                    break;
-
-                case DALI_CMD_ON_AND_STEP_UP:
-                    daliCmdOnAndStepUp();
-                    break;
-
-                default:
-                    // TODO: use pattern?
-                    if ((cmdNumber >= DALI_CMD_GO_TO_SCENE) && (cmdNumber <= DALI_CMD_GO_TO_SCENE + 15)) {
-                        daliCmdGoToScene();
-                    }
-                    break;
+            if (daliCmd.flags & DALI_CMD_FLAG_ARC_POWER) {
+                daliStopFade();     // Arc power commands stop a running fade
+                dali->status.powerFailure = 0;
             }
-            dali.status.resetState = 0;
-            dali.status.powerFailure = 0;
-            break;
-
-        case DALI_CMD_TYPE_CONFIG_CMD:
-            dali.status.resetState = 0;
-            switch (dali.commandByte) {
-                case DALI_CMD_RESET:
-                    daliCmdReset();
-                    break;
-
-                case DALI_CMD_STORE_ACTUAL_LEVEL_IN_DTR:
-                    daliCmdStoreActualLevelInDTR();
-                    break;
-
-                case DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL:
-                    daliCmdStoreTheDTRAsMaxLevel();
-                    break;
-
-                case DALI_CMD_STORE_THE_DTR_AS_MIN_LEVEL:
-                    daliCmdStoreTheDTRAsMinLevel();
-                    break;
-
-                case DALI_CMD_STORE_THE_DTR_AS_SYSTEM_FAILURE_LEVEL:
-                    daliCmdStoreTheDTRAsSystemFailureLevel();
-                    break;
-
-                case DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL:
-                    daliCmdStoreTheDTRAsPowerOnLevel();
-                    break;
-
-                case DALI_CMD_STORE_THE_DTR_AS_FADE_TIME:
-                    daliCmdStoreTheDTRAsFadeTime();
-                    break;
-
-                case DALI_CMD_STORE_THE_DTR_AS_FADE_RATE:
-                    daliCmdStoreTheDTRAsFadeRate();
-                    break;
-
-                case DALI_CMD_STORE_DTR_AS_SHORT_ADDRESS:
-                    daliCmdStoreTheDTRAsShortAddress();
-                    break;
-
-                default:
-                    switch (dali.commandByte & 0xf0) {
-                        case DALI_CMD_STORE_THE_DTR_AS_SCENE:
-                            daliCmdStoreTheDTRAsScene();
-                            break;
-
-                        case DALI_CMD_REMOVE_FROM_SCENE:
-                            daliCmdRemoveFromScene();
-                            break;
-
-                        case DALI_CMD_ADD_TO_GROUP:
-                            daliCmdAddToGroup();
-                            break;
-
-                        case DALI_CMD_REMOVE_FROM_GROUP:
-                            daliCmdRemoveFromGroup();
-                            break;
-                    }
-                    break;
+            if ((daliCmd.flags & DALI_CMD_FLAG_ANSWER) == 0) {
+                dali->status.resetState = 0;    // Queries do not change the reset state
             }
-            break;
-
-        case DALI_CMD_TYPE_QUERY_CMD:
-            switch (dali.commandByte) {
-                case DALI_CMD_QUERY_STATUS:
-                    daliCmdQueryStatus();
-                    break;
-
-                case DALI_CMD_QUERY_BALLAST:
-                    daliCmdQueryBallast();
-                    break;
-
-                case DALI_CMD_QUERY_LAMP_FAILURE:
-                    daliCmdQueryLampFailure();
-                    break;
-
-                case DALI_CMD_QUERY_LAMP_POWER_ON:
-                    daliCmdQueryLampPowerOn();
-                    break;
-
-                case DALI_CMD_QUERY_LIMIT_ERROR:
-                    daliCmdqueryLimitError();
-                    break;
-
-                case DALI_CMD_QUERY_RESET_STATE:
-                    daliCmdQueryResetState();
-                    break;
-
-                case DALI_CMD_QUERY_MISSING_SHORT_ADDRESS:
-                    daliCmdQueryMissingShortAddress();
-                    break;
-
-                case DALI_CMD_QUERY_VERSION_NUMBER:
-                    daliCmdQueryVersionNumber();
-                    break;
-
-                case DALI_CMD_QUERY_CONTENT_DTR:
-                    daliCmdQueryContentDTR();
-                    break;
-
-                case DALI_CMD_QUERY_DEVICE_TYPE:
-                    daliCmdQueryDeviceType();
-                    break;
-
-                case DALI_CMD_QUERY_PHYSICAL_MINIMUM_LEVEL:
-                    daliCmdQueryPhysicalMinimumLevel();
-                    break;
-
-                case DALI_CMD_QUERY_POWER_FAILURE:
-                    daliCmdQueryPowerFailure();
-                    break;
-
-                case DALI_CMD_QUERY_ACTUAL_LEVEL:
-                    daliCmdQueryActualLevel();
-                    break;
-
-                case DALI_CMD_QUERY_MAX_LEVEL:
-                    daliCmdQueryMaxLevel();
-                    break;
-
-                case DALI_CMD_QUERY_MIN_LEVEL:
-                    daliCmdQueryMinLevel();
-                    break;
-
-                case DALI_CMD_QUERY_POWER_ON_LEVEL:
-                    daliCmdQueryPowerOnLevel();
-                    break;
-
-                case DALI_CMD_QUERY_SYSTEM_FAILURE_LEVEL:
-                    daliCmdQuerySystemFailureLevel();
-                    break;
-
-                case DALI_CMD_QUERY_FADE_SETTINGS:
-                    daliCmdQueryFadeSettings();
-                    break;
-
-                case DALI_CMD_QUERY_GROUPS_0_7:
-                    daliCmdQueryGroups0_7();
-                    break;
-
-                case DALI_CMD_QUERY_GROUPS_8_15:
-                    daliCmdQueryGroups8_15();
-                    break;
-
-                case DALI_CMD_QUERY_RANDOM_ADDRESS_H:
-                    daliCmdQueryRandomAddressH();
-                    break;
-
-                case DALI_CMD_QUERY_RANDOM_ADDRESS_M:
-                    daliCmdQueryRandomAddressM();
-                    break;
-
-                case DALI_CMD_QUERY_RANDOM_ADDRESS_L:
-                    daliCmdQueryRandomAddressL();
-                    break;
-
-                default:
-                    // TODO: use pattern?
-                    if ((dali.commandByte >= DALI_CMD_QUERY_SCENE_LEVEL) && (dali.commandByte < DALI_CMD_QUERY_GROUPS_0_7)) {
-                        daliCmdQuerySceneLevel();
-                    }
-                    break;
+            if ((daliCmd.flags & DALI_CMD_FLAG_MEMORY) == 0) {
+                dali->memoryWriteEnabled = 0;   // ENABLE WRITE MEMORY sets it again
+            }
+            daliCmd.handler();
+#ifdef DALI_DT8
+            if ((daliCmd.flags & DALI_CMD_FLAG_ARC_POWER) &&
+                (dali->gearFeatures & DALI_GEAR_FEATURE_AUTO_ACTIVATION)) {
+                daliColourActivate(0);      // If not done by a fade (see daliFade())
             }
+#endif
             break;
 
         case DALI_CMD_TYPE_NONE:
             break;
     }
 }
+
+
+// The command has been checked by daliAnalyse() (see the descriptor flags)
+// Each instance addressed executes it in turn. Several answers: the first one is
+// sent (a collision on the bus, COMPARE is answered YES either way).
+void daliExecute(void)
+{
+    uint8_t gears = daliCmd.gears;
+    uint8_t n;
+
+    for (n = 0; gears != 0; n++, gears >>= 1) {
+        if (gears & 1) {
+            dali = &daliGears[n];
+            daliExecuteGear();
+        }
+    }
+}
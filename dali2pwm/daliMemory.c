@@ -0,0 +1,172 @@
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "daliMemory.h"
+
+extern volatile uint16_t rxFrameCount;
+extern volatile uint16_t rxErrorCount;
+extern volatile uint16_t rxDropCount;
+extern volatile uint16_t rxOverflowCount;
+extern uint16_t sendTwiceTimeoutCount;
+extern volatile uint16_t eepromRecordCount;
+extern uint16_t rxLatencyMax;
+extern volatile uint16_t busFailureCount;
+extern volatile uint16_t busRecoveryCount;
+extern uint16_t bootTime;
+extern volatile uint16_t powerFailCount;
+extern uint16_t temperatureState;
+extern int16_t temperature;
+
+// Bank 0
+static const uint8_t DALI_MEMORY_BANK_0_DATA[] PROGMEM = {
+    0x02,                       // Last accessible location
+    0xff,                       // Reserved
+    DALI_MEMORY_BANK_LAST
+};
+
+// Bank 2, indexed by DALI_MEMORY_DIAG_xxx (the counters first)
+static volatile uint16_t * const DIAG_VALUES[DALI_MEMORY_DIAG_VALUES] PROGMEM = {
+    [DALI_MEMORY_DIAG_FRAMES]           = &rxFrameCount,
+    [DALI_MEMORY_DIAG_FRAME_ERRORS]     = &rxErrorCount,
+    [DALI_MEMORY_DIAG_DROPPED]          = &rxDropCount,
+    [DALI_MEMORY_DIAG_OVERFLOWS]        = &rxOverflowCount,
+    [DALI_MEMORY_DIAG_SEND_TWICE]       = (volatile uint16_t *)&sendTwiceTimeoutCount,
+    [DALI_MEMORY_DIAG_EEPROM]           = &eepromRecordCount,
+    [DALI_MEMORY_DIAG_LATENCY]          = (volatile uint16_t *)&rxLatencyMax,
+    [DALI_MEMORY_DIAG_BUS_FAILURES]     = &busFailureCount,
+    [DALI_MEMORY_DIAG_BUS_RECOVERIES]   = &busRecoveryCount,
+    [DALI_MEMORY_DIAG_POWER_FAILURES]   = &powerFailCount,
+    [DALI_MEMORY_DIAG_BOOT_TIME]        = (volatile uint16_t *)&bootTime,
+    [DALI_MEMORY_DIAG_THERMAL]          = (volatile uint16_t *)&temperatureState,
+    [DALI_MEMORY_DIAG_TEMPERATURE]      = (volatile uint16_t *)&temperature,
+};
+
+static uint16_t diagLatch = 0;          // Counter whose MSB was read last
+
+
+// Byte of a 16-bit counter: MSB if 'offset' is even (latches the counter), else LSB
+static uint8_t daliMemoryReadCounter(volatile uint16_t *counter, uint8_t offset)
+{
+    if ((offset & 1) == 0) {
+
+        // MSB: latch the counter (incremented by the interrupts)
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            diagLatch = *counter;
+        }
+        return diagLatch >> 8;
+    }
+    return diagLatch & 0xff;
+}
+
+
+// Diagnostics bank
+static int16_t daliMemoryReadDiag(uint8_t location)
+{
+    uint8_t offset;
+
+    switch (location) {
+        case 0x00:
+            return DALI_MEMORY_DIAG_LAST;
+        case 0x01:
+            return 0xff;
+        case DALI_MEMORY_DIAG_CONTROL:
+            return 0x00;
+    }
+    if (location > DALI_MEMORY_DIAG_LAST) {
+        return DALI_MEMORY_NONE;
+    }
+
+    offset = location - DALI_MEMORY_DIAG_COUNTERS;
+    return daliMemoryReadCounter((volatile uint16_t *)pgm_read_ptr(&DIAG_VALUES[offset >> 1]), offset);
+}
+
+
+#ifdef DALI_SOFT_MANCHESTER
+
+// Half bit histogram bank
+static int16_t daliMemoryReadHistogram(uint8_t location)
+{
+    uint8_t offset;
+
+    switch (location) {
+        case 0x00:
+            return DALI_MEMORY_HISTOGRAM_LAST;
+        case 0x01:
+            return 0xff;
+        case DALI_MEMORY_DIAG_CONTROL:
+            return 0x00;
+    }
+    if (location > DALI_MEMORY_HISTOGRAM_LAST) {
+        return DALI_MEMORY_NONE;
+    }
+
+    offset = location - DALI_MEMORY_DIAG_COUNTERS;
+    return daliMemoryReadCounter(&manchesterHistogram[offset >> 1], offset);
+}
+
+#endif
+
+
+// Content of a memory location, DALI_MEMORY_NONE if not implemented
+int16_t daliMemoryRead(uint8_t bank, uint8_t location)
+{
+    switch (bank) {
+        case DALI_MEMORY_BANK_0:
+            if (location >= sizeof(DALI_MEMORY_BANK_0_DATA)) {
+                return DALI_MEMORY_NONE;
+            }
+            return pgm_read_byte(&DALI_MEMORY_BANK_0_DATA[location]);
+
+        case DALI_MEMORY_BANK_DIAG:
+            return daliMemoryReadDiag(location);
+
+#ifdef DALI_SOFT_MANCHESTER
+        case DALI_MEMORY_BANK_HISTOGRAM:
+            return daliMemoryReadHistogram(location);
+#endif
+
+        default:
+            return DALI_MEMORY_NONE;
+    }
+}
+
+
+// Write a memory location (write enabled by ENABLE WRITE MEMORY)
+// Returns 0 if the location is not writable
+uint8_t daliMemoryWrite(uint8_t bank, uint8_t location, uint8_t value)
+{
+    uint8_t n;
+    volatile uint16_t *counter;
+
+    if ((location != DALI_MEMORY_DIAG_CONTROL) || (value != DALI_MEMORY_DIAG_RESET)) {
+        return 0;
+    }
+
+    switch (bank) {
+        case DALI_MEMORY_BANK_DIAG:
+            // The measurements (from DALI_MEMORY_DIAG_COUNT) are kept: the boot time
+            // is measured once per power up
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                for (n = 0; n < DALI_MEMORY_DIAG_COUNT; n++) {
+                    counter = (volatile uint16_t *)pgm_read_ptr(&DIAG_VALUES[n]);
+                    *counter = 0;
+                }
+            }
+            break;
+
+#ifdef DALI_SOFT_MANCHESTER
+        case DALI_MEMORY_BANK_HISTOGRAM:
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                for (n = 0; n < MANCHESTER_HISTOGRAM_SIZE; n++) {
+                    manchesterHistogram[n] = 0;
+                }
+            }
+            break;
+#endif
+
+        default:
+            return 0;
+    }
+    diagLatch = 0;
+    return 1;
+}
@@ -0,0 +1,79 @@
+#ifndef _DALI_MEMORY_H_
+#define _DALI_MEMORY_H_
+
+#include <inttypes.h>
+
+#include "manchester.h"
+
+// Memory banks, addressed by DTR1 (bank) and DTR (location)
+// READ MEMORY LOCATION answers the location and increments DTR, nothing if the
+// location is not implemented. WRITE MEMORY LOCATION needs ENABLE WRITE MEMORY.
+//
+// Bank 0 (IEC 62386-102, mandatory part only):
+//     [0x00] last accessible location
+//     [0x01] reserved
+//     [0x02] last accessible memory bank
+// Bank 1 (OEM) is not implemented.
+//
+// Bank 2, diagnostics (manufacturer specific), kept in RAM since power up:
+//     [0x00] last accessible location
+//     [0x01] reserved
+//     [0x02] reset: writing DALI_MEMORY_DIAG_RESET clears the counters (reads 0)
+//     [0x03] 16-bit counters, MSB first (see DALI_MEMORY_DIAG_xxx)
+//     then 16-bit measurements, same layout, not cleared by the reset
+// Reading the MSB of a counter latches its LSB: the two bytes are consistent
+// although they are read by two frames. Counters wrap at 0xffff.
+// Reading copies the counter with the interrupts disabled for a few cycles only:
+// the PWM and the fade are not delayed.
+//
+// Bank 3, half bit histogram (DALI_SOFT_MANCHESTER only, see manchester.h), same layout:
+//     [0x00] last accessible location
+//     [0x01] reserved
+//     [0x02] reset: writing DALI_MEMORY_DIAG_RESET clears the bins (reads 0)
+//     [0x03] 16-bit bins, MSB first, from MANCHESTER_HISTOGRAM_FIRST Timer1 ticks
+// Bins saturate at 0xffff.
+
+#define DALI_MEMORY_BANK_0              0
+#define DALI_MEMORY_BANK_DIAG           2
+#define DALI_MEMORY_BANK_HISTOGRAM      3
+#ifdef DALI_SOFT_MANCHESTER
+    #define DALI_MEMORY_BANK_LAST       DALI_MEMORY_BANK_HISTOGRAM
+#else
+    #define DALI_MEMORY_BANK_LAST       DALI_MEMORY_BANK_DIAG
+#endif
+
+#define DALI_MEMORY_NONE                -1      // Location not implemented (no answer)
+
+// Diagnostics bank
+#define DALI_MEMORY_DIAG_RESET          0x00    // Value written at location DALI_MEMORY_DIAG_CONTROL
+#define DALI_MEMORY_DIAG_CONTROL        0x02
+#define DALI_MEMORY_DIAG_COUNTERS       0x03    // Location of the first counter
+
+// Counters (index, location = DALI_MEMORY_DIAG_COUNTERS + 2 * index)
+#define DALI_MEMORY_DIAG_FRAMES         0       // Forward frames received (all addresses)
+#define DALI_MEMORY_DIAG_FRAME_ERRORS   1       // Frames with an error (RX re-armed in USART_RX_vect, or Manchester decoder)
+#define DALI_MEMORY_DIAG_DROPPED        2       // Frames ignored (BW frame pending, bus failure)
+#define DALI_MEMORY_DIAG_OVERFLOWS      3       // Frames lost, queue full
+#define DALI_MEMORY_DIAG_SEND_TWICE     4       // Send twice commands not repeated in time
+#define DALI_MEMORY_DIAG_EEPROM         5       // Eeprom records written (see eepromCache.h)
+#define DALI_MEMORY_DIAG_LATENCY        6       // Worst case from frame reception to processing, in 4us
+#define DALI_MEMORY_DIAG_BUS_FAILURES   7
+#define DALI_MEMORY_DIAG_BUS_RECOVERIES 8
+#define DALI_MEMORY_DIAG_POWER_FAILURES 9       // Supply failures detected (see powerFail.h)
+#define DALI_MEMORY_DIAG_COUNT          10      // Counters, cleared by the reset
+
+// Measurements (index after the counters)
+#define DALI_MEMORY_DIAG_BOOT_TIME      10      // Clock setup to the first output update, in us (see BOOT_TIME_TARGET_US)
+#define DALI_MEMORY_DIAG_THERMAL        11      // Thermal state, TEMPERATURE_xxx (see temperature.h)
+#define DALI_MEMORY_DIAG_TEMPERATURE    12      // Led temperature, signed, 1/16 degree C (every TEMPERATURE_UPDATE_PERIOD)
+#define DALI_MEMORY_DIAG_VALUES         13      // Counters and measurements
+
+#define DALI_MEMORY_DIAG_LAST           (DALI_MEMORY_DIAG_COUNTERS + 2 * DALI_MEMORY_DIAG_VALUES - 1)
+
+// Histogram bank (DALI_MEMORY_DIAG_CONTROL and DALI_MEMORY_DIAG_COUNTERS locations)
+#define DALI_MEMORY_HISTOGRAM_LAST      (DALI_MEMORY_DIAG_COUNTERS + 2 * MANCHESTER_HISTOGRAM_SIZE - 1)
+
+int16_t daliMemoryRead(uint8_t bank, uint8_t location);
+uint8_t daliMemoryWrite(uint8_t bank, uint8_t location, uint8_t value);
+
+#endif
@@ -0,0 +1,44 @@
+#include <avr/pgmspace.h>
+
+#include "dali.h"
+#include "dimmingCurve.h"
+
+static const uint16_t *activeCurves[DALI_GEAR_COUNT];   // Point to the selected tables (in flash)
+
+
+// Select the active dimming curve of an output channel
+// Falls back to the logarithmic curve if the curve does not exist
+// Returns the curve actually selected
+uint8_t dimmingCurveSelect(uint8_t channel, uint8_t curve)
+{
+    if (curve >= DIMMING_CURVE_COUNT) {
+        curve = DIMMING_CURVE_LOGARITHMIC;
+    }
+    activeCurves[channel] = pgm_read_ptr(&DIMMING_CURVES[curve]);
+    return curve;
+}
+
+
+// Convert an arc power level to a PWM value, with the curve of an output channel
+// level is in 8.8 fixed point (MSB : arc power level [0-254], LSB : fraction)
+// Output is linearly interpolated between two points of the curve
+uint16_t dimmingCurveLookup(uint8_t channel, uint16_t level)
+{
+    const uint16_t *activeCurve = activeCurves[channel];
+    uint8_t index = level >> 8;
+    uint8_t fraction = level & 0xff;
+    uint16_t low;
+    uint16_t high;
+
+    if (index >= 254) {
+        return pgm_read_word(&activeCurve[254]);
+    }
+
+    low = pgm_read_word(&activeCurve[index]);
+    if (fraction == 0) {
+        return low;
+    }
+    high = pgm_read_word(&activeCurve[index + 1]);
+
+    return low + (uint16_t)(((uint32_t)(high - low) * fraction) >> 8);
+}
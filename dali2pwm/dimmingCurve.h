@@ -0,0 +1,19 @@
+#ifndef _DIMMING_CURVE_H_
+#define _DIMMING_CURVE_H_
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+
+// Dimming curves, tables are generated at build time by genDimmingCurve.py
+#define DIMMING_CURVE_LOGARITHMIC   0       // DALI standard curve (default)
+#define DIMMING_CURVE_LINEAR        1
+#define DIMMING_CURVE_GAMMA         2       // First gamma variant (see DIMMING_GAMMAS in Makefile)
+
+// Tables stored in flash: convert [0-254] to [0-65535]
+extern const uint16_t * const DIMMING_CURVES[] PROGMEM;
+extern const uint8_t DIMMING_CURVE_COUNT;
+
+uint8_t dimmingCurveSelect(uint8_t channel, uint8_t curve);
+uint16_t dimmingCurveLookup(uint8_t channel, uint16_t level);
+
+#endif
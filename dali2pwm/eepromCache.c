@@ -0,0 +1,237 @@
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include "eepromCache.h"
+
+#define EEPROM_INT_ENABLE()     (EECR |= (1 << EERIE))
+#define EEPROM_INT_DISABLE()    (EECR &= ~(1 << EERIE))
+
+#define EEPROM_LEGACY_MARKER    0xAA    // Byte 0 of the fixed layout used before the journal
+
+static uint8_t eepromShadow[EEPROM_CACHE_SIZE];
+static uint8_t eepromRecord[EEPROM_RECORD_SIZE];        // Record being written (snapshot of the shadow)
+static uint8_t eepromIndex = EEPROM_RECORD_SIZE;        // Bytes of eepromRecord written, EEPROM_RECORD_SIZE if none
+static uint8_t eepromSlot = 0;                          // Slot of the newest record
+static uint8_t eepromSequence = 0;                      // Sequence number of the newest record
+static volatile uint8_t eepromChanged = 0;              // Shadow changed since the last record was started
+static uint8_t eepromHeld = 0;                          // Records wait for eepromCacheRelease() (boot)
+volatile uint16_t eepromRecordCount = 0;                // Records written since power up (see daliMemory.h)
+
+
+static uint8_t eepromCrc(const uint8_t *data, uint8_t length)
+{
+    uint8_t crc = 0;
+
+    while (length--) {
+        crc = _crc_ibutton_update(crc, *data++);
+    }
+    return crc;
+}
+
+
+static uint16_t eepromSlotAddress(uint8_t slot)
+{
+    return (uint16_t)slot * EEPROM_RECORD_SIZE;
+}
+
+
+// Prepare a new record from the shadow, in the next slot
+static void eepromStartRecord(void)
+{
+    uint8_t n;
+
+    eepromChanged = 0;
+    eepromRecordCount++;
+    eepromSequence++;
+    eepromSlot++;
+    if (eepromSlot >= EEPROM_SLOT_COUNT) {
+        eepromSlot = 0;
+    }
+
+    eepromRecord[EEPROM_OFFSET_SEQUENCE] = eepromSequence;
+    eepromRecord[EEPROM_OFFSET_VERSION] = EEPROM_RECORD_VERSION;
+    for (n = 0; n < EEPROM_CACHE_SIZE; n++) {
+        eepromRecord[EEPROM_OFFSET_DATA + n] = eepromShadow[n];
+    }
+    eepromRecord[EEPROM_OFFSET_CRC] = eepromCrc(eepromRecord, EEPROM_OFFSET_CRC);
+    eepromIndex = 0;
+}
+
+
+// Write the next byte of the record (or start a new record if the shadow changed)
+// Eeprom must be ready. Returns 0 when there is nothing left to write.
+static uint8_t eepromCommitNext(void)
+{
+    uint8_t offset;
+
+    if (eepromIndex >= EEPROM_RECORD_SIZE) {
+        if (eepromChanged == 0) {
+            return 0;
+        }
+        eepromStartRecord();
+    }
+
+    // The sequence number is written last: until then, the slot is an old
+    // record (with a wrong CRC), and the previous record remains the newest.
+    offset = eepromIndex + 1;
+    if (offset == EEPROM_RECORD_SIZE) {
+        offset = EEPROM_OFFSET_SEQUENCE;
+    }
+
+    // Eeprom is ready, eeprom_update_byte() starts the write and returns.
+    // Unchanged bytes are not written (eeprom endurance)
+    eeprom_update_byte((uint8_t*)(eepromSlotAddress(eepromSlot) + offset), eepromRecord[offset]);
+    eepromIndex++;
+    return 1;
+}
+
+
+// Eeprom is ready: write the next byte
+ISR(EE_READY_vect)
+{
+    if (eepromCommitNext() == 0) {
+        EEPROM_INT_DISABLE();   // Journal is up to date
+    }
+}
+
+
+// Load the newest valid record in the shadow
+// Only the sequence numbers and the newest record are read; older records are
+// read only if the newest one is corrupted.
+// Changes are not written before eepromCacheRelease(): the default registers of a new
+// device, or the imported layout, do not delay the first light.
+void eepromCacheInit(void)
+{
+    uint8_t sequence[EEPROM_SLOT_COUNT];
+    uint16_t rejected = 0;                      // 1 bit per slot
+    uint8_t valid = 0;
+    uint8_t newest;
+    uint8_t n;
+
+    EEPROM_INT_DISABLE();
+    eepromIndex = EEPROM_RECORD_SIZE;
+    eepromChanged = 0;
+    eepromHeld = 1;
+    eeprom_busy_wait();
+
+    for (n = 0; n < EEPROM_SLOT_COUNT; n++) {
+        sequence[n] = eeprom_read_byte((const uint8_t*)eepromSlotAddress(n));
+    }
+
+    // Try records from the newest to the oldest
+    while (valid == 0) {
+        newest = EEPROM_SLOT_COUNT;
+        for (n = 0; n < EEPROM_SLOT_COUNT; n++) {
+            if (rejected & (1 << n)) {
+                continue;
+            }
+            if ((newest == EEPROM_SLOT_COUNT) || ((int8_t)(sequence[n] - eepromSequence) > 0)) {
+                newest = n;
+                eepromSequence = sequence[n];
+            }
+        }
+        if (newest == EEPROM_SLOT_COUNT) {
+            break;          // No valid record
+        }
+
+        eeprom_read_block(eepromRecord, (const void*)eepromSlotAddress(newest), EEPROM_RECORD_SIZE);
+        if ((eepromRecord[EEPROM_OFFSET_VERSION] == EEPROM_RECORD_VERSION) &&
+            (eepromCrc(eepromRecord, EEPROM_OFFSET_CRC) == eepromRecord[EEPROM_OFFSET_CRC])) {
+            valid = 1;
+            eepromSlot = newest;
+        }
+        else {
+            rejected |= 1 << newest;
+        }
+    }
+
+    if (valid == 1) {
+        for (n = 0; n < EEPROM_CACHE_SIZE; n++) {
+            eepromShadow[n] = eepromRecord[EEPROM_OFFSET_DATA + n];
+        }
+    }
+    else {
+
+        // No record: import the fixed layout written by previous firmwares,
+        // or leave the shadow erased (0xff) so that default values are stored.
+        eepromSlot = 0;                         // First record goes to slot 1 (slot 0 holds the old layout)
+        eepromSequence = 0;
+        eeprom_read_block(eepromShadow, (const void*)0, EEPROM_CACHE_SIZE);
+        if (eepromShadow[0] != EEPROM_LEGACY_MARKER) {
+            for (n = 0; n < EEPROM_CACHE_SIZE; n++) {
+                eepromShadow[n] = 0xff;
+            }
+        }
+        else {
+            eepromChanged = 1;                  // Convert to a record
+        }
+    }
+}
+
+
+uint8_t eepromCacheRead(uint8_t address)
+{
+    return eepromShadow[address];
+}
+
+
+// Write a byte in the shadow, a new record will be written in background
+void eepromCacheWrite(uint8_t address, uint8_t value)
+{
+    if (eepromShadow[address] != value) {
+        eepromShadow[address] = value;
+        eepromChanged = 1;
+        if (eepromHeld == 0) {
+            EEPROM_INT_ENABLE();
+        }
+    }
+}
+
+
+// Write the changes held since eepromCacheInit(), and the next ones, in background
+void eepromCacheRelease(void)
+{
+    eepromHeld = 0;
+    if (eepromChanged != 0) {
+        EEPROM_INT_ENABLE();
+    }
+}
+
+
+uint8_t eepromCacheIsDirty(void)
+{
+    return (eepromChanged != 0) || (eepromIndex < EEPROM_RECORD_SIZE);
+}
+
+
+// Load the levels saved at the last power failure (EEPROM_POWER_FAIL_LEVELS bytes)
+// Returns 0 if there are none, or if their write was cut
+uint8_t eepromCachePowerFailRead(uint8_t *levels)
+{
+    eeprom_busy_wait();
+    eeprom_read_block(levels, (const void*)EEPROM_POWER_FAIL_ADDRESS, EEPROM_POWER_FAIL_LEVELS);
+    return eeprom_read_byte((const uint8_t*)(EEPROM_POWER_FAIL_ADDRESS + EEPROM_POWER_FAIL_LEVELS)) ==
+           eepromCrc(levels, EEPROM_POWER_FAIL_LEVELS);
+}
+
+
+// Save the levels now (blocking), the supply is failing
+// Only the changed bytes are written (~3.4ms each). The record being written is
+// suspended after its current byte and resumed afterwards, if there is still time.
+void eepromCachePowerFailWrite(const uint8_t *levels)
+{
+    uint8_t resume = EECR & (1 << EERIE);
+    uint8_t n;
+
+    EEPROM_INT_DISABLE();
+    for (n = 0; n < EEPROM_POWER_FAIL_LEVELS; n++) {
+        eeprom_busy_wait();
+        eeprom_update_byte((uint8_t*)(EEPROM_POWER_FAIL_ADDRESS + n), levels[n]);
+    }
+    eeprom_busy_wait();
+    eeprom_update_byte((uint8_t*)(EEPROM_POWER_FAIL_ADDRESS + n), eepromCrc(levels, EEPROM_POWER_FAIL_LEVELS));
+    if (resume) {
+        EEPROM_INT_ENABLE();
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef _EEPROM_CACHE_H_
+#define _EEPROM_CACHE_H_
+
+#include <inttypes.h>
+#include <avr/io.h>
+
+#include "dali.h"
+
+// RAM shadow of the DALI registers stored in eeprom (see ADD_xxx in dali.h)
+//
+// The eeprom holds a journal of records, written in turn in EEPROM_SLOT_COUNT slots:
+//     [0] sequence number, incremented for each record
+//     [1] EEPROM_RECORD_VERSION
+//     [2 - EEPROM_CACHE_SIZE+1] DALI registers
+//     [EEPROM_CACHE_SIZE+2] CRC8 (1-Wire polynomial) of the previous bytes
+// At boot, the newest valid record is loaded. A record cut by a power failure fails
+// its CRC, the previous one is used instead: the changes of the last ~120ms
+// (EEPROM_RECORD_SIZE writes) before a power failure may be lost. They are not
+// flushed when the supply fails, that would need ~120ms of hold-up time instead of
+// POWER_FAIL_HOLD_UP_US (see powerFail.h).
+// When the shadow changes, a new record is written in the next slot, one byte per
+// EEPROM ready interrupt, the sequence number last. After power up, the changes wait
+// for eepromCacheRelease() (BOOT_BACKGROUND_DELAY, see dali.h). Each cell is written once every
+// EEPROM_SLOT_COUNT records.
+// The registers of the gear instances are stored one block after the other: the
+// version tells the layout and the number of blocks.
+//
+// The last bytes of the eeprom, after the slots, hold the levels saved when the supply
+// fails (see powerFail.h), written at once instead of journaled:
+//     [2n] output level of instance n, [2n+1] its fade target (the level if not fading)
+//     [EEPROM_POWER_FAIL_LEVELS] CRC8 of the levels, written last
+#define EEPROM_CACHE_SIZE       (DALI_EEPROM_SIZE * DALI_GEAR_COUNT)
+#define EEPROM_RECORD_VERSION   (DALI_EEPROM_VERSION | ((DALI_GEAR_COUNT - 1) << 4))
+#define EEPROM_RECORD_SIZE      (EEPROM_CACHE_SIZE + 3)
+#define EEPROM_POWER_FAIL_LEVELS    (2 * DALI_GEAR_COUNT)
+#define EEPROM_POWER_FAIL_SIZE      (EEPROM_POWER_FAIL_LEVELS + 1)
+#define EEPROM_POWER_FAIL_ADDRESS   (E2END + 1 - EEPROM_POWER_FAIL_SIZE)
+#define EEPROM_SLOT_COUNT       (EEPROM_POWER_FAIL_ADDRESS / EEPROM_RECORD_SIZE)   // 14 slots on AT90PWM216 (9 with DALI_DT8, 5 with 3 gear)
+
+#define EEPROM_WRITE_US         3400    // Erase and write of a byte (datasheet: 3.3ms)
+
+#define EEPROM_OFFSET_SEQUENCE  0
+#define EEPROM_OFFSET_VERSION   1
+#define EEPROM_OFFSET_DATA      2
+#define EEPROM_OFFSET_CRC       (EEPROM_RECORD_SIZE - 1)
+
+void eepromCacheInit(void);
+uint8_t eepromCacheRead(uint8_t address);
+void eepromCacheWrite(uint8_t address, uint8_t value);
+void eepromCacheRelease(void);
+uint8_t eepromCacheIsDirty(void);
+uint8_t eepromCachePowerFailRead(uint8_t *levels);
+void eepromCachePowerFailWrite(const uint8_t *levels);
+
+#endif
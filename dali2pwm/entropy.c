@@ -0,0 +1,68 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "main.h"
+#include "entropy.h"
+
+volatile uint32_t entropyPool = 0;
+static uint32_t entropyState = 0;       // xorshift32 state (never 0)
+
+
+// Watchdog interrupt, every 16ms from the watchdog oscillator
+// Timer0 (4us) and Timer1 (16us, or the PWM counter with PWM_USE_TIMER1) are
+// clocked by the crystal: their value at this time is the drift of the two
+// oscillators.
+ISR(WDT_vect)
+{
+    ENTROPY_ADD(TCNT0);
+    ENTROPY_ADD(TCNT1L);
+}
+
+
+// Watchdog in interrupt mode only (no reset, WDTON fuse unprogrammed)
+// Interrupts must be disabled
+void entropyInit(void)
+{
+    MCUSR &= ~(1 << WDRF);
+    WDTCSR = (1 << WDCE) | (1 << WDE);      // Timed sequence
+    WDTCSR = (1 << WDIE) | ENTROPY_WDT_PRESCALER;
+}
+
+
+// xorshift32 (Marsaglia), period 2^32 - 1
+static uint32_t entropyNext(void)
+{
+    uint32_t x = entropyState;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    entropyState = x;
+    return x;
+}
+
+
+// New random address, 0 to ENTROPY_RANDOM_MAX
+// The pool collected since the previous call is mixed in the generator state: a
+// pool without noise still gives a new address (the next one of the sequence).
+uint32_t entropyRandomAddress(void)
+{
+    uint32_t address;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        entropyState ^= entropyPool;
+    }
+    if (entropyState == 0) {
+        entropyState = 1;
+    }
+
+    // Several rounds: every bit of the pool reaches the 24 bits of the address
+    do {
+        entropyNext();
+        entropyNext();
+        address = entropyNext() & 0xffffffUL;
+    } while (address > ENTROPY_RANDOM_MAX);
+
+    return address;
+}
@@ -0,0 +1,36 @@
+#ifndef _ENTROPY_H_
+#define _ENTROPY_H_
+
+#include <inttypes.h>
+
+// Random address (RANDOMISE) from hardware noise
+// Gear powered up together run the same code on the same bus: the only
+// differences between them are analog. The pool collects the least significant
+// bits of:
+//   - the ADC samples (noise of the led current and string voltage, see current.c)
+//   - Timer0 and Timer1 read by the watchdog interrupt: the watchdog runs from its
+//     own RC oscillator (128kHz, +-10% from part to part, with jitter), its period
+//     drifts against the crystal
+//   - the arrival time of the DALI frames and edges (see dali.c)
+// entropyRandomAddress() mixes the pool in a xorshift generator.
+//
+// The collision rate of 64 gear powered up together is measured by
+// host/randomAddress.c.
+
+#define ENTROPY_WDT_PRESCALER   ((0 << WDP3) | (0 << WDP2) | (0 << WDP1) | (0 << WDP0))    // 16ms
+#define ENTROPY_RANDOM_MAX      0xfffffeUL      // 0xffffff is the "no random address" value
+
+// Mix a noisy value in the pool (interrupts only: the pool is not read atomically)
+// Rotate left 1 bit then xor: the noisy low bits of successive values spread over
+// the 32 bits of the pool.
+#define ENTROPY_ADD(value)      do { \
+                                    entropyPool = (entropyPool << 1) | (entropyPool >> 31); \
+                                    entropyPool ^= (uint8_t)(value); \
+                                } while (0)
+
+extern volatile uint32_t entropyPool;
+
+void entropyInit(void);
+uint32_t entropyRandomAddress(void);
+
+#endif
@@ -0,0 +1,300 @@
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "main.h"
+#include "dali.h"
+#include "fade.h"
+#include "dimmingCurve.h"
+
+// Fade of one output channel (one per DALI instance, see pwmSet())
+// Fading is a DDA: each PWM cycle adds step, plus one when the remainders
+// accumulated in error reach cycles. The target is reached exactly after cycles.
+typedef struct {
+    uint32_t position;                  // Output level, in 8.24 fixed point (MSB : arc power level [0-254])
+    uint32_t step;                      // Integer part of (distance / cycles)
+    uint32_t remainder;                 // Remainder of (distance / cycles)
+    uint32_t error;
+    uint32_t cycles;                    // Fade duration, in PWM cycles
+    uint32_t count;                     // PWM cycles left
+    uint8_t direction;                  // UP or DOWN
+    uint8_t endLevel;                   // Level set at the end of fading (0 when fading to off)
+    volatile uint8_t currentLevel;
+} Fade;
+
+static Fade fades[DALI_GEAR_COUNT];
+
+// Channels fading, bit n: fades[n] (cleared by the interrupt at the end of the fade)
+static volatile uint8_t fadeRunning = 0;
+
+#ifdef DALI_DT8
+// Colour mix (see colour.h), in 16.16 fixed point, same DDA as the level
+// Started with the same number of cycles, the colour and the level are stepped by the
+// same interrupts and reach their targets in the same PWM cycle.
+static uint32_t mixPosition = 0;
+static uint32_t mixStep;
+static uint32_t mixRemainder;
+static uint32_t mixError;
+static uint32_t mixCycles;
+static uint32_t mixCount;
+static uint8_t mixDirection;
+static uint16_t mixTarget;
+
+static volatile uint8_t mixRunning = 0;
+#endif
+
+// The PWM cycle interrupt runs while the level or the colour fades
+#ifdef DALI_DT8
+    #define FADE_IDLE()     ((fadeRunning == 0) && (mixRunning == 0))
+#else
+    #define FADE_IDLE()     (fadeRunning == 0)
+#endif
+
+
+// Next step of the level of a channel
+static inline void fadeLevelCycle(uint8_t channel)
+{
+    Fade *fade = &fades[channel];
+    uint32_t step = fade->step;
+
+    fade->error += fade->remainder;
+    if (fade->error >= fade->cycles) {
+        fade->error -= fade->cycles;
+        step++;
+    }
+
+    if (--fade->count == 0) {
+
+        // Requested level is reached
+        fade->position = (uint32_t)fade->endLevel << 24;
+        fade->currentLevel = fade->endLevel;
+        fadeRunning &= ~(1 << channel);
+    }
+    else {
+        if (fade->direction == UP) {
+            fade->position += step;
+        }
+        else {
+            fade->position -= step;
+        }
+        fade->currentLevel = fade->position >> 24;
+    }
+
+    pwmSet(channel, dimmingCurveLookup(channel, fade->position >> 16));
+}
+
+
+#ifdef DALI_DT8
+
+// Next step of the colour mix
+static inline void fadeMixCycle(void)
+{
+    uint32_t step = mixStep;
+
+    mixError += mixRemainder;
+    if (mixError >= mixCycles) {
+        mixError -= mixCycles;
+        step++;
+    }
+
+    if (--mixCount == 0) {
+        mixPosition = (uint32_t)mixTarget << 16;
+        mixRunning = 0;
+    }
+    else if (mixDirection == UP) {
+        mixPosition += step;
+    }
+    else {
+        mixPosition -= step;
+    }
+
+    pwmSetMix(mixPosition >> 16);
+}
+
+#endif
+
+
+// PWM end of cycle: next fade step of each fading channel
+// The new values are loaded by the PWM at the end of the next cycle
+ISR(PWM_CYCLE_vect)
+{
+    uint8_t n;
+
+#ifdef DALI_DT8
+    if (mixRunning) {
+        fadeMixCycle();
+    }
+#endif
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        if (fadeRunning & (1 << n)) {
+            fadeLevelCycle(n);
+        }
+    }
+
+    if (FADE_IDLE()) {
+        PWM_CYCLE_INT_DISABLE();
+    }
+}
+
+
+// Fade the output of 'channel' from its actual level to 'level' in 'cycles' PWM cycles
+// A running fade is restarted from its current position, the other channels go on.
+// Fading from off starts at minLevel, fading to off (level 0) ends at minLevel then switches off.
+void fadeStart(uint8_t channel, uint8_t level, uint8_t minLevel, uint32_t cycles)
+{
+    Fade *fade = &fades[channel];
+    uint32_t target;
+    uint32_t distance;
+
+    PWM_CYCLE_INT_DISABLE();
+    fadeRunning &= ~(1 << channel);
+
+    if (fade->position == 0) {
+        fade->position = (uint32_t)minLevel << 24;
+    }
+    fade->endLevel = level;
+    if (level == 0) {
+        level = minLevel;
+    }
+    target = (uint32_t)level << 24;
+
+    if (target > fade->position) {
+        distance = target - fade->position;
+        fade->direction = UP;
+    }
+    else {
+        distance = fade->position - target;
+        fade->direction = DOWN;
+    }
+
+    if ((distance == 0) || (cycles == 0)) {
+
+        // Nothing to fade, the output is set by fadeOutput()
+        fade->position = (uint32_t)fade->endLevel << 24;
+        fade->currentLevel = fade->endLevel;
+    }
+    else {
+        fade->step = distance / cycles;
+        fade->remainder = distance % cycles;
+        fade->error = 0;
+        fade->cycles = cycles;
+        fade->count = cycles;
+        fade->currentLevel = fade->position >> 24;
+        fadeRunning |= 1 << channel;
+    }
+
+    if (!FADE_IDLE()) {
+        PWM_CYCLE_INT_ENABLE();     // This channel, another one or the colour is fading
+    }
+}
+
+
+// Stop fading a channel at the current level (and colour)
+void fadeStop(uint8_t channel)
+{
+    PWM_CYCLE_INT_DISABLE();
+    fadeRunning &= ~(1 << channel);
+    fades[channel].position = (uint32_t)fades[channel].currentLevel << 24;
+#ifdef DALI_DT8
+    mixRunning = 0;
+#endif
+    if (!FADE_IDLE()) {
+        PWM_CYCLE_INT_ENABLE();
+    }
+}
+
+
+// Level (or colour) of a channel fading
+uint8_t fadeIsRunning(uint8_t channel)
+{
+#ifdef DALI_DT8
+    if (mixRunning) {
+        return 1;
+    }
+#endif
+    return (fadeRunning & (1 << channel)) != 0;
+}
+
+
+// Output level of a channel (during fading, integer part of the current position)
+uint8_t fadeLevel(uint8_t channel)
+{
+    return fades[channel].currentLevel;
+}
+
+
+// Level a channel is fading to, its output level if it is not fading
+uint8_t fadeTarget(uint8_t channel)
+{
+    if (fadeRunning & (1 << channel)) {
+        return fades[channel].endLevel;
+    }
+    return fades[channel].currentLevel;
+}
+
+
+// Set the output level of a channel, when it is not fading
+void fadeOutput(uint8_t channel, uint8_t level)
+{
+    Fade *fade = &fades[channel];
+
+    if ((fadeRunning & (1 << channel)) == 0) {
+        fade->currentLevel = level;
+        fade->position = (uint32_t)level << 24;
+        pwmSet(channel, dimmingCurveLookup(channel, (uint16_t)level << 8));
+    }
+}
+
+
+#ifdef DALI_DT8
+
+// Fade the colour mix to 'mix' in 'cycles' PWM cycles (0: immediately)
+// A running colour fade is restarted from its current position.
+void fadeMixStart(uint16_t mix, uint32_t cycles)
+{
+    uint32_t target = (uint32_t)mix << 16;
+    uint32_t distance;
+
+    PWM_CYCLE_INT_DISABLE();
+    mixRunning = 0;
+    mixTarget = mix;
+
+    if (target > mixPosition) {
+        distance = target - mixPosition;
+        mixDirection = UP;
+    }
+    else {
+        distance = mixPosition - target;
+        mixDirection = DOWN;
+    }
+
+    if ((distance == 0) || (cycles == 0)) {
+        mixPosition = target;
+        pwmSetMix(mix);
+    }
+    else {
+        mixStep = distance / cycles;
+        mixRemainder = distance % cycles;
+        mixError = 0;
+        mixCycles = cycles;
+        mixCount = cycles;
+        mixRunning = 1;
+    }
+
+    if (!FADE_IDLE()) {
+        PWM_CYCLE_INT_ENABLE();
+    }
+}
+
+
+// Colour mix (during fading, integer part of the current position)
+uint16_t fadeMix(void)
+{
+    uint16_t mix;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        mix = mixPosition >> 16;
+    }
+    return mix;
+}
+
+#endif
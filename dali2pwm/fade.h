@@ -0,0 +1,35 @@
+#ifndef _FADE_H_
+#define _FADE_H_
+
+#include <inttypes.h>
+
+#include "pwm.h"
+
+// Fading runs in the PWM end of cycle interrupt, one step per PWM cycle
+#ifdef PWM_USE_TIMER1
+    #define PWM_CYCLE_vect              TIMER1_OVF_vect                 // TOV1 is set at TOP (mode 14)
+    #define PWM_CYCLE_INT_ENABLE()      (TIMSK1 |= (1 << TOIE1))
+    #define PWM_CYCLE_INT_DISABLE()     (TIMSK1 &= ~(1 << TOIE1))
+#else
+    #define PWM_CYCLE_vect              PSC0_EC_vect
+    #define PWM_CYCLE_INT_ENABLE()      (PIM0 |= (1 << PEOPE0))
+    #define PWM_CYCLE_INT_DISABLE()     (PIM0 &= ~(1 << PEOPE0))
+#endif
+
+// Duration conversion, in PWM cycles
+#define FADE_CYCLES(ms)         ((uint32_t)(ms) * F_PWM / 1000)
+// PWM cycles per step, in 24.8 fixed point (rate in steps/s)
+#define FADE_STEP_PERIOD(rate)  ((uint32_t)(F_PWM * 256.0 / (rate)))
+
+void fadeStart(uint8_t channel, uint8_t level, uint8_t minLevel, uint32_t cycles);
+void fadeStop(uint8_t channel);
+uint8_t fadeIsRunning(uint8_t channel);
+uint8_t fadeLevel(uint8_t channel);
+uint8_t fadeTarget(uint8_t channel);
+void fadeOutput(uint8_t channel, uint8_t level);
+#ifdef DALI_DT8
+void fadeMixStart(uint16_t mix, uint32_t cycles);
+uint16_t fadeMix(void);
+#endif
+
+#endif
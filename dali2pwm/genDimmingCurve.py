@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Dimming curve generator
+#
+# Generates the dimming curve tables (arc power level [0-254] to PWM [0-65535])
+# stored in flash. Called by the Makefile, see DIMMING_GAMMAS to select the gamma
+# variants built in the firmware.
+#
+# Usage: genDimmingCurve.py <output.c> [gamma ...]
+#
+
+import sys
+
+LEVELS = 255
+OUTPUT_MAX = 65535
+
+
+def logarithmic(i):
+    # DALI logarithmic curve (IEC 62386-102): level 1 = 0.1%, level 254 = 100%
+    return int(65.535 * 10 ** ((i - 1) / (253. / 3.)))
+
+
+def linear(i):
+    return int(round(OUTPUT_MAX * i / 254.))
+
+
+def gamma(g):
+    return lambda i: int(round(OUTPUT_MAX * (i / 254.) ** g))
+
+
+def table(name, comment, function):
+    values = [0] + [min(function(i), OUTPUT_MAX) for i in range(1, LEVELS)]
+    lines = ['// ' + comment,
+             'static const uint16_t %s[%d] PROGMEM = {%5d,' % (name, LEVELS, values[0])]
+    for n in range(1, LEVELS, 10):
+        row = ', '.join('%5d' % v for v in values[n:n + 10])
+        lines.append(' ' * 40 + row + (',' if n + 10 < LEVELS else ''))
+    lines.append(' ' * 36 + '};')
+    return '\n'.join(lines) + '\n'
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit('usage: %s <output.c> [gamma ...]' % sys.argv[0])
+
+    curves = [('CURVE_LOGARITHMIC', 'Logarithmic curve: int(65.535 * 10 ** ((i - 1) / (253. / 3.)))', logarithmic),
+              ('CURVE_LINEAR', 'Linear curve: 65535 * i / 254', linear)]
+    for g in sys.argv[2:]:
+        curves.append(('CURVE_GAMMA_%s' % g.replace('.', '_'),
+                       'Gamma %s curve: 65535 * (i / 254) ** %s' % (g, g), gamma(float(g))))
+
+    out = ['// This file is generated by genDimmingCurve.py, do not edit.',
+           '',
+           '#include <avr/pgmspace.h>',
+           '',
+           '#include "dimmingCurve.h"',
+           '',
+           '']
+    for name, comment, function in curves:
+        out.append(table(name, comment, function))
+    out.append('// Curve selected by dimmingCurveSelect(n) (see DIMMING_CURVE_xxx in dimmingCurve.h)')
+    out.append('const uint16_t * const DIMMING_CURVES[%d] PROGMEM = {' % len(curves))
+    out.append(',\n'.join('    %s' % name for name, _, _ in curves))
+    out.append('};')
+    out.append('')
+    out.append('const uint8_t DIMMING_CURVE_COUNT = %d;' % len(curves))
+
+    with open(sys.argv[1], 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()
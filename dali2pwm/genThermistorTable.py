@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+#
+# Thermistor table generator
+#
+# Generates the table converting the TEMPERATURE input (PD6/ADC3) to a temperature,
+# stored in flash. The NTC is connected between ADC3 and GND, with a pull-up
+# resistor to AVcc. Called by the Makefile, see THERMISTOR_xxx.
+#
+# Usage: genThermistorTable.py <output.c> <R25> <B> <pull-up> <AVcc mV> <Vref mV>
+#
+
+import math
+import sys
+
+ENTRIES = 33            # ADC [0-1024] in steps of 32, see TEMPERATURE_TABLE_SHIFT
+STEP = 32
+T_MIN = -40.
+T_MAX = 150.
+KELVIN = 273.15
+
+
+def temperature(adc, r25, b, pullUp, avcc, vref):
+    v = adc * vref / 1024.
+    if v <= 0:
+        return T_MAX
+    r = pullUp * v / (avcc - v)
+    t = 1. / (1. / (25. + KELVIN) + math.log(r / r25) / b) - KELVIN
+    return min(max(t, T_MIN), T_MAX)
+
+
+def main():
+    if len(sys.argv) != 7:
+        sys.exit('usage: %s <output.c> <R25> <B> <pull-up> <AVcc mV> <Vref mV>' % sys.argv[0])
+
+    r25, b, pullUp, avcc, vref = [float(a) for a in sys.argv[2:]]
+    values = [int(round(16 * temperature(n * STEP, r25, b, pullUp, avcc, vref))) for n in range(ENTRIES)]
+
+    out = ['// This file is generated by genThermistorTable.py, do not edit.',
+           '',
+           '#include <avr/pgmspace.h>',
+           '',
+           '#include "temperature.h"',
+           '',
+           '',
+           '// NTC R25 = %g, B = %g, pull-up %g to %g mV, ADC reference %g mV' % (r25, b, pullUp, avcc, vref),
+           '// Temperature (1/16 degree C) for ADC = 32 * n',
+           'const int16_t TEMPERATURE_TABLE[%d] PROGMEM = {' % ENTRIES]
+    for n in range(0, ENTRIES, 8):
+        row = ', '.join('%5d' % v for v in values[n:n + 8])
+        out.append('    ' + row + (',' if n + 8 < ENTRIES else ''))
+    out.append('};')
+
+    with open(sys.argv[1], 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()
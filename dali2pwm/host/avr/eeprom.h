@@ -0,0 +1,15 @@
+#ifndef _HOST_AVR_EEPROM_H_
+#define _HOST_AVR_EEPROM_H_
+
+// Host build: the eeprom is an array, see hostEeprom.c
+
+#include <stddef.h>
+#include <avr/io.h>
+
+#define eeprom_busy_wait()
+
+uint8_t eeprom_read_byte(const uint8_t *address);
+void eeprom_read_block(void *destination, const void *source, size_t length);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _HOST_AVR_INTERRUPT_H_
+#define _HOST_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+// Interrupt vectors are plain functions, called by the host program
+#define EE_READY_vect       hostEepromReadyVect
+
+#define ISR(vector)         void vector(void); void vector(void)
+#define sei()
+#define cli()
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef _HOST_AVR_IO_H_
+#define _HOST_AVR_IO_H_
+
+// Host build: the AT90PWM216 registers used by dali2pwm are plain variables
+// (see hostRegisters.c), the bit numbers are the ones of the datasheet
+
+#include <inttypes.h>
+
+#define E2END       0x1FF           // AT90PWM216: 512 bytes of eeprom
+
+#define _BV(bit)    (1 << (bit))
+
+// Ports
+extern volatile uint8_t DDRB, PORTB, PINB;
+extern volatile uint8_t DDRD, PORTD, PIND;
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+#define PIND4 4
+
+// System
+extern volatile uint8_t CLKPR, PRR, SMCR, MCUSR;
+#define CLKPS0  0
+#define CLKPCE  7
+#define PRADC   0
+#define PRUSART 1
+#define PRSPI   2
+#define PRTIM0  3
+#define PRTIM1  4
+#define PRPSC0  5
+#define PRPSC1  6
+#define PRPSC2  7
+
+// Watchdog
+extern volatile uint8_t WDTCSR;
+#define WDRF    3
+#define WDP0    0
+#define WDP1    1
+#define WDP2    2
+#define WDE     3
+#define WDCE    4
+#define WDP3    5
+#define WDIE    6
+#define WDIF    7
+
+// Timer0
+extern volatile uint8_t TCCR0A, TCCR0B, OCR0A, OCR0B, TIMSK0, TIFR0, TCNT0;
+#define WGM00   0
+#define WGM01   1
+#define CS00    0
+#define CS01    1
+#define CS02    2
+#define TOIE0   0
+#define OCIE0A  1
+#define OCIE0B  2
+#define OCF0A   1
+
+// Timer1
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1, TCNT1L, TCNT1H, ICR1L, ICR1H;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+#define WGM10   0
+#define WGM11   1
+#define COM1B0  4
+#define COM1B1  5
+#define COM1A0  6
+#define COM1A1  7
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define WGM12   3
+#define WGM13   4
+#define ICES1   6
+#define ICNC1   7
+#define TOIE1   0
+#define OCIE1A  1
+#define OCIE1B  2
+#define ICIE1   5
+#define TOV1    0
+#define OCF1A   1
+#define OCF1B   2
+#define ICF1    5
+
+// PSC0
+extern volatile uint8_t PLLCSR, PCNF0, PCTL0, PSOC0, PIM0, PIFR0;
+extern volatile uint16_t OCR0SA, OCR0RA, OCR0SB, OCR0RB;
+#define PLOCK   0
+#define PLLE    1
+#define PLLF    2
+#define PCLKSEL0 1
+#define PLOCK0  5
+#define PMODE00 3
+#define PMODE01 4
+#define POP0    2
+#define PRUN0   0
+#define PPRE00  6
+#define PPRE01  7
+#define POEN0A  0
+#define PSYNC00 4
+#define PSYNC01 5
+#define PEOPE0  0
+#define PARUN0  2
+
+// PSC2 (tunable white, see ../colour.h)
+extern volatile uint8_t PCNF2, PCTL2, PSOC2;
+extern volatile uint16_t OCR2SA, OCR2RA, OCR2SB, OCR2RB;
+#define PLOCK2  5
+#define PRUN2   0
+#define POEN2A  0
+#define POEN2B  2
+
+// Analog comparator 0 (power failure, see ../powerFail.h)
+extern volatile uint8_t AC0CON, ACSR;
+#define AC0M0   0
+#define AC0IS0  4
+#define AC0IS1  5
+#define AC0IE   6
+#define AC0EN   7
+#define AC0O    0
+#define AC0IF   4
+
+// ADC
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0, DIDR1;
+extern volatile uint16_t ADC;
+#define MUX0    0
+#define MUX1    1
+#define MUX2    2
+#define MUX3    3
+#define ADLAR   5
+#define REFS0   6
+#define REFS1   7
+#define ADPS0   0
+#define ADPS1   1
+#define ADPS2   2
+#define ADIE    3
+#define ADIF    4
+#define ADATE   5
+#define ADSC    6
+#define ADEN    7
+#define ADTS0   0
+#define ADTS1   1
+#define ADTS2   2
+#define ADTS3   3
+#define ADHSM   7
+#define ADC3D   3
+#define ADC4D   4
+#define ADC7D   7
+
+// EUSART (DALI)
+extern volatile uint8_t UCSRA, UCSRB, UCSRC, UBRRH, UBRRL, UDR;
+extern volatile uint8_t EUCSRA, EUCSRB, EUCSRC, MUBRRH, MUBRRL, EUDR;
+#define TXEN    3
+#define RXEN    4
+#define RXCIE   7
+#define USBS    3
+#define URxS0   0
+#define UTxS0   4
+#define BODR    0
+#define EMCH    1
+#define EUSBS   3
+#define EUSART  4
+#define STP0    0
+#define STP1    1
+#define F1617   2
+#define FEM     3
+
+// Eeprom
+extern volatile uint8_t EECR;
+#define EERIE       3
+
+#endif
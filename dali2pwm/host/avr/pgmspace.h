@@ -0,0 +1,14 @@
+#ifndef _HOST_AVR_PGMSPACE_H_
+#define _HOST_AVR_PGMSPACE_H_
+
+// Host build: flash data is in RAM
+
+#include <inttypes.h>
+
+#define PROGMEM
+#define pgm_read_byte(address)  (*(const uint8_t *)(address))
+#define pgm_read_word(address)  (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_ptr(address)   (*(void * const *)(address))
+
+#endif
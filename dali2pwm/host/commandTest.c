@@ -0,0 +1,1171 @@
+// Conformance and latency of the DALI commands
+//
+// One gear (see hostGear.h) receives forward frames on the simulated bus and is
+// checked through its answers and its registers: every command of DALI_COMMANDS
+// and DALI_SPECIAL_COMMANDS, direct arc power, the send twice and device type
+// rules, the timing of the backward frames.
+//
+// Latency of each command, from the end of the forward frame:
+//   - answer: start of the backward frame (tick that writes UDR)
+//   - output: end of the PWM cycle that loads the new duty (before the next frame)
+// The interrupts (1ms tick, PWM cycles) and the main loop run in simulated time,
+// their execution time is not simulated: the latencies are the ones of the
+// scheduling, which dominate (the CPU time of a command is a few hundred cycles,
+// less than 1/4 of a PWM cycle).
+// The latency table is printed on stdout (worst case of each command during the
+// tests), the failures on stderr.
+//
+// commandTestDT8 is the same test of the tunable white build (DALI_DT8): the
+// device type 8 commands replace the device type 6 ones, and the colour fade is
+// checked against the level fade at every PWM cycle.
+//
+// Build and run (from this directory): make check, or ./commandTest > latency.txt
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+
+#include "hostGear.h"
+#include "../colour.h"
+#include "../dali.h"
+#include "../daliCmd.h"
+#include "../daliMemory.h"
+#include "../dimmingCurve.h"
+#include "../pwm.h"
+#include "../current.h"
+#include "../temperature.h"
+
+#define SPECIAL_MODE_US         (15 * 60 * 1000000UL)   // INITIALISE enables the special commands for 15 minutes
+
+#define LATENCY_NONE            -1
+
+// Led temperature: ADC of the TEMPERATURE input (see host/thermistorTable.c)
+#define ADC_DERATING            230                     // ~79 degree C
+#define TEMPERATURE_SAMPLES     200                     // Filter settled (TEMPERATURE_FILTER_SHIFT)
+
+// Status bits (see DaliStatus)
+#define STATUS_LAMP_FAILURE     0x02
+#define STATUS_LAMP_ON          0x04
+#define STATUS_FADE_RUNNING     0x10
+#define STATUS_RESET_STATE      0x20
+#define STATUS_POWER_FAILURE    0x80
+
+// Latency table, one row per command handler
+typedef struct {
+    const char *name;
+    uint8_t first;                  // Command byte (special commands: address byte)
+    uint8_t last;
+    uint8_t special;
+    uint32_t executed;              // Frames executed
+    int32_t answer;                 // Worst case latency, us
+    int32_t output;
+} Row;
+
+static Row rows[128];
+static uint8_t rowCount = 0;
+static Row *directArcPowerRow;
+static Row *commandRows[256];       // Indexed by the command byte
+static Row *specialRows[32];        // Indexed by DALI_SPECIAL_CMD_INDEX()
+
+static HostGear gear;
+static uint16_t loadedDuty;         // Duty of the current PWM cycle
+
+// Frame being sent
+static Row *frameRow;               // Command executed, NULL if the frame was ignored (until the next frame)
+static uint8_t outputChanged;
+static uint16_t framesSent;         // Since power up
+
+#ifdef DALI_DT8
+// Colour fade, observed at each PWM cycle (see testColourFade())
+static uint8_t levelTarget;
+static uint16_t mixTarget;
+static uint32_t levelReached;       // PWM cycle where the fade reached the target, 0 if not yet
+static uint32_t mixReached;
+static uint32_t fluxErrors;         // PWM cycles where the two strings do not add up to the duty
+#endif
+
+
+static void latency(int32_t *worst)
+{
+    uint32_t time = hostBus.now - hostBus.frameEnd;
+
+    if ((int32_t)time > *worst) {
+        *worst = time;
+    }
+}
+
+
+// Rows of the latency table, from the command descriptors of the gear
+static void rowsInit(void)
+{
+    const DaliCommand *commands = dlsym(gear.library, "DALI_COMMANDS");
+    const DaliCommand *specials = dlsym(gear.library, "DALI_SPECIAL_COMMANDS");
+    Dl_info info;
+    uint16_t n;
+    Row *row;
+
+    directArcPowerRow = &rows[rowCount++];
+    directArcPowerRow->name = "DirectArcPower";
+
+    for (n = 0; n < 256 + 32; n++) {
+        const DaliCommand *command = (n < 256) ? &commands[n] : &specials[n - 256];
+
+        if (command->handler == NULL) {
+            continue;
+        }
+        row = &rows[rowCount - 1];
+        if ((row == directArcPowerRow) || (command->handler != commands[row->last].handler) ||
+            (n >= 256)) {
+            row = &rows[rowCount++];
+            row->name = "?";
+            if (dladdr(command->handler, &info) && (info.dli_sname != NULL)) {
+                row->name = info.dli_sname + strlen("daliCmd");
+            }
+            row->first = (n < 256) ? n : DALI_SPECIAL_CMD_1 + 2 * (n - 256);
+            row->special = (n >= 256);
+        }
+        row->last = (n < 256) ? n : DALI_SPECIAL_CMD_1 + 2 * (n - 256);
+        if (n < 256) {
+            commandRows[n] = row;
+        }
+        else {
+            specialRows[n - 256] = row;
+        }
+    }
+    for (n = 0; n < rowCount; n++) {
+        rows[n].answer = LATENCY_NONE;
+        rows[n].output = LATENCY_NONE;
+    }
+}
+
+
+// Row of the command executed by the frame, NULL if none
+static Row *executedRow(void)
+{
+    DaliCmd *cmd = gear.cmd;
+
+    switch (cmd->type) {
+        case DALI_CMD_TYPE_DIRECT_ARC_POWER:
+            return directArcPowerRow;
+        case DALI_CMD_TYPE_COMMAND:
+            if (((cmd->addressByte & DALI_SPECIAL_CMD_MASK) == DALI_SPECIAL_CMD_1) ||
+                ((cmd->addressByte & DALI_SPECIAL_CMD_MASK) == DALI_SPECIAL_CMD_2)) {
+                return specialRows[DALI_SPECIAL_CMD_INDEX(cmd->addressByte)];
+            }
+            return commandRows[cmd->commandByte];
+        default:
+            return NULL;
+    }
+}
+
+
+#ifdef DALI_DT8
+// Warm and cool strings after a PWM cycle
+static void colourCycle(void)
+{
+    if (*gear.ocr0ra + *gear.ocr2ra != gear.pwmDuty(0)) {
+        fluxErrors++;
+    }
+    if ((levelReached == 0) && (gear.fadeLevel(0) == levelTarget)) {
+        levelReached = hostBus.now;
+    }
+    if ((mixReached == 0) && (gear.fadeMix() == mixTarget)) {
+        mixReached = hostBus.now;
+    }
+}
+#endif
+
+
+// End of a PWM cycle: the PSC loads the last duty written (before the fade steps)
+static void pwmCycle(void)
+{
+    uint16_t duty = gear.pwmDuty(0);
+
+    if (duty != loadedDuty) {
+        loadedDuty = duty;
+        if ((frameRow != NULL) && !outputChanged) {
+            outputChanged = 1;
+            latency(&frameRow->output);
+        }
+    }
+}
+
+
+static void answerStart(void)
+{
+    if (frameRow != NULL) {
+        latency(&frameRow->answer);
+    }
+}
+
+
+static void frameReceived(void)
+{
+    outputChanged = *gear.pim0 & (1 << PEOPE0);     // Fade running: output changes are not due to this frame
+    framesSent++;
+    gear.cmd->type = DALI_CMD_TYPE_NONE;
+}
+
+
+static void frameDone(void)
+{
+    frameRow = executedRow();
+    if (frameRow != NULL) {
+        frameRow->executed++;
+    }
+}
+
+
+// Send a forward frame, wait for the backward frame and the settling time
+// Returns the answer or ANSWER_NONE
+static int16_t sendFrame(uint8_t address, uint8_t command, uint8_t status)
+{
+    frameRow = NULL;
+    return hostBusSendFrame(address, command, status);
+}
+
+
+static int16_t send(uint8_t address, uint8_t command)
+{
+    return sendFrame(address, command, 3 << STP0);      // 2 stop bits, no frame error
+}
+
+
+static int16_t query(uint8_t command)
+{
+    return send(BROADCAST, command);
+}
+
+
+static void twice(uint8_t address, uint8_t command)
+{
+    send(address, command);
+    send(address, command);
+}
+
+
+// DTR, then a send twice command
+static void store(uint8_t command, uint8_t value)
+{
+    send(DALI_CMD_DTR, value);
+    twice(BROADCAST, command);
+}
+
+
+// Application extended command (DALI_DEVICE_TYPE)
+static int16_t queryDT(uint8_t command)
+{
+    send(DALI_CMD_ENABLE_DEVICE_TYPE_X, DALI_DEVICE_TYPE);
+    return query(command);
+}
+
+
+static void storeDT(uint8_t command, uint8_t value)
+{
+    send(DALI_CMD_DTR, value);
+    send(DALI_CMD_ENABLE_DEVICE_TYPE_X, DALI_DEVICE_TYPE);
+    twice(BROADCAST, command);
+}
+
+
+#ifdef DALI_DT8
+static void sendDT(uint8_t command)
+{
+    send(DALI_CMD_ENABLE_DEVICE_TYPE_X, DALI_DEVICE_TYPE);
+    send(BROADCAST, command);
+}
+
+
+// Colour temperature in DTR1 (MSB) and DTR (LSB), then an application extended command
+static void sendTc(uint8_t command, uint16_t tc)
+{
+    send(DALI_CMD_DTR1, tc >> 8);
+    send(DALI_CMD_DTR, tc);
+    sendDT(command);
+}
+
+
+static void storeTcLimit(uint8_t limit, uint16_t tc)
+{
+    send(DALI_CMD_DTR2, limit);
+    send(DALI_CMD_DTR1, tc >> 8);
+    send(DALI_CMD_DTR, tc);
+    send(DALI_CMD_ENABLE_DEVICE_TYPE_X, DALI_DEVICE_TYPE);
+    twice(BROADCAST, DALI_CMD_STORE_COLOUR_TEMPERATURE_LIMIT);
+}
+
+
+// QUERY COLOUR VALUE: MSB answered, LSB left in DTR, ANSWER_NONE if no answer
+static long queryColour(uint8_t value)
+{
+    long msb;
+
+    send(DALI_CMD_DTR, value);
+    msb = queryDT(DALI_CMD_QUERY_COLOUR_VALUE);
+    if (msb == ANSWER_NONE) {
+        return ANSWER_NONE;
+    }
+    return (msb << 8) | query(DALI_CMD_QUERY_CONTENT_DTR);
+}
+
+
+// Colour temperature of the output, from the duties of the two strings
+static long outputTc(void)
+{
+    uint32_t warm = *gear.ocr0ra;
+    uint32_t total = warm + *gear.ocr2ra;
+
+    hostCheck("strings add up to the duty", total, gear.pwmDuty(0));
+    if (total == 0) {
+        return ANSWER_NONE;
+    }
+    return COLOUR_TC_PHYSICAL_COOLEST + (warm * COLOUR_TC_RANGE + total / 2) / total;
+}
+#endif
+
+
+static void search(uint32_t address)
+{
+    send(DALI_CMD_SEARCH_ADDRESS_H, address >> 16);
+    send(DALI_CMD_SEARCH_ADDRESS_M, address >> 8);
+    send(DALI_CMD_SEARCH_ADDRESS_L, address);
+}
+
+
+// Diagnostic counter or measurement (see daliMemory.h), ANSWER_NONE if not readable
+static long readCounter(uint8_t counter)
+{
+    long msb;
+    long lsb;
+
+    send(DALI_CMD_DTR1, DALI_MEMORY_BANK_DIAG);
+    send(DALI_CMD_DTR, DALI_MEMORY_DIAG_COUNTERS + 2 * counter);
+    msb = query(DALI_CMD_READ_MEMORY_LOCATION);
+    lsb = query(DALI_CMD_READ_MEMORY_LOCATION);
+    if ((msb == ANSWER_NONE) || (lsb == ANSWER_NONE)) {
+        return ANSWER_NONE;
+    }
+    return (msb << 8) | lsb;
+}
+
+
+// Lamp failure input of the main loop (the ADC interrupt wakes it up)
+static void lampFailure(uint8_t failure)
+{
+    gear.lampFailure = failure;
+    hostGearRun(&gear);
+}
+
+
+// New test, the gear is powered up with an erased eeprom (short address 0)
+static void powerUp(const char *name)
+{
+    hostTestName = name;
+    frameRow = NULL;
+    hostGearPowerUp(&gear);
+    hostGearRun(&gear);
+    framesSent = 0;
+    hostBusWait(100000UL);
+}
+
+
+static void testPowerUp(void)
+{
+    uint8_t n;
+
+    powerUp("power up");
+    hostCheck("QUERY STATUS", query(DALI_CMD_QUERY_STATUS), STATUS_POWER_FAILURE | STATUS_RESET_STATE | STATUS_LAMP_ON);
+    hostCheck("QUERY RESET STATE", query(DALI_CMD_QUERY_RESET_STATE), DALI_YES);
+    hostCheck("QUERY BALLAST", query(DALI_CMD_QUERY_BALLAST), DALI_YES);
+    hostCheck("QUERY LAMP FAILURE", query(DALI_CMD_QUERY_LAMP_FAILURE), ANSWER_NONE);
+    hostCheck("QUERY LAMP POWER ON", query(DALI_CMD_QUERY_LAMP_POWER_ON), DALI_YES);
+    hostCheck("QUERY LIMIT ERROR", query(DALI_CMD_QUERY_LIMIT_ERROR), ANSWER_NONE);
+    hostCheck("QUERY MISSING SHORT ADDRESS", query(DALI_CMD_QUERY_MISSING_SHORT_ADDRESS), ANSWER_NONE);
+    hostCheck("QUERY VERSION NUMBER", query(DALI_CMD_QUERY_VERSION_NUMBER), DALI_VERSION_NUMBER);
+    hostCheck("QUERY CONTENT DTR", query(DALI_CMD_QUERY_CONTENT_DTR), 0);
+    hostCheck("QUERY DEVICE TYPE", query(DALI_CMD_QUERY_DEVICE_TYPE), DALI_DEVICE_TYPE);
+    hostCheck("QUERY PHYSICAL MINIMUM LEVEL", query(DALI_CMD_QUERY_PHYSICAL_MINIMUM_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+    hostCheck("QUERY POWER FAILURE", query(DALI_CMD_QUERY_POWER_FAILURE), 1);
+    hostCheck("QUERY ACTUAL LEVEL", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+    hostCheck("QUERY MAX LEVEL", query(DALI_CMD_QUERY_MAX_LEVEL), 254);
+    hostCheck("QUERY MIN LEVEL", query(DALI_CMD_QUERY_MIN_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+    hostCheck("QUERY POWER ON LEVEL", query(DALI_CMD_QUERY_POWER_ON_LEVEL), 254);
+    hostCheck("QUERY SYSTEM FAILURE LEVEL", query(DALI_CMD_QUERY_SYSTEM_FAILURE_LEVEL), 254);
+    hostCheck("QUERY FADE TIME/FADE RATE", query(DALI_CMD_QUERY_FADE_SETTINGS), 0x07);
+    hostCheck("QUERY EXTENDED FADE TIME", query(DALI_CMD_QUERY_EXTENDED_FADE_TIME), 0);
+    for (n = 0; n < 16; n++) {
+        hostCheck("QUERY SCENE LEVEL", query(DALI_CMD_QUERY_SCENE_LEVEL + n), DALI_MASK);
+    }
+    hostCheck("QUERY GROUPS 0-7", query(DALI_CMD_QUERY_GROUPS_0_7), 0);
+    hostCheck("QUERY GROUPS 8-15", query(DALI_CMD_QUERY_GROUPS_8_15), 0);
+    hostCheck("QUERY RANDOM ADDRESS (H)", query(DALI_CMD_QUERY_RANDOM_ADDRESS_H), 0xff);
+    hostCheck("QUERY RANDOM ADDRESS (M)", query(DALI_CMD_QUERY_RANDOM_ADDRESS_M), 0xff);
+    hostCheck("QUERY RANDOM ADDRESS (L)", query(DALI_CMD_QUERY_RANDOM_ADDRESS_L), 0xff);
+
+    // An arc power command clears the power failure and the reset state
+    send(SHORT_DAPC(0), 200);
+    hostCheck("QUERY POWER FAILURE after DAPC", query(DALI_CMD_QUERY_POWER_FAILURE), 0);
+    hostCheck("QUERY RESET STATE after DAPC", query(DALI_CMD_QUERY_RESET_STATE), ANSWER_NONE);
+}
+
+
+static void testDirectArcPower(void)
+{
+    uint16_t duty;
+
+    powerUp("direct arc power");
+    duty = gear.pwmDuty(0);
+    send(SHORT_DAPC(0), 100);
+    hostCheck("actual level", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 100);
+    hostCheck("duty changed", gear.pwmDuty(0) != duty, 1);
+    hostCheck("PWM loaded", loadedDuty, gear.pwmDuty(0));
+
+    send(SHORT_DAPC(0), 10);
+    hostCheck("level below min", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+    hostCheck("QUERY LIMIT ERROR", query(DALI_CMD_QUERY_LIMIT_ERROR), DALI_YES);
+    send(SHORT_DAPC(0), DALI_MASK);
+    hostCheck("level after MASK", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+    send(SHORT_DAPC(0), 0);
+    hostCheck("level off", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 0);
+    hostCheck("QUERY LAMP POWER ON when off", query(DALI_CMD_QUERY_LAMP_POWER_ON), ANSWER_NONE);
+    hostCheck("duty off", gear.pwmDuty(0), 0);
+
+    send(SHORT_DAPC(1), 120);
+    hostCheck("DAPC to another gear", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 0);
+    send(BROADCAST_DAPC, 120);
+    hostCheck("broadcast DAPC", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 120);
+
+    // Fade time 2 (1s)
+    store(DALI_CMD_STORE_THE_DTR_AS_FADE_TIME, 2);
+    send(BROADCAST_DAPC, 254);
+    hostCheck("fade running", query(DALI_CMD_QUERY_STATUS) & STATUS_FADE_RUNNING, STATUS_FADE_RUNNING);
+    hostBusWait(1100000UL);
+    hostCheck("level after the fade", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+    hostCheck("fade ended", query(DALI_CMD_QUERY_STATUS) & STATUS_FADE_RUNNING, 0);
+
+    // An arc power command stops the fade
+    send(BROADCAST_DAPC, 100);
+    hostBusWait(500000UL);
+    send(BROADCAST, DALI_CMD_RECALL_MIN_LEVEL);
+    hostCheck("fade stopped", query(DALI_CMD_QUERY_STATUS) & STATUS_FADE_RUNNING, 0);
+    hostCheck("level after RECALL MIN LEVEL", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+}
+
+
+static void testIndirectArcPower(void)
+{
+    powerUp("indirect arc power");
+    send(BROADCAST, DALI_CMD_RECALL_MIN_LEVEL);
+    hostCheck("RECALL MIN LEVEL", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+    send(BROADCAST, DALI_CMD_STEP_UP);
+    hostCheck("STEP UP", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL + 1);
+    send(BROADCAST, DALI_CMD_STEP_DOWN);
+    hostCheck("STEP DOWN", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+    send(BROADCAST, DALI_CMD_STEP_DOWN);
+    hostCheck("STEP DOWN at min level", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+    send(BROADCAST, DALI_CMD_STEP_DOWN_AND_OFF);
+    hostCheck("STEP DOWN AND OFF at min level", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 0);
+    send(BROADCAST, DALI_CMD_STEP_UP);
+    hostCheck("STEP UP when off", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 0);
+    send(BROADCAST, DALI_CMD_UP_200MS);
+    hostCheck("UP when off", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 0);
+    send(BROADCAST, DALI_CMD_ON_AND_STEP_UP);
+    hostCheck("ON AND STEP UP when off", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+    send(BROADCAST, DALI_CMD_ON_AND_STEP_UP);
+    hostCheck("ON AND STEP UP", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL + 1);
+    send(BROADCAST, DALI_CMD_STEP_DOWN_AND_OFF);
+    hostCheck("STEP DOWN AND OFF", query(DALI_CMD_QUERY_ACTUAL_LEVEL), DALI_PHYSICAL_MIN_LEVEL);
+    send(BROADCAST, DALI_CMD_RECALL_MAX_LEVEL);
+    hostCheck("RECALL MAX LEVEL", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+    send(BROADCAST, DALI_CMD_IMMEDIATE_OFF);
+    hostCheck("OFF", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 0);
+
+    // Fade rate 7: 9 steps in 200ms
+    send(BROADCAST_DAPC, 100);
+    send(BROADCAST, DALI_CMD_UP_200MS);
+    hostBusWait(300000UL);
+    hostCheck("UP", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 109);
+    send(BROADCAST, DALI_CMD_DOWN_200MS);
+    hostBusWait(300000UL);
+    hostCheck("DOWN", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 100);
+
+    store(DALI_CMD_STORE_THE_DTR_AS_SCENE + 3, 120);
+    send(BROADCAST, DALI_CMD_GO_TO_SCENE + 3);
+    hostCheck("GO TO SCENE", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 120);
+    send(BROADCAST, DALI_CMD_GO_TO_SCENE + 4);
+    hostCheck("GO TO SCENE not set (MASK)", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 120);
+}
+
+
+static void testConfiguration(void)
+{
+    powerUp("configuration");
+    send(BROADCAST_DAPC, 150);
+    twice(BROADCAST, DALI_CMD_STORE_ACTUAL_LEVEL_IN_DTR);
+    hostCheck("STORE ACTUAL LEVEL IN THE DTR", query(DALI_CMD_QUERY_CONTENT_DTR), 150);
+
+    store(DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL, 200);
+    hostCheck("max level", query(DALI_CMD_QUERY_MAX_LEVEL), 200);
+    hostCheck("level below max", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 150);
+    store(DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL, 100);
+    hostCheck("level above max", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 100);
+    store(DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL, 30);
+    hostCheck("max level below min", query(DALI_CMD_QUERY_MAX_LEVEL), DALI_PHYSICAL_MIN_LEVEL + 1);
+    store(DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL, 254);
+
+    store(DALI_CMD_STORE_THE_DTR_AS_MIN_LEVEL, 60);
+    hostCheck("min level", query(DALI_CMD_QUERY_MIN_LEVEL), 60);
+    hostCheck("level below min", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 60);
+    store(DALI_CMD_STORE_THE_DTR_AS_MIN_LEVEL, 255);
+    hostCheck("min level above max", query(DALI_CMD_QUERY_MIN_LEVEL), 253);
+    store(DALI_CMD_STORE_THE_DTR_AS_MIN_LEVEL, DALI_PHYSICAL_MIN_LEVEL);
+
+    store(DALI_CMD_STORE_THE_DTR_AS_SYSTEM_FAILURE_LEVEL, 80);
+    hostCheck("system failure level", query(DALI_CMD_QUERY_SYSTEM_FAILURE_LEVEL), 80);
+    store(DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL, 90);
+    hostCheck("power on level", query(DALI_CMD_QUERY_POWER_ON_LEVEL), 90);
+    store(DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL, 255);
+    hostCheck("power on level MASK (last active level)", query(DALI_CMD_QUERY_POWER_ON_LEVEL), DALI_LAST_ACTIVE_LEVEL);
+
+    store(DALI_CMD_STORE_THE_DTR_AS_FADE_TIME, 0x13);
+    hostCheck("fade time", query(DALI_CMD_QUERY_FADE_SETTINGS), 0x37);
+    store(DALI_CMD_STORE_THE_DTR_AS_FADE_RATE, 0);
+    hostCheck("fade rate 0", query(DALI_CMD_QUERY_FADE_SETTINGS), 0x37);
+    store(DALI_CMD_STORE_THE_DTR_AS_FADE_RATE, 5);
+    hostCheck("fade rate", query(DALI_CMD_QUERY_FADE_SETTINGS), 0x35);
+
+    store(DALI_CMD_SET_EXTENDED_FADE_TIME, 0x12);
+    hostCheck("extended fade time", query(DALI_CMD_QUERY_EXTENDED_FADE_TIME), 0x12);
+    store(DALI_CMD_SET_EXTENDED_FADE_TIME, DALI_EXTENDED_FADE_TIME_MAX + 1);
+    hostCheck("extended fade time out of range", query(DALI_CMD_QUERY_EXTENDED_FADE_TIME), 0);
+}
+
+
+// Bus low for BUS_FAILURE_TIMEOUT during a fade: the interrupt leaves the fade to the
+// main loop, which stops it at systemFailureLevel
+static void testBusFailure(void)
+{
+    powerUp("bus failure");
+    store(DALI_CMD_STORE_THE_DTR_AS_SYSTEM_FAILURE_LEVEL, 80);
+    store(DALI_CMD_STORE_THE_DTR_AS_FADE_TIME, 4);         // 2s
+    send(BROADCAST_DAPC, 200);
+    hostBusWait(500000UL);
+    hostCheck("fading", gear.dali->status.fadeRunning, 1);
+
+    gear.busFailureVect();
+    hostCheck("fade left to the main loop", gear.dali->status.fadeRunning, 1);
+    hostGearMainLoop(&gear);
+    hostCheck("level at system failure level", gear.dali->actualDimLevel, 80);
+    hostCheck("fade stopped", gear.dali->status.fadeRunning, 0);
+    hostCheck("output at system failure level", gear.fadeLevel(0), 80);
+    hostBusWait(2000000UL);
+    hostCheck("level after the fade time", gear.dali->actualDimLevel, 80);
+
+    // Limited by the max level, MASK: level unchanged
+    store(DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL, 60);
+    store(DALI_CMD_STORE_THE_DTR_AS_SYSTEM_FAILURE_LEVEL, 100);
+    gear.busFailureVect();
+    hostGearMainLoop(&gear);
+    hostCheck("system failure level above max", gear.dali->actualDimLevel, 60);
+    store(DALI_CMD_STORE_THE_DTR_AS_SYSTEM_FAILURE_LEVEL, DALI_MASK);
+    send(BROADCAST_DAPC, 55);
+    hostBusWait(2500000UL);
+    gear.busFailureVect();
+    hostGearMainLoop(&gear);
+    hostCheck("system failure level MASK", gear.dali->actualDimLevel, 55);
+    hostCheck("bus failures", readCounter(DALI_MEMORY_DIAG_BUS_FAILURES), 3);
+}
+
+
+static void testSendTwice(void)
+{
+    powerUp("send twice");
+    send(DALI_CMD_DTR, 200);
+
+    send(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    hostBusWait(200000UL);
+    hostCheck("sent once", query(DALI_CMD_QUERY_MAX_LEVEL), 254);
+
+    send(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    send(BROADCAST, DALI_CMD_QUERY_ACTUAL_LEVEL);
+    send(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    hostBusWait(200000UL);
+    hostCheck("another frame in between", query(DALI_CMD_QUERY_MAX_LEVEL), 254);
+
+    send(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    send(SHORT(5), DALI_CMD_QUERY_ACTUAL_LEVEL);
+    send(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    hostBusWait(200000UL);
+    hostCheck("frame for another gear in between", query(DALI_CMD_QUERY_MAX_LEVEL), 254);
+
+    send(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    hostBusWait(150000UL);
+    send(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    hostBusWait(200000UL);
+    hostCheck("repeated after 100ms", query(DALI_CMD_QUERY_MAX_LEVEL), 254);
+
+    send(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    send(SHORT(0), DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    hostBusWait(200000UL);
+    hostCheck("repeated with another address", query(DALI_CMD_QUERY_MAX_LEVEL), 254);
+
+    twice(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    hostCheck("sent twice", query(DALI_CMD_QUERY_MAX_LEVEL), 200);
+}
+
+
+static void testScenesAndGroups(void)
+{
+    powerUp("scenes and groups");
+    store(DALI_CMD_STORE_THE_DTR_AS_SCENE + 15, 77);
+    hostCheck("scene 15", query(DALI_CMD_QUERY_SCENE_LEVEL + 15), 77);
+    twice(BROADCAST, DALI_CMD_REMOVE_FROM_SCENE + 15);
+    hostCheck("scene 15 removed", query(DALI_CMD_QUERY_SCENE_LEVEL + 15), DALI_MASK);
+
+    twice(BROADCAST, DALI_CMD_ADD_TO_GROUP + 3);
+    hostCheck("groups 0-7", query(DALI_CMD_QUERY_GROUPS_0_7), 0x08);
+    hostCheck("group 3 address", send(GROUP(3), DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+    hostCheck("group 4 address", send(GROUP(4), DALI_CMD_QUERY_ACTUAL_LEVEL), ANSWER_NONE);
+    twice(BROADCAST, DALI_CMD_ADD_TO_GROUP + 12);
+    hostCheck("groups 8-15", query(DALI_CMD_QUERY_GROUPS_8_15), 0x10);
+    send(GROUP_DAPC(12), 100);
+    hostCheck("group DAPC", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 100);
+    twice(BROADCAST, DALI_CMD_REMOVE_FROM_GROUP + 3);
+    hostCheck("group 3 removed", query(DALI_CMD_QUERY_GROUPS_0_7), 0);
+    hostCheck("group 3 address removed", send(GROUP(3), DALI_CMD_QUERY_ACTUAL_LEVEL), ANSWER_NONE);
+}
+
+
+static void testShortAddress(void)
+{
+    powerUp("short address");
+    hostCheck("short address 0", send(SHORT(0), DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+    store(DALI_CMD_STORE_DTR_AS_SHORT_ADDRESS, 5);
+    hostCheck("short address 5", send(SHORT(5), DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+    hostCheck("old short address", send(SHORT(0), DALI_CMD_QUERY_ACTUAL_LEVEL), ANSWER_NONE);
+    send(SHORT_DAPC(5), 100);
+    hostCheck("short address DAPC", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 100);
+    store(DALI_CMD_STORE_DTR_AS_SHORT_ADDRESS, DALI_MASK);
+    hostCheck("QUERY MISSING SHORT ADDRESS", query(DALI_CMD_QUERY_MISSING_SHORT_ADDRESS), DALI_YES);
+    hostCheck("short address removed", send(SHORT(5), DALI_CMD_QUERY_ACTUAL_LEVEL), ANSWER_NONE);
+}
+
+
+#ifndef DALI_DT8
+static void testDeviceType6(void)
+{
+    powerUp("device type 6");
+    hostCheck("without ENABLE DEVICE TYPE", query(DALI_CMD_QUERY_DIMMING_CURVE), ANSWER_NONE);
+    hostCheck("QUERY DIMMING CURVE", queryDT(DALI_CMD_QUERY_DIMMING_CURVE), DIMMING_CURVE_LOGARITHMIC);
+    send(DALI_CMD_ENABLE_DEVICE_TYPE_X, DALI_DEVICE_TYPE + 1);
+    hostCheck("other device type", query(DALI_CMD_QUERY_DIMMING_CURVE), ANSWER_NONE);
+    send(DALI_CMD_ENABLE_DEVICE_TYPE_X, DALI_DEVICE_TYPE);
+    query(DALI_CMD_QUERY_ACTUAL_LEVEL);
+    hostCheck("device type for the next command only", query(DALI_CMD_QUERY_DIMMING_CURVE), ANSWER_NONE);
+
+    hostCheck("QUERY FAST FADE TIME", queryDT(DALI_CMD_QUERY_FAST_FADE_TIME), 0);
+    hostCheck("QUERY MIN FAST FADE TIME", queryDT(DALI_CMD_QUERY_MIN_FAST_FADE_TIME), DALI_MIN_FAST_FADE_TIME);
+    storeDT(DALI_CMD_STORE_DTR_AS_FAST_FADE_TIME, 10);
+    hostCheck("fast fade time", queryDT(DALI_CMD_QUERY_FAST_FADE_TIME), 10);
+    storeDT(DALI_CMD_STORE_DTR_AS_FAST_FADE_TIME, 40);
+    hostCheck("fast fade time above max", queryDT(DALI_CMD_QUERY_FAST_FADE_TIME), DALI_MAX_FAST_FADE_TIME);
+    storeDT(DALI_CMD_STORE_DTR_AS_FAST_FADE_TIME, 0);
+    hostCheck("fast fade time 0", queryDT(DALI_CMD_QUERY_FAST_FADE_TIME), 0);
+
+    storeDT(DALI_CMD_SELECT_DIMMING_CURVE, DIMMING_CURVE_LINEAR);
+    hostCheck("SELECT DIMMING CURVE", queryDT(DALI_CMD_QUERY_DIMMING_CURVE), DIMMING_CURVE_LINEAR);
+    storeDT(DALI_CMD_SELECT_DIMMING_CURVE, 200);
+    hostCheck("unknown dimming curve", queryDT(DALI_CMD_QUERY_DIMMING_CURVE), DIMMING_CURVE_LOGARITHMIC);
+
+    lampFailure(DALI_FAILURE_OPEN_CIRCUIT);
+    hostCheck("QUERY FAILURE STATUS (open)", queryDT(DALI_CMD_QUERY_FAILURE_STATUS), DALI_FAILURE_OPEN_CIRCUIT);
+    hostCheck("QUERY OPEN CIRCUIT", queryDT(DALI_CMD_QUERY_OPEN_CIRCUIT), DALI_YES);
+    hostCheck("QUERY SHORT CIRCUIT (open)", queryDT(DALI_CMD_QUERY_SHORT_CIRCUIT), ANSWER_NONE);
+    hostCheck("QUERY LAMP FAILURE", query(DALI_CMD_QUERY_LAMP_FAILURE), DALI_YES);
+    hostCheck("QUERY STATUS (lamp failure)", query(DALI_CMD_QUERY_STATUS) & STATUS_LAMP_FAILURE, STATUS_LAMP_FAILURE);
+    lampFailure(DALI_FAILURE_SHORT_CIRCUIT);
+    hostCheck("QUERY FAILURE STATUS (short)", queryDT(DALI_CMD_QUERY_FAILURE_STATUS), DALI_FAILURE_SHORT_CIRCUIT);
+    hostCheck("QUERY SHORT CIRCUIT", queryDT(DALI_CMD_QUERY_SHORT_CIRCUIT), DALI_YES);
+    lampFailure(0);
+    hostCheck("QUERY FAILURE STATUS", queryDT(DALI_CMD_QUERY_FAILURE_STATUS), 0);
+    hostCheck("QUERY LAMP FAILURE (none)", query(DALI_CMD_QUERY_LAMP_FAILURE), ANSWER_NONE);
+    hostCheck("QUERY THERMAL SHUTDOWN", queryDT(DALI_CMD_QUERY_THERMAL_SHUTDOWN), ANSWER_NONE);
+    hostCheck("QUERY THERMAL OVERLOAD", queryDT(DALI_CMD_QUERY_THERMAL_OVERLOAD), ANSWER_NONE);
+
+    // IEC 62386-207 features, fixed
+    hostCheck("QUERY EXTENDED VERSION NUMBER", queryDT(DALI_CMD_QUERY_EXTENDED_VERSION_NUMBER), DALI_DT6_EXTENDED_VERSION);
+    hostCheck("QUERY GEAR TYPE", queryDT(DALI_CMD_QUERY_GEAR_TYPE), DALI_DT6_GEAR_TYPE);
+    hostCheck("QUERY POSSIBLE OPERATING MODES", queryDT(DALI_CMD_QUERY_POSSIBLE_OPERATING_MODES), DALI_DT6_OPERATING_MODES);
+    hostCheck("QUERY FEATURES", queryDT(DALI_CMD_QUERY_FEATURES), DALI_DT6_FEATURES);
+    hostCheck("QUERY OPERATING MODE", queryDT(DALI_CMD_QUERY_OPERATING_MODE), DALI_DT6_OPERATING_MODES);
+    storeDT(DALI_CMD_SELECT_DIMMING_CURVE, DIMMING_CURVE_LINEAR);
+    hostCheck("QUERY OPERATING MODE (linear)", queryDT(DALI_CMD_QUERY_OPERATING_MODE),
+              DALI_DT6_OPERATING_MODES | DALI_DT6_MODE_NON_LOG);
+    storeDT(DALI_CMD_SELECT_DIMMING_CURVE, DIMMING_CURVE_LOGARITHMIC);
+
+    // No load detection, reference measurement or current protector
+    storeDT(DALI_CMD_REFERENCE_SYSTEM_POWER, 0);
+    storeDT(DALI_CMD_ENABLE_CURRENT_PROTECTOR, 0);
+    hostCheck("QUERY CURRENT PROTECTOR ENABLED", queryDT(DALI_CMD_QUERY_CURRENT_PROTECTOR_ENABLED), ANSWER_NONE);
+    storeDT(DALI_CMD_DISABLE_CURRENT_PROTECTOR, 0);
+    hostCheck("QUERY REFERENCE RUNNING", queryDT(DALI_CMD_QUERY_REFERENCE_RUNNING), ANSWER_NONE);
+    hostCheck("QUERY REFERENCE MEASUREMENT FAILED", queryDT(DALI_CMD_QUERY_REFERENCE_MEASUREMENT_FAILED), ANSWER_NONE);
+    hostCheck("QUERY LOAD DECREASE", queryDT(DALI_CMD_QUERY_LOAD_DECREASE), ANSWER_NONE);
+    hostCheck("QUERY LOAD INCREASE", queryDT(DALI_CMD_QUERY_LOAD_INCREASE), ANSWER_NONE);
+    hostCheck("QUERY CURRENT PROTECTOR ACTIVE", queryDT(DALI_CMD_QUERY_CURRENT_PROTECTOR_ACTIVE), ANSWER_NONE);
+    hostCheck("QUERY FAILURE STATUS (none)", queryDT(DALI_CMD_QUERY_FAILURE_STATUS), 0);
+    hostCheck("level unchanged", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+}
+
+#else
+
+static void testDeviceType8(void)
+{
+    powerUp("device type 8");
+    hostCheck("without ENABLE DEVICE TYPE", query(DALI_CMD_QUERY_COLOUR_TYPE_FEATURES), ANSWER_NONE);
+    hostCheck("QUERY COLOUR TYPE FEATURES", queryDT(DALI_CMD_QUERY_COLOUR_TYPE_FEATURES), DALI_COLOUR_TYPE_FEATURES);
+    send(DALI_CMD_ENABLE_DEVICE_TYPE_X, 6);
+    hostCheck("other device type", query(DALI_CMD_QUERY_COLOUR_TYPE_FEATURES), ANSWER_NONE);
+    hostCheck("QUERY EXTENDED VERSION NUMBER", queryDT(DALI_CMD_QUERY_EXTENDED_VERSION_NUMBER), DALI_DT8_EXTENDED_VERSION);
+    hostCheck("QUERY GEAR FEATURES", queryDT(DALI_CMD_QUERY_GEAR_FEATURES), DALI_GEAR_FEATURE_AUTO_ACTIVATION);
+    hostCheck("QUERY COLOUR STATUS", queryDT(DALI_CMD_QUERY_COLOUR_STATUS), DALI_COLOUR_STATUS_TC_ACTIVE);
+
+    hostCheck("power on colour", queryColour(DALI_COLOUR_VALUE_TC), COLOUR_TC_PHYSICAL_WARMEST);
+    hostCheck("power on output colour", outputTc(), COLOUR_TC_PHYSICAL_WARMEST);
+    hostCheck("Tc coolest", queryColour(DALI_COLOUR_VALUE_TC_COOLEST), COLOUR_TC_PHYSICAL_COOLEST);
+    hostCheck("Tc warmest", queryColour(DALI_COLOUR_VALUE_TC_WARMEST), COLOUR_TC_PHYSICAL_WARMEST);
+    hostCheck("Tc physical coolest", queryColour(DALI_COLOUR_VALUE_TC_PHYSICAL_COOLEST), COLOUR_TC_PHYSICAL_COOLEST);
+    hostCheck("Tc physical warmest", queryColour(DALI_COLOUR_VALUE_TC_PHYSICAL_WARMEST), COLOUR_TC_PHYSICAL_WARMEST);
+    hostCheck("temporary Tc", queryColour(DALI_COLOUR_VALUE_TEMPORARY_TC), COLOUR_MASK);
+    hostCheck("unknown colour value", queryColour(0), COLOUR_MASK);
+    hostCheck("colour value MSB in DTR1", query(DALI_CMD_QUERY_CONTENT_DTR1), COLOUR_MASK >> 8);
+
+    // Temporary colour, applied by ACTIVATE
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, 250);
+    hostCheck("SET TEMPORARY COLOUR TEMPERATURE", queryColour(DALI_COLOUR_VALUE_TEMPORARY_TC), 250);
+    hostCheck("temporary Tc not applied", queryColour(DALI_COLOUR_VALUE_TC), COLOUR_TC_PHYSICAL_WARMEST);
+    sendDT(DALI_CMD_ACTIVATE);
+    hostCheck("ACTIVATE", queryColour(DALI_COLOUR_VALUE_TC), 250);
+    hostCheck("output colour after ACTIVATE", outputTc(), 250);
+    hostCheck("temporary Tc after ACTIVATE", queryColour(DALI_COLOUR_VALUE_TEMPORARY_TC), COLOUR_MASK);
+    sendDT(DALI_CMD_STEP_COOLER);
+    hostCheck("STEP COOLER", queryColour(DALI_COLOUR_VALUE_TC), 249);
+    hostCheck("output colour after STEP COOLER", outputTc(), 249);
+    sendDT(DALI_CMD_STEP_WARMER);
+    sendDT(DALI_CMD_STEP_WARMER);
+    hostCheck("STEP WARMER", queryColour(DALI_COLOUR_VALUE_REPORT_TC), 251);
+    sendDT(DALI_CMD_COPY_REPORT_TO_TEMPORARY);
+    hostCheck("COPY REPORT TO TEMPORARY", queryColour(DALI_COLOUR_VALUE_TEMPORARY_TC), 251);
+
+    // Automatic activation by the arc power commands
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, 200);
+    send(BROADCAST_DAPC, 200);
+    hostCheck("activated by DAPC", queryColour(DALI_COLOUR_VALUE_TC), 200);
+    storeDT(DALI_CMD_STORE_GEAR_FEATURES, 0xff);
+    hostCheck("STORE GEAR FEATURES", queryDT(DALI_CMD_QUERY_GEAR_FEATURES), DALI_GEAR_FEATURE_AUTO_ACTIVATION);
+    storeDT(DALI_CMD_STORE_GEAR_FEATURES, 0);
+    hostCheck("automatic activation disabled", queryDT(DALI_CMD_QUERY_GEAR_FEATURES), 0);
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, 300);
+    send(BROADCAST, DALI_CMD_RECALL_MAX_LEVEL);
+    hostCheck("not activated by RECALL MAX LEVEL", queryColour(DALI_COLOUR_VALUE_TC), 200);
+    storeDT(DALI_CMD_STORE_GEAR_FEATURES, DALI_GEAR_FEATURE_AUTO_ACTIVATION);
+    send(BROADCAST, DALI_CMD_RECALL_MAX_LEVEL);
+    hostCheck("activated by RECALL MAX LEVEL", queryColour(DALI_COLOUR_VALUE_TC), 300);
+    hostCheck("output colour after RECALL MAX LEVEL", outputTc(), 300);
+
+    // Limits
+    storeTcLimit(DALI_TC_LIMIT_COOLEST, 180);
+    hostCheck("STORE Tc LIMIT coolest", queryColour(DALI_COLOUR_VALUE_TC_COOLEST), 180);
+    storeTcLimit(DALI_TC_LIMIT_WARMEST, 280);
+    hostCheck("STORE Tc LIMIT warmest", queryColour(DALI_COLOUR_VALUE_TC_WARMEST), 280);
+    hostCheck("colour within the new limits", queryColour(DALI_COLOUR_VALUE_TC), 280);
+    hostCheck("output colour within the new limits", outputTc(), 280);
+    storeTcLimit(DALI_TC_LIMIT_PHYSICAL_COOLEST, 100);
+    hostCheck("physical limit not stored", queryColour(DALI_COLOUR_VALUE_TC_PHYSICAL_COOLEST), COLOUR_TC_PHYSICAL_COOLEST);
+    storeTcLimit(DALI_TC_LIMIT_COOLEST, 300);
+    hostCheck("coolest above warmest", queryColour(DALI_COLOUR_VALUE_TC_COOLEST), 280);
+    storeTcLimit(DALI_TC_LIMIT_COOLEST, 0);
+    hostCheck("coolest below physical", queryColour(DALI_COLOUR_VALUE_TC_COOLEST), COLOUR_TC_PHYSICAL_COOLEST);
+    storeTcLimit(DALI_TC_LIMIT_COOLEST, COLOUR_MASK);
+    hostCheck("MASK limit ignored", queryColour(DALI_COLOUR_VALUE_TC_COOLEST), COLOUR_TC_PHYSICAL_COOLEST);
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, 400);
+    sendDT(DALI_CMD_ACTIVATE);
+    hostCheck("Tc above the warmest limit", queryColour(DALI_COLOUR_VALUE_TC), 280);
+    hostCheck("QUERY COLOUR STATUS (out of range)", queryDT(DALI_CMD_QUERY_COLOUR_STATUS),
+          DALI_COLOUR_STATUS_TC_ACTIVE | DALI_COLOUR_STATUS_TC_OUT_OF_RANGE);
+    sendDT(DALI_CMD_STEP_WARMER);
+    hostCheck("STEP WARMER at the limit", queryColour(DALI_COLOUR_VALUE_TC), 280);
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, 160);
+    sendDT(DALI_CMD_ACTIVATE);
+    hostCheck("Tc within the limits", queryColour(DALI_COLOUR_VALUE_TC), 160);
+    hostCheck("QUERY COLOUR STATUS (in range)", queryDT(DALI_CMD_QUERY_COLOUR_STATUS), DALI_COLOUR_STATUS_TC_ACTIVE);
+
+    // Scenes and power on: temporary colour if any, actual colour otherwise
+    store(DALI_CMD_STORE_THE_DTR_AS_SCENE + 5, 254);
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, 222);
+    store(DALI_CMD_STORE_THE_DTR_AS_SCENE + 4, 120);
+    hostCheck("scene colour (actual)", gear.dali->sceneColourTemperature[5], 160);
+    hostCheck("scene colour (temporary)", gear.dali->sceneColourTemperature[4], 222);
+    send(BROADCAST, DALI_CMD_GO_TO_SCENE + 4);
+    hostCheck("GO TO SCENE level", query(DALI_CMD_QUERY_ACTUAL_LEVEL), 120);
+    hostCheck("GO TO SCENE colour", queryColour(DALI_COLOUR_VALUE_TC), 222);
+    send(BROADCAST, DALI_CMD_GO_TO_SCENE + 5);
+    hostCheck("GO TO SCENE colour", queryColour(DALI_COLOUR_VALUE_TC), 160);
+    hostCheck("output colour after GO TO SCENE", outputTc(), 160);
+    twice(BROADCAST, DALI_CMD_REMOVE_FROM_SCENE + 4);
+    hostCheck("scene colour removed", gear.dali->sceneColourTemperature[4], COLOUR_MASK);
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, 190);
+    store(DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL, 254);
+    hostCheck("power on colour", gear.dali->powerOnColourTemperature, 190);
+
+    // Out of the physical limits: clamped, stored and loaded again at power up
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, 100);
+    hostCheck("temporary Tc below physical", queryColour(DALI_COLOUR_VALUE_TEMPORARY_TC), COLOUR_TC_PHYSICAL_COOLEST);
+    store(DALI_CMD_STORE_THE_DTR_AS_SCENE + 6, 100);
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, 1000);
+    hostCheck("temporary Tc above physical", queryColour(DALI_COLOUR_VALUE_TEMPORARY_TC), COLOUR_TC_PHYSICAL_WARMEST);
+    store(DALI_CMD_STORE_THE_DTR_AS_SCENE + 7, 100);
+    hostBusWait(1000UL * BOOT_BACKGROUND_DELAY);
+    hostGearPowerCycle(&gear);
+    hostGearRun(&gear);
+    hostCheck("scene colour below physical after power up", gear.dali->sceneColourTemperature[6], COLOUR_TC_PHYSICAL_COOLEST);
+    hostCheck("scene colour above physical after power up", gear.dali->sceneColourTemperature[7], COLOUR_TC_PHYSICAL_WARMEST);
+    hostCheck("power on colour after power up", gear.dali->powerOnColourTemperature, 190);
+
+    twice(BROADCAST, DALI_CMD_RESET);
+    hostCheck("Tc coolest after RESET", queryColour(DALI_COLOUR_VALUE_TC_COOLEST), COLOUR_TC_PHYSICAL_COOLEST);
+    hostCheck("Tc warmest after RESET", queryColour(DALI_COLOUR_VALUE_TC_WARMEST), COLOUR_TC_PHYSICAL_WARMEST);
+    hostCheck("power on colour after RESET", gear.dali->powerOnColourTemperature, COLOUR_TC_PHYSICAL_WARMEST);
+    hostCheck("scene colour after RESET", gear.dali->sceneColourTemperature[5], COLOUR_MASK);
+}
+
+
+// Level and colour fade in lockstep: both reach their target in the same PWM cycle,
+// the two strings add up to the duty at every cycle
+static void testColourFade(void)
+{
+    uint32_t start;
+    long levelProgress;
+    long mixProgress;
+
+    powerUp("colour fade");
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, COLOUR_TC_PHYSICAL_COOLEST);
+    sendDT(DALI_CMD_ACTIVATE);
+    send(BROADCAST_DAPC, 100);
+    store(DALI_CMD_STORE_THE_DTR_AS_FADE_TIME, 1);          // 0.7s
+    sendTc(DALI_CMD_SET_TEMPORARY_COLOUR_TEMPERATURE, COLOUR_TC_PHYSICAL_WARMEST);
+
+    levelTarget = 254;
+    mixTarget = COLOUR_MIX_WARM;
+    levelReached = 0;
+    mixReached = 0;
+    fluxErrors = 0;
+    send(BROADCAST_DAPC, 254);
+    start = hostBus.frameEnd;
+
+    hostBusAdvance(start + 350000UL);
+    levelProgress = (gear.fadeLevel(0) - 100) * 1000L / (254 - 100);
+    mixProgress = gear.fadeMix() * 1000L / COLOUR_MIX_WARM;
+    if (labs(levelProgress - mixProgress) > 10) {
+        hostCheck("colour progress at half fade (per mil of the level progress)", mixProgress, levelProgress);
+    }
+    hostCheck("colour fading", queryDT(DALI_CMD_QUERY_COLOUR_STATUS), DALI_COLOUR_STATUS_TC_ACTIVE);
+    hostCheck("QUERY STATUS (fade running)", query(DALI_CMD_QUERY_STATUS) & STATUS_FADE_RUNNING, STATUS_FADE_RUNNING);
+
+    hostBusAdvance(start + 1000000UL);
+    hostCheck("level fade ended", levelReached != 0, 1);
+    hostCheck("colour fade ended in the same PWM cycle (us)", (long)(mixReached - levelReached), 0);
+    if (labs((long)(levelReached - start) - 707000L) > 1000) {
+        hostCheck("fade duration (us)", levelReached - start, 707000L);
+    }
+    hostCheck("PWM cycles where the strings do not add up to the duty", fluxErrors, 0);
+    hostCheck("colour after the fade", queryColour(DALI_COLOUR_VALUE_TC), COLOUR_TC_PHYSICAL_WARMEST);
+    hostCheck("output colour after the fade", outputTc(), COLOUR_TC_PHYSICAL_WARMEST);
+    hostCheck("QUERY STATUS (fade ended)", query(DALI_CMD_QUERY_STATUS) & STATUS_FADE_RUNNING, 0);
+}
+#endif
+
+
+static void testSpecialCommands(void)
+{
+    DaliRegisters *dali;
+    uint32_t random;
+
+    powerUp("special commands");
+    dali = gear.dali;
+    hostCheck("COMPARE out of special mode", send(DALI_CMD_COMPARE, 0), ANSWER_NONE);
+    twice(DALI_CMD_INITIALIZE, 0x00);
+    twice(DALI_CMD_RANDOMISE, 0x00);
+    random = ((uint32_t)dali->randomAddressH << 16) | ((uint32_t)dali->randomAddressM << 8) | dali->randomAddressL;
+    hostCheck("RANDOMISE", random <= 0xfffffe, 1);
+    hostCheck("QUERY RANDOM ADDRESS (H)", query(DALI_CMD_QUERY_RANDOM_ADDRESS_H), random >> 16);
+    hostCheck("QUERY RANDOM ADDRESS (M)", query(DALI_CMD_QUERY_RANDOM_ADDRESS_M), (random >> 8) & 0xff);
+    hostCheck("QUERY RANDOM ADDRESS (L)", query(DALI_CMD_QUERY_RANDOM_ADDRESS_L), random & 0xff);
+
+    search(random);
+    hostCheck("search address", ((uint32_t)dali->searchAddressH << 16) | (dali->searchAddressM << 8) | dali->searchAddressL, random);
+    hostCheck("COMPARE (equal)", send(DALI_CMD_COMPARE, 0), DALI_YES);
+    hostCheck("QUERY SHORT ADDRESS", send(DALI_CMD_QUERY_SHORT_ADDRESS, 0), SHORT(0));
+    search(random + 1);
+    hostCheck("COMPARE (above)", send(DALI_CMD_COMPARE, 0), DALI_YES);
+    if (random > 0) {
+        search(random - 1);
+        hostCheck("COMPARE (below)", send(DALI_CMD_COMPARE, 0), ANSWER_NONE);
+    }
+    hostCheck("QUERY SHORT ADDRESS (other search address)", send(DALI_CMD_QUERY_SHORT_ADDRESS, 0), ANSWER_NONE);
+
+    search(random);
+    send(DALI_CMD_PROGRAM_SHORT_ADDRESS, SHORT(7));
+    hostCheck("PROGRAM SHORT ADDRESS", send(SHORT(7), DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+    hostCheck("VERIFY SHORT ADDRESS", send(DALI_CMD_VERIFY_SHORT_ADDRESS, SHORT(7)), DALI_YES);
+    hostCheck("VERIFY SHORT ADDRESS (other)", send(DALI_CMD_VERIFY_SHORT_ADDRESS, SHORT(8)), ANSWER_NONE);
+    send(DALI_CMD_PROGRAM_SHORT_ADDRESS, DALI_MASK);
+    hostCheck("PROGRAM SHORT ADDRESS (MASK)", query(DALI_CMD_QUERY_MISSING_SHORT_ADDRESS), DALI_YES);
+    send(DALI_CMD_PROGRAM_SHORT_ADDRESS, SHORT(7));
+
+    send(DALI_CMD_WITHDRAW, 0);
+    hostCheck("COMPARE after WITHDRAW", send(DALI_CMD_COMPARE, 0), ANSWER_NONE);
+
+    // Physical selection: the gear is selected by removing its lamp
+    send(DALI_CMD_PHYSICAL_SELECTION, 0);
+    search(0);
+    lampFailure(DALI_FAILURE_OPEN_CIRCUIT);
+    send(DALI_CMD_PROGRAM_SHORT_ADDRESS, SHORT(9));
+    hostCheck("PROGRAM SHORT ADDRESS (physical selection)", send(DALI_CMD_VERIFY_SHORT_ADDRESS, SHORT(9)), DALI_YES);
+    lampFailure(0);
+    send(DALI_CMD_PHYSICAL_SELECTION, 0);
+    search(random);
+    hostCheck("COMPARE after PHYSICAL SELECTION", send(DALI_CMD_COMPARE, 0), DALI_YES);
+
+    send(DALI_CMD_TERMINATE, 0);
+    hostCheck("COMPARE after TERMINATE", send(DALI_CMD_COMPARE, 0), ANSWER_NONE);
+    twice(DALI_CMD_INITIALIZE, DALI_MASK);
+    hostCheck("INITIALISE (gear without short address)", send(DALI_CMD_COMPARE, 0), ANSWER_NONE);
+    twice(DALI_CMD_INITIALIZE, SHORT(9));
+    hostCheck("INITIALISE (short address)", send(DALI_CMD_COMPARE, 0), DALI_YES);
+    hostBusWait(SPECIAL_MODE_US);
+    hostCheck("COMPARE after 15 minutes", send(DALI_CMD_COMPARE, 0), ANSWER_NONE);
+}
+
+
+// ADC conversions of a working string at 'adcTemperature', then the derating update
+static void heat(uint16_t adcTemperature)
+{
+    uint32_t n;
+
+    for (n = 0; n < (uint32_t)TEMPERATURE_SAMPLE_PERIOD * TEMPERATURE_SAMPLES; n++) {
+        switch (*gear.admux & 0x0f) {
+        case CURRENT_ADC_CHANNEL:
+            *gear.adc = CURRENT_ADC(CURRENT_NOMINAL_MA);
+            break;
+        case CURRENT_VOLTAGE_CHANNEL:
+            *gear.adc = CURRENT_VOLTAGE_ADC(32000);
+            break;
+        default:
+            *gear.adc = adcTemperature;
+            break;
+        }
+        gear.adcVect();
+    }
+    hostBusWait(2 * TEMPERATURE_UPDATE_PERIOD * 1000UL);
+}
+
+
+// Thermal state in bank 2, both builds (device type 8 has no thermal queries)
+static void testThermal(void)
+{
+    long temperature;
+
+    powerUp("thermal");
+    hostCheck("thermal state", readCounter(DALI_MEMORY_DIAG_THERMAL), TEMPERATURE_NORMAL);
+    heat(ADC_DERATING);
+    hostCheck("thermal state (derating)", readCounter(DALI_MEMORY_DIAG_THERMAL), TEMPERATURE_DERATING);
+    temperature = readCounter(DALI_MEMORY_DIAG_TEMPERATURE);
+    hostCheck("temperature", (temperature > TEMPERATURE_DERATING_START * TEMPERATURE_UNIT) &&
+                             (temperature < TEMPERATURE_DERATING_END * TEMPERATURE_UNIT), 1);
+#ifndef DALI_DT8
+    hostCheck("QUERY THERMAL OVERLOAD (derating)", queryDT(DALI_CMD_QUERY_THERMAL_OVERLOAD), DALI_YES);
+#endif
+}
+
+
+static void testMemoryBanks(void)
+{
+    long frames;
+    long records;
+
+    powerUp("memory banks");
+    send(DALI_CMD_DTR1, DALI_MEMORY_BANK_0);
+    send(DALI_CMD_DTR, 0);
+    hostCheck("bank 0 last location", query(DALI_CMD_READ_MEMORY_LOCATION), 0x02);
+    hostCheck("bank 0 reserved", query(DALI_CMD_READ_MEMORY_LOCATION), 0xff);
+    hostCheck("bank 0 last bank", query(DALI_CMD_READ_MEMORY_LOCATION), DALI_MEMORY_BANK_LAST);
+    hostCheck("bank 0 after the last location", query(DALI_CMD_READ_MEMORY_LOCATION), ANSWER_NONE);
+    hostCheck("DTR incremented by the reads", query(DALI_CMD_QUERY_CONTENT_DTR), 3);
+    hostCheck("QUERY CONTENT DTR1", query(DALI_CMD_QUERY_CONTENT_DTR1), DALI_MEMORY_BANK_0);
+    send(DALI_CMD_DTR2, 0x5a);
+    hostCheck("QUERY CONTENT DTR2", query(DALI_CMD_QUERY_CONTENT_DTR2), 0x5a);
+    send(DALI_CMD_DTR1, 1);
+    send(DALI_CMD_DTR, 0);
+    hostCheck("bank 1 not implemented", query(DALI_CMD_READ_MEMORY_LOCATION), ANSWER_NONE);
+
+    send(DALI_CMD_DTR1, DALI_MEMORY_BANK_DIAG);
+    send(DALI_CMD_DTR, 0);
+    hostCheck("diagnostics last location", query(DALI_CMD_READ_MEMORY_LOCATION), DALI_MEMORY_DIAG_LAST);
+    frames = framesSent + 3;
+    hostCheck("frames received", readCounter(DALI_MEMORY_DIAG_FRAMES), frames);
+    hostCheck("frame errors", readCounter(DALI_MEMORY_DIAG_FRAME_ERRORS), 0);
+    sendFrame(BROADCAST, DALI_CMD_QUERY_STATUS, (1 << FEM) | (3 << STP0));
+    sendFrame(BROADCAST, DALI_CMD_QUERY_STATUS, (1 << FEM) | (3 << STP0));
+    hostCheck("frame errors", readCounter(DALI_MEMORY_DIAG_FRAME_ERRORS), 2);
+    frames = framesSent + 3 - 2;
+    hostCheck("frames received (errors excluded)", readCounter(DALI_MEMORY_DIAG_FRAMES), frames);
+    send(BROADCAST, DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL);
+    hostBusWait(200000UL);
+    hostCheck("send twice timeouts", readCounter(DALI_MEMORY_DIAG_SEND_TWICE), 1);
+    records = readCounter(DALI_MEMORY_DIAG_EEPROM);
+    store(DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL, 200);
+    hostCheck("eeprom records", readCounter(DALI_MEMORY_DIAG_EEPROM), records + 1);
+    hostCheck("dropped frames", readCounter(DALI_MEMORY_DIAG_DROPPED), 0);
+    hostCheck("queue overflows", readCounter(DALI_MEMORY_DIAG_OVERFLOWS), 0);
+    hostCheck("bus failures", readCounter(DALI_MEMORY_DIAG_BUS_FAILURES), 0);
+    hostCheck("bus recoveries", readCounter(DALI_MEMORY_DIAG_BUS_RECOVERIES), 0);
+    hostCheck("latency readable", readCounter(DALI_MEMORY_DIAG_LATENCY) != ANSWER_NONE, 1);
+    *gear.bootTime = 40;                // Measured by main()
+    hostCheck("boot time", readCounter(DALI_MEMORY_DIAG_BOOT_TIME), 40);
+
+    // Reset of the counters, the measurements are kept
+    send(DALI_CMD_DTR, DALI_MEMORY_DIAG_CONTROL);
+    hostCheck("WRITE MEMORY LOCATION not enabled", send(DALI_CMD_WRITE_MEMORY_LOCATION, DALI_MEMORY_DIAG_RESET), ANSWER_NONE);
+    twice(BROADCAST, DALI_CMD_ENABLE_WRITE_MEMORY);
+    send(DALI_CMD_DTR1, DALI_MEMORY_BANK_DIAG);
+    send(DALI_CMD_DTR, DALI_MEMORY_DIAG_CONTROL);
+    hostCheck("WRITE MEMORY LOCATION", send(DALI_CMD_WRITE_MEMORY_LOCATION, DALI_MEMORY_DIAG_RESET), DALI_MEMORY_DIAG_RESET);
+    hostCheck("DTR incremented by the write", query(DALI_CMD_QUERY_CONTENT_DTR), DALI_MEMORY_DIAG_CONTROL + 1);
+    hostCheck("frames received after reset", readCounter(DALI_MEMORY_DIAG_FRAMES), 4);
+    hostCheck("frame errors after reset", readCounter(DALI_MEMORY_DIAG_FRAME_ERRORS), 0);
+    hostCheck("send twice timeouts after reset", readCounter(DALI_MEMORY_DIAG_SEND_TWICE), 0);
+    hostCheck("boot time after reset", readCounter(DALI_MEMORY_DIAG_BOOT_TIME), 40);
+    hostCheck("write to a counter", send(DALI_CMD_WRITE_MEMORY_LOCATION, DALI_MEMORY_DIAG_RESET), ANSWER_NONE);
+    query(DALI_CMD_QUERY_ACTUAL_LEVEL);
+    send(DALI_CMD_DTR, DALI_MEMORY_DIAG_CONTROL);
+    hostCheck("write disabled by another command", send(DALI_CMD_WRITE_MEMORY_LOCATION, DALI_MEMORY_DIAG_RESET), ANSWER_NONE);
+}
+
+
+static void testReset(void)
+{
+    powerUp("reset");
+    store(DALI_CMD_STORE_THE_DTR_AS_MAX_LEVEL, 200);
+    store(DALI_CMD_STORE_THE_DTR_AS_FADE_RATE, 3);
+    store(DALI_CMD_STORE_THE_DTR_AS_SCENE + 2, 40);
+    twice(BROADCAST, DALI_CMD_ADD_TO_GROUP + 1);
+    store(DALI_CMD_STORE_DTR_AS_SHORT_ADDRESS, 4);
+
+    twice(BROADCAST, DALI_CMD_RESET);
+    hostCheck("QUERY STATUS", query(DALI_CMD_QUERY_STATUS), STATUS_RESET_STATE | STATUS_LAMP_ON);
+    hostCheck("max level", query(DALI_CMD_QUERY_MAX_LEVEL), 254);
+    hostCheck("fade rate", query(DALI_CMD_QUERY_FADE_SETTINGS), 0x07);
+    hostCheck("scene 2", query(DALI_CMD_QUERY_SCENE_LEVEL + 2), DALI_MASK);
+    hostCheck("groups", query(DALI_CMD_QUERY_GROUPS_0_7), 0);
+    hostCheck("group address", send(GROUP(1), DALI_CMD_QUERY_ACTUAL_LEVEL), ANSWER_NONE);
+    hostCheck("short address kept", send(SHORT(4), DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+}
+
+
+static void printLatency(Row *row)
+{
+    char code[16];
+
+    if (row == directArcPowerRow) {
+        snprintf(code, sizeof(code), "-");
+    }
+    else if (row->first == row->last) {
+        snprintf(code, sizeof(code), "0x%02x", row->first);
+    }
+    else {
+        snprintf(code, sizeof(code), "0x%02x-0x%02x", row->first, row->last);
+    }
+    printf("%-32s %-10s %8lu", row->name, code, (unsigned long)row->executed);
+    if (row->answer != LATENCY_NONE) {
+        printf(" %12ld", (long)row->answer);
+    }
+    else {
+        printf(" %12s", "-");
+    }
+    if (row->output != LATENCY_NONE) {
+        printf(" %12ld\n", (long)row->output);
+    }
+    else {
+        printf(" %12s\n", "-");
+    }
+}
+
+
+int main(void)
+{
+    uint8_t n;
+
+    hostGearLoad(&gear, 0);
+    hostBusAttach(&gear);
+    hostBus.cycleStart = pwmCycle;
+#ifdef DALI_DT8
+    hostBus.cycleEnd = colourCycle;
+#endif
+    hostBus.answerStart = answerStart;
+    hostBus.frameReceived = frameReceived;
+    hostBus.frameDone = frameDone;
+    rowsInit();
+
+    testPowerUp();
+    testDirectArcPower();
+    testIndirectArcPower();
+    testConfiguration();
+    testBusFailure();
+    testSendTwice();
+    testScenesAndGroups();
+    testShortAddress();
+#ifndef DALI_DT8
+    testDeviceType6();
+#else
+    testDeviceType8();
+    testColourFade();
+#endif
+    testSpecialCommands();
+    testMemoryBanks();
+    testThermal();
+    testReset();
+
+    // Every command is executed at least once
+    hostTestName = "coverage";
+    for (n = 0; n < rowCount; n++) {
+        if (rows[n].executed == 0) {
+            hostFailures++;
+            fprintf(stderr, "FAIL %s: %s is not tested\n", hostTestName, rows[n].name);
+        }
+    }
+
+    printf("Latency from the end of the forward frame, worst case (us)\n");
+    printf("answer: start of the backward frame, output: PWM cycle with the new duty\n\n");
+    printf("%-32s %-10s %8s %12s %12s\n", "command", "code", "executed", "answer", "output");
+    for (n = 0; n < rowCount; n++) {
+        if (!rows[n].special) {
+            printLatency(&rows[n]);
+        }
+    }
+    printf("\n%-32s %-10s\n", "special command", "address");
+    for (n = 0; n < rowCount; n++) {
+        if (rows[n].special) {
+            printLatency(&rows[n]);
+        }
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "commandTest: %lu checks, %lu failures, %u commands\n",
+            (unsigned long)hostChecks, (unsigned long)hostFailures, rowCount);
+    hostGearUnload(&gear);
+    return hostFailures != 0;
+}
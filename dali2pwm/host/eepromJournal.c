@@ -0,0 +1,223 @@
+// Host test of the eeprom journal (eepromCache.c)
+//
+// - power failures: a record is cut after each possible byte, the registers
+//   loaded at the next boot must be the previous or the new ones
+// - boot: eeprom accesses and estimated duration of eepromCacheInit(), nothing
+//   written before eepromCacheRelease()
+// - endurance: write cycles of the most written cell per register change
+//
+// Build and run: make
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hostEeprom.h"
+#include "../eepromCache.h"
+
+#define F_CPU                   16000000UL
+#define EEPROM_ENDURANCE        100000UL    // Write/erase cycles (datasheet)
+
+// Cycle estimates of the avr-libc routines (avr-gcc -Os)
+#define CYCLES_READ_CALL        20          // eeprom_read_xxx() call and setup
+#define CYCLES_READ_BYTE        12          // Each byte read (4 cycles CPU halt included)
+#define CYCLES_CRC_BYTE         44          // _crc_ibutton_update()
+
+#define ENDURANCE_COMMITS       (EEPROM_SLOT_COUNT * 1000UL)
+
+static uint8_t failures = 0;
+
+
+// Run the eeprom ready interrupt until the journal is up to date or 'bytes' bytes are written
+static void commit(uint16_t bytes)
+{
+    while ((EECR & (1 << EERIE)) && (bytes > 0)) {
+        hostEepromReadyVect();
+        bytes--;
+    }
+}
+
+
+// Power up: load the journal, write in background at once
+static void boot(void)
+{
+    eepromCacheInit();
+    eepromCacheRelease();
+}
+
+
+static void fill(uint8_t seed)
+{
+    uint8_t n;
+
+    for (n = 0; n < EEPROM_CACHE_SIZE; n++) {
+        eepromCacheWrite(n, (uint8_t)(seed + n * 7));
+    }
+}
+
+
+static uint8_t check(uint8_t seed)
+{
+    uint8_t n;
+
+    for (n = 0; n < EEPROM_CACHE_SIZE; n++) {
+        if (eepromCacheRead(n) != (uint8_t)(seed + n * 7)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static void testPowerFailure(void)
+{
+    uint8_t seed = 0;
+    uint16_t cut;
+    uint16_t round;
+    uint32_t cuts = 0;
+
+    hostEepromErase();
+    boot();
+    fill(seed);
+    commit(0xffff);
+
+    // Several rounds, so that records are cut in every slot
+    for (round = 0; round < 2 * EEPROM_SLOT_COUNT; round++) {
+        for (cut = 0; cut <= EEPROM_RECORD_SIZE; cut++) {
+            fill(seed + 1);
+            commit(cut);
+            boot();                 // Power failure, reboot
+            cuts++;
+            if (check(seed + 1)) {
+                seed++;
+            }
+            else if (!check(seed)) {
+                printf("FAIL power failure: round %u, cut after %u bytes\n", round, cut);
+                failures++;
+                return;
+            }
+        }
+        fill(++seed);
+        commit(0xffff);
+    }
+    printf("power failure: %lu cuts, previous or new registers loaded every time\n", (unsigned long)cuts);
+}
+
+
+static void testLegacyImport(void)
+{
+    uint8_t n;
+
+    hostEepromErase();
+    for (n = 0; n < EEPROM_CACHE_SIZE; n++) {
+        hostEeprom[n] = (uint8_t)(0xAA + n * 7);
+    }
+    boot();
+    if (!check(0xAA)) {
+        printf("FAIL legacy import: registers not loaded\n");
+        failures++;
+        return;
+    }
+    commit(0xffff);
+    boot();
+    if (!check(0xAA)) {
+        printf("FAIL legacy import: registers not converted to a record\n");
+        failures++;
+        return;
+    }
+    printf("legacy layout: imported and converted to a record\n");
+}
+
+
+static void testBoot(void)
+{
+    uint32_t cycles;
+    uint32_t fixedCycles;
+
+    hostEepromErase();
+    boot();
+    fill(0x10);
+    commit(0xffff);
+
+    hostEepromReads = 0;
+    hostEepromReadCalls = 0;
+    boot();
+    cycles = hostEepromReadCalls * CYCLES_READ_CALL +
+             hostEepromReads * CYCLES_READ_BYTE +
+             EEPROM_OFFSET_CRC * CYCLES_CRC_BYTE;
+
+    // Fixed layout: one eeprom_read_byte() per register
+    fixedCycles = EEPROM_CACHE_SIZE * (CYCLES_READ_CALL + CYCLES_READ_BYTE);
+
+    printf("boot: %lu bytes read in %lu calls (%u sequence numbers + 1 block), ~%lu cycles = %lu us at %lu MHz\n",
+           (unsigned long)hostEepromReads, (unsigned long)hostEepromReadCalls, EEPROM_SLOT_COUNT,
+           (unsigned long)cycles, (unsigned long)(cycles / (F_CPU / 1000000UL)), F_CPU / 1000000UL);
+    printf("boot: fixed layout, %u bytes read in %u calls, ~%lu cycles = %lu us\n",
+           EEPROM_CACHE_SIZE, EEPROM_CACHE_SIZE,
+           (unsigned long)fixedCycles, (unsigned long)(fixedCycles / (F_CPU / 1000000UL)));
+
+    // New device: the default registers are written after the first light
+    hostEepromErase();
+    eepromCacheInit();
+    fill(0x30);
+    if (EECR & (1 << EERIE)) {
+        printf("FAIL boot: eeprom written before eepromCacheRelease()\n");
+        failures++;
+        return;
+    }
+    eepromCacheRelease();
+    commit(0xffff);
+    boot();
+    if (!check(0x30)) {
+        printf("FAIL boot: registers held at boot not written\n");
+        failures++;
+        return;
+    }
+    printf("boot: nothing written before eepromCacheRelease(), then one record\n");
+}
+
+
+static void testEndurance(void)
+{
+    uint32_t n;
+    uint32_t maxWrites = 0;
+    uint32_t totalWrites = 0;
+    uint16_t cell;
+
+    hostEepromErase();
+    boot();
+    fill(0x20);
+    commit(0xffff);
+    memset(hostEepromWrites, 0, sizeof(hostEepromWrites));
+
+    // Worst case: the same register changes each time (e.g. a scene stored again and again)
+    for (n = 0; n < ENDURANCE_COMMITS; n++) {
+        eepromCacheWrite(13, (uint8_t)n);
+        commit(0xffff);
+    }
+
+    for (cell = 0; cell <= E2END; cell++) {
+        totalWrites += hostEepromWrites[cell];
+        if (hostEepromWrites[cell] > maxWrites) {
+            maxWrites = hostEepromWrites[cell];
+        }
+    }
+
+    printf("endurance: %lu changes, %lu byte writes, most written cell %lu times\n",
+           (unsigned long)ENDURANCE_COMMITS, (unsigned long)totalWrites, (unsigned long)maxWrites);
+    printf("endurance: ~%lu changes of one register before wear-out (fixed layout: %lu)\n",
+           (unsigned long)((uint64_t)EEPROM_ENDURANCE * ENDURANCE_COMMITS / maxWrites), EEPROM_ENDURANCE);
+}
+
+
+int main(void)
+{
+    printf("eeprom journal: %u slots of %u bytes (%u registers)\n",
+           EEPROM_SLOT_COUNT, EEPROM_RECORD_SIZE, EEPROM_CACHE_SIZE);
+
+    testPowerFailure();
+    testLegacyImport();
+    testBoot();
+    testEndurance();
+
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "hostEeprom.h"
+
+uint8_t hostEeprom[E2END + 1];
+uint32_t hostEepromWrites[E2END + 1];       // Write cycles of each cell
+uint32_t hostEepromReads = 0;               // Bytes read
+uint32_t hostEepromReadCalls = 0;           // Calls to eeprom_read_xxx()
+
+
+void hostEepromErase(void)
+{
+    memset(hostEeprom, 0xff, sizeof(hostEeprom));
+    memset(hostEepromWrites, 0, sizeof(hostEepromWrites));
+    hostEepromReads = 0;
+    hostEepromReadCalls = 0;
+}
+
+
+uint8_t eeprom_read_byte(const uint8_t *address)
+{
+    hostEepromReads++;
+    hostEepromReadCalls++;
+    return hostEeprom[(uintptr_t)address];
+}
+
+
+void eeprom_read_block(void *destination, const void *source, size_t length)
+{
+    hostEepromReads += length;
+    hostEepromReadCalls++;
+    memcpy(destination, &hostEeprom[(uintptr_t)source], length);
+}
+
+
+void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+    if (hostEeprom[(uintptr_t)address] != value) {
+        hostEeprom[(uintptr_t)address] = value;
+        hostEepromWrites[(uintptr_t)address]++;
+    }
+}
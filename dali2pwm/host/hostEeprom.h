@@ -0,0 +1,18 @@
+#ifndef _HOST_EEPROM_H_
+#define _HOST_EEPROM_H_
+
+#include <inttypes.h>
+
+#include <avr/io.h>
+
+extern uint8_t hostEeprom[E2END + 1];
+extern uint32_t hostEepromWrites[E2END + 1];
+extern uint32_t hostEepromReads;
+extern uint32_t hostEepromReadCalls;
+
+void hostEepromErase(void);
+
+// EE_READY_vect of eepromCache.c
+void hostEepromReadyVect(void);
+
+#endif
@@ -0,0 +1,326 @@
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <avr/io.h>
+
+#include "hostGear.h"
+
+static char hostGearDirectory[] = "/tmp/hostGearXXXXXX";
+static uint8_t hostGearCopies = 0;      // Copies in hostGearDirectory
+
+HostBus hostBus;
+
+const char *hostTestName = "";
+uint32_t hostChecks = 0;
+uint32_t hostFailures = 0;
+
+
+static void *hostGearSymbol(HostGear *g, const char *name)
+{
+    void *symbol = dlsym(g->library, name);
+
+    if (symbol == NULL) {
+        fprintf(stderr, "hostGear: %s\n", dlerror());
+        exit(2);
+    }
+    return symbol;
+}
+
+
+// Copy the library for gear n, and power it up
+void hostGearLoad(HostGear *g, uint8_t n)
+{
+    char command[200];
+
+    if ((hostGearCopies == 0) && (mkdtemp(hostGearDirectory) == NULL)) {
+        perror("hostGear");
+        exit(2);
+    }
+    snprintf(g->path, sizeof(g->path), "%s/gear%u.so", hostGearDirectory, n);
+    snprintf(command, sizeof(command), "cp %s %s", HOST_GEAR_LIBRARY, g->path);
+    if (system(command) != 0) {
+        exit(2);
+    }
+    hostGearCopies++;
+    g->library = NULL;
+    hostGearPowerUp(g);
+}
+
+
+// The library is loaded again (variables and registers at their reset value), with
+// 'eeprom' (erased if NULL), bus idle (high), supply up, then the inits of main() in
+// its order but pwmInit() (it waits for the PLL lock): registers, first output update,
+// other peripherals
+static void hostGearBoot(HostGear *g, const uint8_t *eeprom)
+{
+    void (*eepromErase)(void);
+    void (*currentInit)(void);
+    void (*temperatureInit)(void);
+    void (*entropyInit)(void);
+#ifdef POWER_FAIL_SENSE
+    void (*powerFailInit)(void);
+#endif
+    void (*daliInit)(void);
+    volatile uint8_t *pind;
+    uint8_t n;
+
+    if (g->library != NULL) {
+        dlclose(g->library);
+    }
+    g->library = dlopen(g->path, RTLD_NOW | RTLD_LOCAL);
+    if (g->library == NULL) {
+        fprintf(stderr, "hostGear: %s\n", dlerror());
+        exit(2);
+    }
+
+    g->rxVect = (void (*)(void))hostGearSymbol(g, "USART_RX_vect");
+    g->tickVect = (void (*)(void))hostGearSymbol(g, "TIMER0_COMP_A_vect");
+    g->captureVect = (void (*)(void))hostGearSymbol(g, "TIMER1_CAPT_vect");
+    g->busFailureVect = (void (*)(void))hostGearSymbol(g, "TIMER1_COMPA_vect");
+    g->adcVect = (void (*)(void))hostGearSymbol(g, "ADC_vect");
+    g->watchdogVect = (void (*)(void))hostGearSymbol(g, "WDT_vect");
+    g->pwmCycleVect = (void (*)(void))hostGearSymbol(g, "PSC0_EC_vect");
+    g->eepromVect = (void (*)(void))hostGearSymbol(g, "hostEepromReadyVect");
+#ifdef POWER_FAIL_SENSE
+    g->powerFailVect = (void (*)(void))hostGearSymbol(g, "ANALOG_COMP_0_vect");
+#endif
+    g->controlGear = (void (*)(uint8_t))hostGearSymbol(g, "daliControlGear");
+    g->outputPower = (uint8_t (*)(uint8_t))hostGearSymbol(g, "daliOutputPower");
+    g->fadeOutput = (void (*)(uint8_t, uint8_t))hostGearSymbol(g, "fadeOutput");
+    g->isPending = (uint8_t (*)(void))hostGearSymbol(g, "daliIsPending");
+    g->pwmDuty = (uint16_t (*)(uint8_t))hostGearSymbol(g, "pwmDuty");
+    g->fadeLevel = (uint8_t (*)(uint8_t))hostGearSymbol(g, "fadeLevel");
+    g->lampState = (uint8_t (*)(void))hostGearSymbol(g, "currentLampFailure");
+#ifdef DALI_DT8
+    g->fadeMix = (uint16_t (*)(void))hostGearSymbol(g, "fadeMix");
+#endif
+    g->eucsrc = hostGearSymbol(g, "EUCSRC");
+    g->eudr = hostGearSymbol(g, "EUDR");
+    g->udr = hostGearSymbol(g, "UDR");
+    g->eecr = hostGearSymbol(g, "EECR");
+    g->tcnt0 = hostGearSymbol(g, "TCNT0");
+    g->tcnt1l = hostGearSymbol(g, "TCNT1L");
+    g->tcnt1 = hostGearSymbol(g, "TCNT1");
+    g->icr1l = hostGearSymbol(g, "ICR1L");
+    g->icr1 = hostGearSymbol(g, "ICR1");
+    g->admux = hostGearSymbol(g, "ADMUX");
+    g->adc = hostGearSymbol(g, "ADC");
+    g->pim0 = hostGearSymbol(g, "PIM0");
+    g->ocr0ra = hostGearSymbol(g, "OCR0RA");
+    g->ocr2ra = hostGearSymbol(g, "OCR2RA");
+    g->ocr2sb = hostGearSymbol(g, "OCR2SB");
+    g->acsr = hostGearSymbol(g, "ACSR");
+    g->eeprom = hostGearSymbol(g, "hostEeprom");
+    g->eepromWrites = hostGearSymbol(g, "hostEepromWrites");
+    g->txState = hostGearSymbol(g, "txState");
+    g->bootTime = hostGearSymbol(g, "bootTime");
+    g->dali = hostGearSymbol(g, "daliGears");
+    g->cmd = hostGearSymbol(g, "daliCmd");
+    eepromErase = (void (*)(void))hostGearSymbol(g, "hostEepromErase");
+    currentInit = (void (*)(void))hostGearSymbol(g, "currentInit");
+    temperatureInit = (void (*)(void))hostGearSymbol(g, "temperatureInit");
+    entropyInit = (void (*)(void))hostGearSymbol(g, "entropyInit");
+#ifdef POWER_FAIL_SENSE
+    powerFailInit = (void (*)(void))hostGearSymbol(g, "powerFailInit");
+#endif
+    daliInit = (void (*)(void))hostGearSymbol(g, "daliInit");
+    pind = hostGearSymbol(g, "PIND");
+
+    eepromErase();
+    if (eeprom != NULL) {
+        memcpy(g->eeprom, eeprom, E2END + 1);
+    }
+    *pind = (1 << PIND4);
+    *g->acsr = (1 << AC0O);
+    g->lampFailure = 0;
+    daliInit();
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        g->fadeOutput(n, g->outputPower(n));
+    }
+    currentInit();
+    temperatureInit();
+    entropyInit();
+#ifdef POWER_FAIL_SENSE
+    powerFailInit();
+#endif
+}
+
+
+// Power up with an erased eeprom
+void hostGearPowerUp(HostGear *g)
+{
+    hostGearBoot(g, NULL);
+}
+
+
+// Power up again, the eeprom keeps its content
+void hostGearPowerCycle(HostGear *g)
+{
+    uint8_t eeprom[E2END + 1];
+
+    memcpy(eeprom, g->eeprom, sizeof(eeprom));
+    hostGearBoot(g, eeprom);
+}
+
+
+// Main loop of the gear, and the eeprom writes it started
+void hostGearRun(HostGear *g)
+{
+    uint8_t n;
+
+    g->controlGear(g->lampFailure);
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        g->fadeOutput(n, g->outputPower(n));
+    }
+    while (*g->eecr & (1 << EERIE)) {
+        g->eepromVect();
+    }
+}
+
+
+// Main loop, while something is pending (it sleeps otherwise)
+void hostGearMainLoop(HostGear *g)
+{
+    while (g->isPending()) {
+        hostGearRun(g);
+    }
+}
+
+
+// The last gear unloaded removes the directory of the copies
+void hostGearUnload(HostGear *g)
+{
+    dlclose(g->library);
+    g->library = NULL;
+    unlink(g->path);
+    if (--hostGearCopies == 0) {
+        rmdir(hostGearDirectory);
+    }
+}
+
+
+void hostCheck(const char *what, long actual, long expected)
+{
+    hostChecks++;
+    if (actual != expected) {
+        hostFailures++;
+        fprintf(stderr, "FAIL %s: %s is %ld, expected %ld\n", hostTestName, what, actual, expected);
+    }
+}
+
+
+// The bus drives gear 'g' from time 0, without hooks
+void hostBusAttach(HostGear *g)
+{
+    memset(&hostBus, 0, sizeof(hostBus));
+    hostBus.gear = g;
+    hostBus.nextTick = TICK_US / 2;
+    hostBus.nextCycle = PWM_CYCLE_US;
+    hostBus.answer = ANSWER_NONE;
+}
+
+
+// 1ms tick, a backward frame may start
+static void hostBusTick(void)
+{
+    HostGear *g = hostBus.gear;
+    uint8_t state = *g->txState;
+    uint32_t delay;
+
+    *g->tcnt0 = 0;
+    g->tickVect();
+    if ((state == DALI_TX_WAIT) && (*g->txState == DALI_TX_SENDING)) {
+        hostBus.answer = *g->udr;
+        delay = hostBus.now - hostBus.frameEnd;
+        if ((delay < BW_MIN_US) || (delay > BW_WINDOW_US)) {
+            hostCheck("backward frame start (us after the forward frame, 7-22 Te)", delay, BW_MIN_US);
+        }
+        if (hostBus.answerStart != NULL) {
+            hostBus.answerStart();
+        }
+    }
+}
+
+
+// End of a PWM cycle: the PSC loads the last duty written, then the fade steps
+static void hostBusCycle(void)
+{
+    HostGear *g = hostBus.gear;
+
+    if (hostBus.cycleStart != NULL) {
+        hostBus.cycleStart();
+    }
+    if (*g->pim0 & (1 << PEOPE0)) {
+        g->pwmCycleVect();
+    }
+    if (hostBus.cycleEnd != NULL) {
+        hostBus.cycleEnd();
+    }
+}
+
+
+// Run the interrupts and the main loop until 'time'
+void hostBusAdvance(uint32_t time)
+{
+    while ((hostBus.nextTick <= time) || (hostBus.nextCycle <= time)) {
+        if (hostBus.nextTick <= hostBus.nextCycle) {
+            hostBus.now = hostBus.nextTick;
+            hostBusTick();
+            hostBus.nextTick += TICK_US;
+        }
+        else {
+            hostBus.now = hostBus.nextCycle;
+            hostBusCycle();
+            hostBus.nextCycle += PWM_CYCLE_US;
+        }
+        hostGearMainLoop(hostBus.gear);
+    }
+    hostBus.now = time;
+}
+
+
+void hostBusWait(uint32_t time)
+{
+    hostBusAdvance(hostBus.now + time);
+}
+
+
+// Send a forward frame (EUCSRC 'status' at its end), wait for the backward frame
+// and the settling time
+// Returns the answer or ANSWER_NONE
+int16_t hostBusSendFrame(uint8_t address, uint8_t command, uint8_t status)
+{
+    HostGear *g = hostBus.gear;
+    uint32_t end = hostBus.now + FW_FRAME_US;
+
+    hostBus.frameEnd = end;
+    hostBusAdvance(end);
+    hostBus.answer = ANSWER_NONE;
+    if (hostBus.frameReceived != NULL) {
+        hostBus.frameReceived();
+    }
+
+    *g->tcnt0 = (uint8_t)((hostBus.now + TICK_US - hostBus.nextTick) / 4);
+    *g->eucsrc = status;
+    *g->eudr = address;
+    *g->udr = command;
+    g->rxVect();
+    hostGearMainLoop(g);
+    if (hostBus.frameDone != NULL) {
+        hostBus.frameDone();
+    }
+
+    hostBusAdvance(end + BW_WINDOW_US);
+    if (hostBus.answer != ANSWER_NONE) {
+        hostBusAdvance(end + BW_WINDOW_US + BW_FRAME_US + SETTLING_US);
+    }
+    return hostBus.answer;
+}
+
+
+int16_t hostBusSend(uint8_t address, uint8_t command)
+{
+    return hostBusSendFrame(address, command, 3 << STP0);      // 2 stop bits, no frame error
+}
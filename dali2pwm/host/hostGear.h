@@ -0,0 +1,145 @@
+#ifndef _HOST_GEAR_H_
+#define _HOST_GEAR_H_
+
+#include <inttypes.h>
+
+#include "../dali.h"
+#include "../pwm.h"
+
+// A gear of a host simulation: a private copy of daliGear.so (the dali2pwm
+// modules built for the PC). dlopen() returns the same instance for the same
+// file, each gear is loaded from its own copy: its registers, eeprom and DALI
+// registers are its own.
+// Programs built with -DDALI_DT8 load the tunable white gear (daliGearDT8.so), with
+// -DDALI_GEAR_COUNT=3 the gear of three instances (daliGear3.so), with
+// -DPOWER_FAIL_SENSE the gear with the supply monitor (daliGearPF.so).
+
+#ifdef DALI_DT8
+    #define HOST_GEAR_LIBRARY   "./daliGearDT8.so"
+#elif DALI_GEAR_COUNT == 3
+    #define HOST_GEAR_LIBRARY   "./daliGear3.so"
+#elif defined(POWER_FAIL_SENSE)
+    #define HOST_GEAR_LIBRARY   "./daliGearPF.so"
+#else
+    #define HOST_GEAR_LIBRARY   "./daliGear.so"
+#endif
+
+typedef struct {
+    char path[64];                  // Private copy of the library
+    void *library;
+
+    // Interrupt vectors
+    void (*rxVect)(void);           // USART_RX_vect
+    void (*tickVect)(void);         // TIMER0_COMP_A_vect
+    void (*captureVect)(void);      // TIMER1_CAPT_vect
+    void (*busFailureVect)(void);   // TIMER1_COMPA_vect (bus low for BUS_FAILURE_TIMEOUT)
+    void (*adcVect)(void);          // ADC_vect
+    void (*watchdogVect)(void);     // WDT_vect
+    void (*pwmCycleVect)(void);     // PSC0_EC_vect (fading)
+    void (*eepromVect)(void);       // EE_READY_vect
+#ifdef POWER_FAIL_SENSE
+    void (*powerFailVect)(void);    // ANALOG_COMP_0_vect
+#endif
+
+    void (*controlGear)(uint8_t);
+    uint8_t (*outputPower)(uint8_t);    // daliOutputPower()
+    void (*fadeOutput)(uint8_t, uint8_t);
+    uint8_t (*isPending)(void);     // daliIsPending()
+    uint16_t (*pwmDuty)(uint8_t);
+    uint8_t (*fadeLevel)(uint8_t);
+    uint8_t (*lampState)(void);     // currentLampFailure()
+#ifdef DALI_DT8
+    uint16_t (*fadeMix)(void);
+#endif
+
+    // Registers
+    volatile uint8_t *eucsrc;
+    volatile uint8_t *eudr;
+    volatile uint8_t *udr;
+    volatile uint8_t *eecr;
+    volatile uint8_t *tcnt0;
+    volatile uint8_t *tcnt1l;
+    volatile uint16_t *tcnt1;
+    volatile uint8_t *icr1l;
+    volatile uint16_t *icr1;
+    volatile uint8_t *admux;
+    volatile uint16_t *adc;
+    volatile uint8_t *pim0;
+    volatile uint16_t *ocr0ra;      // Duty of PSCOUT00 (warm string with DALI_DT8)
+    volatile uint16_t *ocr2ra;      // Duty of PSCOUT20 (cool string, or instance 1)
+    volatile uint16_t *ocr2sb;      // PWM_TOP - duty of PSCOUT21 (instance 2)
+    volatile uint8_t *acsr;         // AC0O: supply above the power failure threshold
+    uint8_t *eeprom;                // E2END + 1 bytes
+    uint32_t *eepromWrites;         // Write cycles of each eeprom cell
+
+    volatile uint8_t *txState;
+    uint16_t *bootTime;             // Measured by main(), not run on the host
+    DaliRegisters *dali;            // daliGears[DALI_GEAR_COUNT]
+    DaliCmd *cmd;                   // Last command decoded
+
+    uint8_t lampFailure;            // DALI_FAILURE_xxx, input of the main loop
+} HostGear;
+
+void hostGearLoad(HostGear *g, uint8_t n);
+void hostGearPowerUp(HostGear *g);
+void hostGearPowerCycle(HostGear *g);
+void hostGearRun(HostGear *g);
+void hostGearMainLoop(HostGear *g);
+void hostGearUnload(HostGear *g);
+
+// DALI timing (IEC 62386-101), Te = 416.67us
+#define TE_NS                   416667UL
+#define FW_FRAME_US             (38 * TE_NS / 1000)     // Start bit, 16 bits, stop bits
+#define BW_FRAME_US             (22 * TE_NS / 1000)     // Start bit, 8 bits, stop bits
+#define BW_MIN_US               (7 * TE_NS / 1000)      // BW frame starts 7 to 22 Te after the FW frame
+#define BW_WINDOW_US            (22 * TE_NS / 1000)
+#define SETTLING_US             (22 * TE_NS / 1000)     // After a BW frame, before the next FW frame
+#define TICK_US                 1000UL
+#define PWM_CYCLE_US            ((uint32_t)((PWM_TOP + 1) * 1000000ULL / F_PWM_CLK))
+
+// Address bytes
+#define BROADCAST_DAPC          0xfe
+#define BROADCAST               0xff
+#define SHORT_DAPC(a)           ((a) << 1)
+#define SHORT(a)                (((a) << 1) | 1)
+#define GROUP_DAPC(g)           (0x80 | ((g) << 1))
+#define GROUP(g)                (0x81 | ((g) << 1))
+
+#define ANSWER_NONE             -1
+
+// Simulated bus of one gear (hostBusAttach()): the interrupts (1ms tick, PWM
+// cycles) and the main loop run in simulated time, their execution time is not
+// simulated. A forward frame is received at its end, its backward frame is
+// captured when the tick starts it (checked against the 7-22 Te window).
+// The hooks let a test observe the bus, NULL if not used.
+typedef struct {
+    HostGear *gear;
+    uint32_t now;                   // Simulated time (us)
+    uint32_t nextTick;
+    uint32_t nextCycle;
+    uint32_t frameEnd;              // End of the last forward frame
+    int16_t answer;                 // Its backward frame, ANSWER_NONE if none
+
+    void (*cycleStart)(void);       // End of a PWM cycle: the PSC loads the last duty written
+    void (*cycleEnd)(void);         // After the end of cycle interrupt (fading)
+    void (*answerStart)(void);      // Backward frame starts
+    void (*frameReceived)(void);    // End of a forward frame, before the gear receives it
+    void (*frameDone)(void);        // Forward frame executed by the main loop
+} HostBus;
+
+extern HostBus hostBus;
+
+void hostBusAttach(HostGear *g);
+void hostBusAdvance(uint32_t time);
+void hostBusWait(uint32_t time);
+int16_t hostBusSendFrame(uint8_t address, uint8_t command, uint8_t status);
+int16_t hostBusSend(uint8_t address, uint8_t command);
+
+// Checks of the host tests, the failures on stderr
+extern const char *hostTestName;
+extern uint32_t hostChecks;
+extern uint32_t hostFailures;
+
+void hostCheck(const char *what, long actual, long expected);
+
+#endif
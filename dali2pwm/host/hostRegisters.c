@@ -0,0 +1,30 @@
+#include <avr/io.h>
+
+// AT90PWM216 registers, see avr/io.h
+
+volatile uint8_t DDRB, PORTB, PINB;
+volatile uint8_t DDRD, PORTD, PIND;
+
+volatile uint8_t CLKPR, PRR, SMCR, MCUSR;
+
+volatile uint8_t WDTCSR;
+
+volatile uint8_t TCCR0A, TCCR0B, OCR0A, OCR0B, TIMSK0, TIFR0, TCNT0;
+
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1, TCNT1L, TCNT1H, ICR1L, ICR1H;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+
+volatile uint8_t PLLCSR, PCNF0, PCTL0, PSOC0, PIM0, PIFR0;
+volatile uint16_t OCR0SA, OCR0RA, OCR0SB, OCR0RB;
+volatile uint8_t PCNF2, PCTL2, PSOC2;
+volatile uint16_t OCR2SA, OCR2RA, OCR2SB, OCR2RB;
+
+volatile uint8_t AC0CON, ACSR;
+
+volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0, DIDR1;
+volatile uint16_t ADC;
+
+volatile uint8_t UCSRA, UCSRB, UCSRC, UBRRH, UBRRL, UDR;
+volatile uint8_t EUCSRA, EUCSRB, EUCSRC, MUBRRH, MUBRRL, EUDR;
+
+volatile uint8_t EECR;
@@ -0,0 +1,185 @@
+// Open and shorted led string detection (current.c)
+//
+// The ADC interrupt of the gear (daliGear.so, see hostGear.h) converts I_LAMP and
+// V_LAMP alternately, one conversion per PWM cycle. The samples model a working
+// string, an open string, a shorted string and a supply loss:
+//   - classification: open, short, recovery, no failure without supply
+//   - timing: PWM cycles from the change of the string to the debounced state,
+//     against CURRENT_FAILURE_DEBOUNCE, and the main loop woken up at once
+//   - glitches shorter than the debounce, output off: the state is kept
+//   - the DALI status and the failure status of device type 6
+//
+// Build and run (from this directory): make check, or ./lampFailureTest
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+
+#include "hostGear.h"
+#include "../dali.h"
+#include "../current.h"
+#include "../temperature.h"
+#include "../pwm.h"
+
+#define DEBOUNCE_CYCLES         (2 * CURRENT_FAILURE_DEBOUNCE)  // One V_LAMP sample every other cycle
+#define MAX_CYCLES              1000
+
+#define ADC_TEMPERATURE         1000
+
+// Led string: on phase current and string voltage
+#define STRING_WORKING          CURRENT_NOMINAL_MA, 32000
+#define STRING_OPEN             0, 32000
+#define STRING_SHORT            CURRENT_NOMINAL_MA, 500
+#define STRING_NO_SUPPLY        0, 0
+
+static HostGear gear;
+
+
+// One PWM cycle: conversion of the channel selected by the previous one
+static void cycle(uint16_t mA, uint16_t mV)
+{
+    switch (*gear.admux & 0x0f) {
+    case CURRENT_ADC_CHANNEL:
+        *gear.adc = CURRENT_ADC(mA);
+        break;
+    case CURRENT_VOLTAGE_CHANNEL:
+        *gear.adc = CURRENT_VOLTAGE_ADC(mV);
+        break;
+    default:
+        *gear.adc = ADC_TEMPERATURE;
+        break;
+    }
+    gear.adcVect();
+}
+
+
+static void cycles(uint16_t count, uint16_t mA, uint16_t mV)
+{
+    while (count--) {
+        cycle(mA, mV);
+    }
+}
+
+
+// PWM cycles until the debounced state is 'state' (MAX_CYCLES if never)
+// The main loop must be woken up in the same cycle.
+static uint16_t cyclesUntil(uint8_t state, uint16_t mA, uint16_t mV)
+{
+    uint16_t n;
+
+    for (n = 1; n < MAX_CYCLES; n++) {
+        cycle(mA, mV);
+        if (gear.lampState() == state) {
+            hostCheck("main loop woken up", gear.isPending(), 1);
+            return n;
+        }
+    }
+    return MAX_CYCLES;
+}
+
+
+// The main loop passes the state to daliControlGear(), see main()
+static void mainLoop(void)
+{
+    gear.lampFailure = gear.lampState();
+    hostGearMainLoop(&gear);
+}
+
+
+static void powerUp(const char *name)
+{
+    hostTestName = name;
+    hostGearPowerUp(&gear);
+    mainLoop();
+}
+
+
+// Debounced within DEBOUNCE_CYCLES, up to 3 more: the first V_LAMP sample may
+// come with the previous I_LAMP sample, a temperature conversion takes 1-2 cycles
+static void checkTiming(const char *what, uint16_t n)
+{
+    fprintf(stderr, "%s: %u PWM cycles (%lu us)\n", what, n, (unsigned long)n * PWM_CYCLE_US);
+    hostCheck(what, (n >= DEBOUNCE_CYCLES - 1) && (n <= DEBOUNCE_CYCLES + 3), 1);
+}
+
+
+static void testClassification(void)
+{
+    powerUp("classification");
+    cycles(MAX_CYCLES, STRING_WORKING);
+    hostCheck("working string", gear.lampState(), 0);
+
+    checkTiming("open string", cyclesUntil(DALI_FAILURE_OPEN_CIRCUIT, STRING_OPEN));
+    mainLoop();
+    hostCheck("lamp failure", gear.dali->status.lampFailure, 1);
+    hostCheck("open circuit", gear.dali->failureStatus.openCircuit, 1);
+    hostCheck("short circuit", gear.dali->failureStatus.shortCircuit, 0);
+
+    checkTiming("recovery", cyclesUntil(0, STRING_WORKING));
+    mainLoop();
+    hostCheck("lamp failure after recovery", gear.dali->status.lampFailure, 0);
+    hostCheck("open circuit after recovery", gear.dali->failureStatus.openCircuit, 0);
+
+    checkTiming("shorted string", cyclesUntil(DALI_FAILURE_SHORT_CIRCUIT, STRING_SHORT));
+    mainLoop();
+    hostCheck("lamp failure (short)", gear.dali->status.lampFailure, 1);
+    hostCheck("short circuit", gear.dali->failureStatus.shortCircuit, 1);
+    hostCheck("open circuit (short)", gear.dali->failureStatus.openCircuit, 0);
+
+    // Short to open: the new failure is debounced too
+    checkTiming("short to open", cyclesUntil(DALI_FAILURE_OPEN_CIRCUIT, STRING_OPEN));
+    checkTiming("open to working", cyclesUntil(0, STRING_WORKING));
+
+    // No current and no string voltage: supply loss, not a lamp failure
+    cycles(MAX_CYCLES, STRING_NO_SUPPLY);
+    hostCheck("supply loss", gear.lampState(), 0);
+}
+
+
+static void testGlitches(void)
+{
+    powerUp("glitches");
+    cycles(MAX_CYCLES, STRING_WORKING);
+
+    // One V_LAMP sample less than the debounce, several times
+    cycles(DEBOUNCE_CYCLES - 2, STRING_OPEN);
+    cycles(2, STRING_WORKING);
+    cycles(DEBOUNCE_CYCLES - 2, STRING_SHORT);
+    cycles(2, STRING_WORKING);
+    hostCheck("glitches ignored", gear.lampState(), 0);
+    hostCheck("main loop not woken up", gear.isPending(), 0);
+
+    // Failure reported: a glitch of the working string does not clear it
+    cyclesUntil(DALI_FAILURE_OPEN_CIRCUIT, STRING_OPEN);
+    cycles(DEBOUNCE_CYCLES - 2, STRING_WORKING);
+    cycles(2, STRING_OPEN);
+    hostCheck("failure kept", gear.lampState(), DALI_FAILURE_OPEN_CIRCUIT);
+}
+
+
+// Output off: the samples are not the led current, the state is held
+static void testOutputOff(void)
+{
+    powerUp("output off");
+    cyclesUntil(DALI_FAILURE_OPEN_CIRCUIT, STRING_OPEN);
+    gear.fadeOutput(0, 0);
+    hostCheck("duty below the minimum", gear.pwmDuty(0) < CURRENT_MIN_DUTY, 1);
+    cycles(MAX_CYCLES, STRING_NO_SUPPLY);
+    hostCheck("failure held while off", gear.lampState(), DALI_FAILURE_OPEN_CIRCUIT);
+    gear.fadeOutput(0, 254);
+    checkTiming("working string after off", cyclesUntil(0, STRING_WORKING));
+}
+
+
+int main(void)
+{
+    hostGearLoad(&gear, 0);
+
+    testClassification();
+    testGlitches();
+    testOutputOff();
+
+    hostGearUnload(&gear);
+    fprintf(stderr, "lampFailureTest: %lu checks, %lu failures\n", (unsigned long)hostChecks, (unsigned long)hostFailures);
+    return hostFailures != 0;
+}
@@ -0,0 +1,264 @@
+// Host test of the software Manchester codec (manchester.c, DALI_SOFT_MANCHESTER)
+//
+// - decoder: forward frames with nominal timing and with edge jitter are received,
+//   a bus 30% too slow is rejected (frame errors), backward frames of other gears
+//   are ignored, the echo of the frame sent is ignored
+// - encoder: levels and timing of the half bits of a backward frame
+// - histogram of the half bits measured by the decoder
+//
+// Build and run: make
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "../manchester.h"
+
+#define TE_US                   (1000000.0 / 2400)  // Half bit at 1200 bauds
+#define FRAMES                  200
+
+void TIMER1_COMPB_vect(void);
+
+volatile uint16_t rxErrorCount = 0;
+
+static uint8_t failures = 0;
+static uint16_t receivedCount;
+static uint8_t receivedAddress, receivedCommand;
+static double busTime = 1000.0;         // us
+
+
+// Forward frame decoded, see dali.c
+void daliReceive(uint8_t address, uint8_t command)
+{
+    receivedAddress = address;
+    receivedCommand = command;
+    receivedCount++;
+}
+
+
+static void expect(uint8_t ok, const char *what)
+{
+    if (!ok) {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+
+// Edge at 'us' (input capture, see TIMER1_CAPT_vect in dali.c)
+static void edge(double us, uint8_t level)
+{
+    uint16_t time = (uint16_t)(us / MANCHESTER_TICK_US + 0.5);
+
+    TCNT1 = time;
+    manchesterEdge(time, level);
+}
+
+
+// Bus idle: the end of frame timeout expires
+static void idle(void)
+{
+    if (TIMSK1 & (1 << OCIE1B)) {
+        TCNT1 = OCR1B;
+        TIMER1_COMPB_vect();
+    }
+    busTime += 20 * TE_US;
+}
+
+
+// Frame of 'bits' bits (MSB first) after the start bit, each half bit 'scale' Te long,
+// each edge moved by up to +/- 'jitter' / 2 Te (the intervals by up to +/- 'jitter' Te)
+static void sendFrame(uint16_t frame, uint8_t bits, double scale, double jitter)
+{
+    uint8_t halves = 2 * (bits + 1);
+    uint8_t level = 1;
+    uint8_t half, bit, next;
+    double offset;
+
+    for (half = 0; half < halves; half++) {
+        bit = (half < 2) ? 1 : (frame >> (bits - 1 - ((half - 2) >> 1))) & 1;
+        next = (half & 1) ? bit : !bit;
+        if (next != level) {
+            offset = jitter * TE_US * ((double)rand() / RAND_MAX - 0.5);
+            edge(busTime + half * scale * TE_US + offset, next);
+            level = next;
+        }
+    }
+
+    // Stop bits: the bus returns high
+    if (level == 0) {
+        edge(busTime + halves * scale * TE_US, 1);
+    }
+    busTime += (halves + 4) * scale * TE_US;
+    idle();
+}
+
+
+static void clearHistogram(void)
+{
+    memset((void *)manchesterHistogram, 0, sizeof(manchesterHistogram));
+}
+
+
+// 'FRAMES' random forward frames, returns the number received correctly
+static uint16_t sendForwardFrames(double scale, double jitter)
+{
+    uint16_t frame, n;
+    uint16_t correct = 0;
+
+    for (n = 0; n < FRAMES; n++) {
+        frame = rand() & 0xffff;
+        receivedCount = 0;
+        sendFrame(frame, 16, scale, jitter);
+        if ((receivedCount == 1) && (receivedAddress == (frame >> 8)) && (receivedCommand == (frame & 0xff))) {
+            correct++;
+        }
+    }
+    return correct;
+}
+
+
+static void testDecoder(void)
+{
+    uint16_t correct, errors;
+
+    rxErrorCount = 0;
+    correct = sendForwardFrames(1.0, 0.0);
+    printf("decoder: nominal timing, %u/%u frames received, %u errors\n", correct, FRAMES, rxErrorCount);
+    expect((correct == FRAMES) && (rxErrorCount == 0), "decoder: nominal timing");
+
+    rxErrorCount = 0;
+    correct = sendForwardFrames(1.0, 0.15);
+    printf("decoder: +/-15%% half bit jitter, %u/%u frames received, %u errors\n", correct, FRAMES, rxErrorCount);
+    expect((correct == FRAMES) && (rxErrorCount == 0), "decoder: jitter");
+
+    rxErrorCount = 0;
+    correct = sendForwardFrames(1.3, 0.0);
+    errors = rxErrorCount;
+    printf("decoder: 30%% slow, %u/%u frames received, %u errors\n", correct, FRAMES, errors);
+    expect((correct == 0) && (errors == FRAMES), "decoder: slow frames rejected");
+
+    // The decoder recovers
+    correct = sendForwardFrames(1.0, 0.0);
+    expect((correct == FRAMES) && (rxErrorCount == errors), "decoder: recovery after errors");
+
+    rxErrorCount = 0;
+    receivedCount = 0;
+    sendFrame(0x5a, 8, 1.0, 0.0);
+    sendFrame(0xff, 8, 1.0, 0.0);
+    sendFrame(0x00, 8, 1.0, 0.0);
+    printf("decoder: backward frames, %u received, %u errors\n", receivedCount, rxErrorCount);
+    expect((receivedCount == 0) && (rxErrorCount == 0), "decoder: backward frames ignored");
+}
+
+
+static void testEncoder(void)
+{
+    uint8_t data = 0xa6;
+    uint8_t halves[MANCHESTER_BACKWARD_HALVES + 4];
+    uint8_t half, bit, expected;
+    uint8_t timing = 1;
+    uint16_t last;
+
+    PORTD = 0;
+    DDRD = 0;
+    manchesterInit();
+    expect((PORTD & (1 << MANCHESTER_TX_PIN)) && (DDRD & (1 << MANCHESTER_TX_PIN)), "encoder: TX idle high");
+
+    TCNT1 = 0xfff0;                     // Timer1 wraps during the frame
+    manchesterSend(data);
+    halves[0] = (PORTD >> MANCHESTER_TX_PIN) & 1;
+    last = TCNT1;
+    for (half = 1; half < sizeof(halves); half++) {
+        if ((uint16_t)(OCR1B - last) != MANCHESTER_TE_TICKS) {
+            timing = 0;
+        }
+
+        // Echo of the frame sent on DALI RX: ignored
+        receivedCount = 0;
+        edge(OCR1B * MANCHESTER_TICK_US, 0);
+        last = OCR1B;
+        TCNT1 = OCR1B;
+        TIMER1_COMPB_vect();
+        halves[half] = (PORTD >> MANCHESTER_TX_PIN) & 1;
+    }
+    TCNT1 = OCR1B;
+    TIMER1_COMPB_vect();
+    expect(!(TIMSK1 & (1 << OCIE1B)), "encoder: end of frame");
+    expect(receivedCount == 0, "encoder: echo ignored");
+
+    printf("encoder: 0x%02x sent as ", data);
+    for (half = 0; half < sizeof(halves); half++) {
+        bit = (half < 2) ? 1 : (data >> (7 - ((half - 2) >> 1))) & 1;
+        expected = (half >= MANCHESTER_BACKWARD_HALVES) ? 1 : ((half & 1) ? bit : !bit);
+        printf("%c", halves[half] ? '-' : '_');
+        if (halves[half] != expected) {
+            printf("\nFAIL encoder: half bit %u is %u\n", half, halves[half]);
+            failures++;
+            break;
+        }
+    }
+    printf(", half bit %lu ticks (%lu us)\n", (unsigned long)MANCHESTER_TE_TICKS,
+           (unsigned long)MANCHESTER_TE_TICKS * MANCHESTER_TICK_US);
+    expect(timing, "encoder: half bit timing");
+
+    // The receiver works after the frame sent
+    rxErrorCount = 0;
+    busTime = TCNT1 * MANCHESTER_TICK_US + 20 * TE_US;
+    expect(sendForwardFrames(1.0, 0.0) == FRAMES, "encoder: receiver after the frame sent");
+}
+
+
+static void testHistogram(void)
+{
+    uint32_t total = 0;
+    uint16_t peak = 0;
+    uint8_t bin, peakBin = 0, n;
+
+    clearHistogram();
+    sendForwardFrames(1.0, 0.15);
+
+    printf("histogram: %u frames, +/-15%% half bit jitter\n", FRAMES);
+    for (bin = 0; bin < MANCHESTER_HISTOGRAM_SIZE; bin++) {
+        total += manchesterHistogram[bin];
+        if (manchesterHistogram[bin] > peak) {
+            peak = manchesterHistogram[bin];
+            peakBin = bin;
+        }
+    }
+    for (bin = 0; bin < MANCHESTER_HISTOGRAM_SIZE; bin++) {
+        printf("  %s%2lu ticks %3lu us %5u ", (bin == 0) ? "<=" : (bin == MANCHESTER_HISTOGRAM_SIZE - 1) ? ">=" : "  ",
+               (unsigned long)MANCHESTER_HISTOGRAM_FIRST + bin, (unsigned long)(MANCHESTER_HISTOGRAM_FIRST + bin) * MANCHESTER_TICK_US,
+               manchesterHistogram[bin]);
+        for (n = 0; n < (uint32_t)manchesterHistogram[bin] * 50 / peak; n++) {
+            printf("#");
+        }
+        printf("\n");
+    }
+
+    // A forward frame has 34 half bits, the last one ends without an edge if it is high
+    expect((total >= 33UL * FRAMES) && (total <= 34UL * FRAMES), "histogram: half bits counted");
+    expect((MANCHESTER_HISTOGRAM_FIRST + peakBin >= MANCHESTER_TE_TICKS - 1) &&
+           (MANCHESTER_HISTOGRAM_FIRST + peakBin <= MANCHESTER_TE_TICKS + 1), "histogram: peak at Te");
+    expect((manchesterHistogram[0] == 0) && (manchesterHistogram[MANCHESTER_HISTOGRAM_SIZE - 1] == 0),
+           "histogram: no half bit out of the jitter range");
+}
+
+
+int main(void)
+{
+    printf("manchester: Te %lu ticks, half bit %lu-%lu ticks (%lu-%lu us), timeout %lu ticks\n",
+           (unsigned long)MANCHESTER_TE_TICKS, (unsigned long)MANCHESTER_TE_MIN_TICKS,
+           (unsigned long)MANCHESTER_TE_MAX_TICKS, (unsigned long)MANCHESTER_TE_MIN_US,
+           (unsigned long)MANCHESTER_TE_MAX_US, (unsigned long)MANCHESTER_STOP_TICKS);
+
+    srand(1);
+    testDecoder();
+    testEncoder();
+    testHistogram();
+
+    return (failures == 0) ? 0 : 1;
+}
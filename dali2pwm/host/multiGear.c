@@ -0,0 +1,284 @@
+// Several DALI control gears on one MCU (DALI_GEAR_COUNT, see dali.h)
+//
+// One gear library built with -DDALI_GEAR_COUNT=3 (daliGear3.so, see hostGear.h)
+// receives forward frames on the simulated bus of hostGear.h: the instances are
+// checked through the answers, their registers and the three PSC outputs
+// (PSCOUT00, PSCOUT20, PSCOUT21).
+//   - commissioning: the binary search finds the three random addresses of the MCU
+//   - addressing: short addresses, groups and broadcast reach the right instances
+//   - scenes and fades: each instance has its own, the fades run together
+//
+// Build and run (from this directory): make check, or ./multiGear
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+
+#include "hostGear.h"
+#include "../dali.h"
+#include "../daliCmd.h"
+#include "../pwm.h"
+
+#if DALI_GEAR_COUNT != 3
+    #error "multiGear is built with -DDALI_GEAR_COUNT=3"
+#endif
+
+#define RANDOMISE_US            100000UL                // New random address available after 100ms
+#define FIRST_ADDRESS           10      // Short addresses given by the commissioning
+
+static HostGear gear;
+
+
+static void sendTwice(uint8_t address, uint8_t command)
+{
+    hostBusSend(address, command);
+    hostBusSend(address, command);
+}
+
+
+static void setSearchAddress(uint32_t address)
+{
+    hostBusSend(DALI_CMD_SEARCH_ADDRESS_H, address >> 16);
+    hostBusSend(DALI_CMD_SEARCH_ADDRESS_M, address >> 8);
+    hostBusSend(DALI_CMD_SEARCH_ADDRESS_L, address);
+}
+
+
+// At least one instance has a random address <= address
+static uint8_t compare(uint32_t address)
+{
+    setSearchAddress(address);
+    return hostBusSend(DALI_CMD_COMPARE, 0) != ANSWER_NONE;
+}
+
+
+// Duty of each output, from the PSC registers
+static uint16_t outputDuty(uint8_t channel)
+{
+    switch (channel) {
+        case 0:
+            return *gear.ocr0ra;
+        case 1:
+            return *gear.ocr2ra;
+        default:
+            return PWM_TOP - *gear.ocr2sb;      // PSCOUT21 is on from OCR2SB to the end of the cycle
+    }
+}
+
+
+// Level of each instance and its output
+static void checkLevels(const char *what, uint8_t level0, uint8_t level1, uint8_t level2)
+{
+    uint8_t levels[DALI_GEAR_COUNT] = { level0, level1, level2 };
+    char name[80];
+    uint8_t n;
+
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        snprintf(name, sizeof(name), "%s, instance %u level", what, n);
+        hostCheck(name, gear.dali[n].actualDimLevel, levels[n]);
+        snprintf(name, sizeof(name), "%s, instance %u output", what, n);
+        hostCheck(name, outputDuty(n), gear.pwmDuty(n));
+        if (levels[n] == 0) {
+            hostCheck(name, outputDuty(n), 0);
+        }
+    }
+}
+
+
+static void powerUp(const char *name)
+{
+    hostTestName = name;
+    hostGearPowerUp(&gear);
+    hostGearMainLoop(&gear);
+}
+
+
+// Without eeprom, the short address of an instance is its index
+static void testPowerUp(void)
+{
+    uint8_t n;
+
+    powerUp("power up");
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        hostCheck("default short address", gear.dali[n].shortAddress, n);
+        hostCheck("QUERY ACTUAL LEVEL", hostBusSend(SHORT(n), DALI_CMD_QUERY_ACTUAL_LEVEL), 254);
+    }
+    hostCheck("unused short address", hostBusSend(SHORT(DALI_GEAR_COUNT), DALI_CMD_QUERY_ACTUAL_LEVEL), ANSWER_NONE);
+    checkLevels("power on level", 254, 254, 254);
+}
+
+
+// Binary search of the random addresses: one short address per instance
+static void testCommissioning(void)
+{
+    uint8_t shortAddress = FIRST_ADDRESS;
+    uint32_t low;
+    uint32_t high;
+    uint32_t middle;
+    uint8_t n;
+    uint8_t m;
+
+    powerUp("commissioning");
+    sendTwice(DALI_CMD_INITIALIZE, 0x00);       // All gear
+    sendTwice(DALI_CMD_RANDOMISE, 0x00);
+    hostBusWait(RANDOMISE_US);
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        for (m = n + 1; m < DALI_GEAR_COUNT; m++) {
+            hostCheck("distinct random addresses",
+                  (gear.dali[n].randomAddressH == gear.dali[m].randomAddressH) &&
+                  (gear.dali[n].randomAddressM == gear.dali[m].randomAddressM) &&
+                  (gear.dali[n].randomAddressL == gear.dali[m].randomAddressL), 0);
+        }
+    }
+
+    while ((shortAddress < FIRST_ADDRESS + 8) && compare(0xffffff)) {
+        low = 0;
+        high = 0xffffff;
+        while (low < high) {
+            middle = low + (high - low) / 2;
+            if (compare(middle)) {
+                high = middle;
+            }
+            else {
+                low = middle + 1;
+            }
+        }
+        setSearchAddress(low);
+        hostBusSend(DALI_CMD_PROGRAM_SHORT_ADDRESS, SHORT(shortAddress));
+        hostCheck("VERIFY SHORT ADDRESS", hostBusSend(DALI_CMD_VERIFY_SHORT_ADDRESS, SHORT(shortAddress)), DALI_YES);
+        hostBusSend(DALI_CMD_WITHDRAW, 0);
+        shortAddress++;
+    }
+    hostBusSend(DALI_CMD_TERMINATE, 0);
+    hostCheck("instances found", shortAddress - FIRST_ADDRESS, DALI_GEAR_COUNT);
+
+    // Each instance got its own short address, in the order of the random addresses
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        hostCheck("short address programmed", gear.dali[n].shortAddress >= FIRST_ADDRESS, 1);
+        hostCheck("short address programmed", gear.dali[n].shortAddress < FIRST_ADDRESS + DALI_GEAR_COUNT, 1);
+        for (m = n + 1; m < DALI_GEAR_COUNT; m++) {
+            hostCheck("distinct short addresses", gear.dali[n].shortAddress != gear.dali[m].shortAddress, 1);
+        }
+        hostCheck("special mode of each instance", gear.dali[n].specialModeTimeout, 0);
+    }
+    hostCheck("old short address", hostBusSend(SHORT(0), DALI_CMD_QUERY_ACTUAL_LEVEL), ANSWER_NONE);
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        hostBusSend(SHORT_DAPC(FIRST_ADDRESS + n), 100 + n);
+    }
+    for (n = 0; n < DALI_GEAR_COUNT; n++) {
+        hostCheck("new short address", hostBusSend(SHORT(gear.dali[n].shortAddress), DALI_CMD_QUERY_ACTUAL_LEVEL),
+              100 + gear.dali[n].shortAddress - FIRST_ADDRESS);
+    }
+}
+
+
+// Groups and broadcast fan out to the instances addressed only
+static void testAddressing(void)
+{
+    powerUp("addressing");
+    sendTwice(SHORT(0), DALI_CMD_ADD_TO_GROUP + 5);
+    sendTwice(SHORT(2), DALI_CMD_ADD_TO_GROUP + 5);
+    sendTwice(SHORT(1), DALI_CMD_ADD_TO_GROUP + 9);
+    hostCheck("group of instance 0", gear.dali[0].group, 1 << 5);
+    hostCheck("group of instance 1", gear.dali[1].group, 1 << 9);
+    hostCheck("group of instance 2", gear.dali[2].group, 1 << 5);
+
+    hostBusSend(GROUP_DAPC(5), 200);
+    checkLevels("group 5 DAPC", 200, 254, 200);
+    hostBusSend(GROUP_DAPC(9), 50);
+    checkLevels("group 9 DAPC", 200, 50, 200);
+    hostBusSend(SHORT_DAPC(2), 120);
+    checkLevels("short address DAPC", 200, 50, 120);
+    hostCheck("group without instance", hostBusSend(GROUP(3), DALI_CMD_QUERY_ACTUAL_LEVEL), ANSWER_NONE);
+
+    // Instances sharing a short address: both execute, the first one answers
+    hostBusSend(DALI_CMD_DTR, 0);
+    sendTwice(SHORT(1), DALI_CMD_STORE_DTR_AS_SHORT_ADDRESS);
+    hostCheck("shared short address", gear.dali[1].shortAddress, 0);
+    hostBusSend(SHORT_DAPC(0), 80);
+    checkLevels("shared short address DAPC", 80, 80, 120);
+    hostCheck("shared short address answer", hostBusSend(SHORT(0), DALI_CMD_QUERY_ACTUAL_LEVEL), 80);
+
+    hostBusSend(BROADCAST_DAPC, 70);
+    checkLevels("broadcast DAPC", 70, 70, 70);
+    hostBusSend(BROADCAST, DALI_CMD_IMMEDIATE_OFF);
+    checkLevels("broadcast OFF", 0, 0, 0);
+}
+
+
+// Scenes are stored per instance, GO TO SCENE recalls each one
+static void testScenes(void)
+{
+    powerUp("scenes");
+    hostBusSend(DALI_CMD_DTR, 60);
+    sendTwice(SHORT(0), DALI_CMD_STORE_THE_DTR_AS_SCENE + 3);
+    hostBusSend(DALI_CMD_DTR, 160);
+    sendTwice(SHORT(1), DALI_CMD_STORE_THE_DTR_AS_SCENE + 3);
+    hostCheck("scene of instance 0", gear.dali[0].scene[3], 60);
+    hostCheck("scene of instance 1", gear.dali[1].scene[3], 160);
+    hostCheck("scene of instance 2", gear.dali[2].scene[3], 0xff);
+
+    hostBusSend(BROADCAST_DAPC, 55);
+    hostBusSend(BROADCAST, DALI_CMD_GO_TO_SCENE + 3);
+    checkLevels("GO TO SCENE", 60, 160, 55);     // No scene 3 in instance 2: level kept
+    hostCheck("scene query", hostBusSend(SHORT(1), DALI_CMD_QUERY_SCENE_LEVEL + 3), 160);
+}
+
+
+// Each instance fades with its own fade time, all the outputs step in the same
+// PWM cycles
+static void testFades(void)
+{
+    powerUp("fades");
+    hostBusSend(BROADCAST_DAPC, 100);
+    hostBusSend(DALI_CMD_DTR, 4);                          // 2s
+    sendTwice(SHORT(0), DALI_CMD_STORE_THE_DTR_AS_FADE_TIME);
+    hostBusSend(DALI_CMD_DTR, 2);                          // 1s
+    sendTwice(SHORT(1), DALI_CMD_STORE_THE_DTR_AS_FADE_TIME);
+
+    hostBusSend(BROADCAST_DAPC, 254);
+    hostCheck("instance 2 without fade time", gear.dali[2].actualDimLevel, 254);
+    hostCheck("instance 0 starts fading", gear.fadeLevel(0) < 110, 1);
+    hostCheck("instance 1 starts fading", gear.fadeLevel(1) < 110, 1);
+    hostCheck("instance 0 fading", gear.dali[0].status.fadeRunning, 1);
+    hostCheck("instance 1 fading", gear.dali[1].status.fadeRunning, 1);
+    hostCheck("instance 2 fading", gear.dali[2].status.fadeRunning, 0);
+
+    hostBusWait(500000);
+    hostCheck("instance 0 halfway (1/4)", gear.fadeLevel(0) > 100 && gear.fadeLevel(0) < 160, 1);
+    hostCheck("instance 1 halfway (1/2)", gear.fadeLevel(1) > 160 && gear.fadeLevel(1) < 220, 1);
+    hostCheck("outputs follow the fades", gear.fadeLevel(0) < gear.fadeLevel(1), 1);
+
+    hostBusWait(600000);
+    hostCheck("instance 0 still fading", gear.dali[0].status.fadeRunning, 1);
+    hostCheck("instance 1 fade ended", gear.dali[1].status.fadeRunning, 0);
+    hostCheck("instance 1 level", gear.dali[1].actualDimLevel, 254);
+
+    // Stopping the fade of one instance does not stop the others
+    hostBusSend(DALI_CMD_DTR, 0);
+    sendTwice(SHORT(1), DALI_CMD_STORE_THE_DTR_AS_FADE_TIME);
+    hostBusSend(SHORT_DAPC(1), 80);
+    hostCheck("instance 0 fading on", gear.dali[0].status.fadeRunning, 1);
+    hostCheck("instance 1 without fade time", gear.dali[1].actualDimLevel, 80);
+
+    hostBusWait(1000000);
+    checkLevels("fades ended", 254, 80, 254);
+    hostCheck("PWM interrupt stopped", *gear.pim0 & (1 << PEOPE0), 0);
+}
+
+
+int main(void)
+{
+    hostGearLoad(&gear, 0);
+    hostBusAttach(&gear);
+
+    testPowerUp();
+    testCommissioning();
+    testAddressing();
+    testScenes();
+    testFades();
+
+    hostGearUnload(&gear);
+    fprintf(stderr, "multiGear: %lu checks, %lu failures\n", (unsigned long)hostChecks, (unsigned long)hostFailures);
+    return hostFailures != 0;
+}
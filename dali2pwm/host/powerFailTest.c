@@ -0,0 +1,263 @@
+// Power failure save and last active level (POWER_FAIL_SENSE, see powerFail.h)
+//
+// The gear library built with -DPOWER_FAIL_SENSE (daliGearPF.so, see hostGear.h)
+// receives forward frames on the simulated bus of hostGear.h. The supply fails
+// (analog comparator 0 output low), the gear is powered up again with its eeprom:
+//   - powerOnLevel MASK restores the level, and resumes an interrupted fade
+//   - the first PWM cycle with the restored level, against BOOT_TIME_TARGET_US
+//   - the outputs are off during a dip, and back at the level reached afterwards
+//   - the bytes written when the supply fails, against POWER_FAIL_HOLD_UP_US
+//   - a save cut by the end of the hold-up time, other power on levels and RESET
+//
+// Build and run (from this directory): make check, or ./powerFailTest
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+
+#include "hostGear.h"
+#include "../dali.h"
+#include "../daliCmd.h"
+#include "../eepromCache.h"
+#include "../powerFail.h"
+#include "../pwm.h"
+
+#define FADE_TIME_2S            4       // STORE DTR AS FADE TIME: 2s
+#define JOURNAL_US              (1000UL * BOOT_BACKGROUND_DELAY)   // Registers in eeprom (held after power up)
+
+static HostGear gear;
+static uint32_t firstLight;         // End of the first PWM cycle with the output on, 0 if none
+static uint32_t firstLightWrites;   // Eeprom bytes written before it
+
+
+static void store(uint8_t command, uint8_t value)
+{
+    hostBusSend(DALI_CMD_DTR, value);
+    hostBusSend(BROADCAST, command);
+    hostBusSend(BROADCAST, command);
+}
+
+
+static void powerUp(const char *name)
+{
+    hostTestName = name;
+    hostGearPowerUp(&gear);
+    hostGearMainLoop(&gear);
+}
+
+
+// Eeprom bytes written since power up
+static uint32_t eepromWrites(void)
+{
+    uint32_t writes = 0;
+    uint16_t n;
+
+    for (n = 0; n <= E2END; n++) {
+        writes += gear.eepromWrites[n];
+    }
+    return writes;
+}
+
+
+// Supply falls below the threshold: returns the eeprom bytes written
+static uint32_t supplyFails(void)
+{
+    uint32_t writes = eepromWrites();
+
+    *gear.acsr &= ~(1 << AC0O);
+    gear.powerFailVect();
+    return eepromWrites() - writes;
+}
+
+
+static void supplyBack(void)
+{
+    *gear.acsr |= (1 << AC0O);
+    gear.powerFailVect();
+    hostGearMainLoop(&gear);
+}
+
+
+// Supply fails, then the gear is powered up again (the eeprom keeps its content)
+static void powerCycle(void)
+{
+    supplyFails();
+    hostGearPowerCycle(&gear);
+}
+
+
+// powerOnLevel MASK: the level at the power failure is back at power on
+static void testLastActiveLevel(void)
+{
+    uint32_t writes;
+
+    powerUp("last active level");
+    store(DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL, DALI_MASK);
+    hostCheck("QUERY POWER ON LEVEL", hostBusSend(BROADCAST, DALI_CMD_QUERY_POWER_ON_LEVEL), DALI_LAST_ACTIVE_LEVEL);
+    hostBusWait(JOURNAL_US);
+
+    hostBusSend(BROADCAST_DAPC, 120);
+    hostCheck("level", gear.dali->actualDimLevel, 120);
+
+    writes = supplyFails();
+    hostCheck("output off at once", *gear.ocr0ra, 0);
+    hostCheck("level kept", gear.dali->actualDimLevel, 120);
+    hostCheck("bytes written (2 levels and CRC)", writes, EEPROM_POWER_FAIL_SIZE);
+    fprintf(stderr, "power failure: %lu bytes written, %lu us (hold-up time needed %lu us)\n",
+            (unsigned long)writes, (unsigned long)(writes * EEPROM_WRITE_US), (unsigned long)POWER_FAIL_HOLD_UP_US);
+    hostCheck("save within the hold-up time", writes * EEPROM_WRITE_US <= POWER_FAIL_HOLD_UP_US, 1);
+
+    hostGearPowerCycle(&gear);
+    hostCheck("level at power on", gear.dali->actualDimLevel, 120);
+    hostCheck("output at power on", *gear.ocr0ra, gear.pwmDuty(0));
+    hostCheck("output on", *gear.ocr0ra != 0, 1);
+    hostCheck("QUERY ACTUAL LEVEL", hostBusSend(BROADCAST, DALI_CMD_QUERY_ACTUAL_LEVEL), 120);
+    hostCheck("QUERY POWER FAILURE", hostBusSend(BROADCAST, DALI_CMD_QUERY_POWER_FAILURE) != ANSWER_NONE, 1);
+
+    // Same level at the next failure: nothing to write (eeprom endurance)
+    hostCheck("bytes written, level unchanged", supplyFails(), 0);
+    hostGearPowerCycle(&gear);
+    hostCheck("level at the second power on", gear.dali->actualDimLevel, 120);
+
+    // Off at the power failure: off at power on
+    hostBusSend(BROADCAST, DALI_CMD_IMMEDIATE_OFF);
+    powerCycle();
+    hostCheck("off at power on", gear.dali->actualDimLevel, 0);
+    hostCheck("output off at power on", *gear.ocr0ra, 0);
+}
+
+
+// End of a PWM cycle: the PSC loads the duty written
+static void pwmCycle(void)
+{
+    if ((firstLight == 0) && (*gear.ocr0ra != 0)) {
+        firstLight = hostBus.now;
+        firstLightWrites = eepromWrites();
+    }
+}
+
+
+// Power up to the end of the first PWM cycle with the restored level (the boot
+// takes no simulated time: this is the part of the boot time set by the order of
+// the inits, the CPU time is measured by main(), see BOOT_TIME_TARGET_US)
+static void testBootTime(void)
+{
+    uint32_t start;
+
+    powerUp("boot time");
+    store(DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL, DALI_MASK);
+    hostBusWait(JOURNAL_US);
+    hostBusSend(BROADCAST_DAPC, 120);
+    supplyFails();
+
+    start = hostBus.now;
+    firstLight = 0;
+    hostBus.cycleStart = pwmCycle;
+    hostGearPowerCycle(&gear);
+    hostBusWait(BOOT_TIME_TARGET_US);
+    hostBus.cycleStart = NULL;
+
+    fprintf(stderr, "boot: first PWM cycle with the output on %lu us after power up (target %lu us)\n",
+            (unsigned long)(firstLight - start), (unsigned long)BOOT_TIME_TARGET_US);
+    hostCheck("output on within BOOT_TIME_TARGET_US", firstLight != 0, 1);
+    hostCheck("first light within BOOT_TIME_TARGET_US", firstLight - start <= BOOT_TIME_TARGET_US, 1);
+    hostCheck("eeprom bytes written before the first light", firstLightWrites, 0);
+    hostCheck("restored level", gear.dali->actualDimLevel, 120);
+    hostCheck("output at the restored level", *gear.ocr0ra, gear.pwmDuty(0));
+}
+
+
+// A fade cut by the power failure goes on at power on, from the level reached
+static void testInterruptedFade(void)
+{
+    uint8_t level;
+
+    powerUp("interrupted fade");
+    store(DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL, DALI_MASK);
+    store(DALI_CMD_STORE_THE_DTR_AS_FADE_TIME, FADE_TIME_2S);
+    hostBusSend(BROADCAST_DAPC, 100);
+    hostBusWait(2500000);
+    hostBusSend(BROADCAST_DAPC, 200);
+    hostBusWait(1000000);
+    hostCheck("fading", gear.dali->status.fadeRunning, 1);
+    level = gear.fadeLevel(0);
+    hostCheck("half way", (level > 130) && (level < 170), 1);
+
+    powerCycle();
+    hostCheck("level at power on", gear.dali->actualDimLevel, level);
+    hostCheck("fading at power on", gear.dali->status.fadeRunning, 1);
+    hostCheck("output at power on", *gear.ocr0ra, gear.pwmDuty(0));
+    hostBusWait(2500000);
+    hostCheck("target reached", gear.dali->actualDimLevel, 200);
+    hostCheck("fade ended", gear.dali->status.fadeRunning, 0);
+}
+
+
+// Supply dip: outputs off, then back at the level reached meanwhile
+static void testDip(void)
+{
+    powerUp("dip");
+    hostBusSend(BROADCAST_DAPC, 150);
+    supplyFails();
+    hostCheck("output off", *gear.ocr0ra, 0);
+    hostBusSend(BROADCAST_DAPC, 180);
+    hostCheck("level changed during the dip", gear.dali->actualDimLevel, 180);
+    hostCheck("output still off", *gear.ocr0ra, 0);
+    hostCheck("duty reported off", gear.pwmDuty(0), 0);
+
+    supplyBack();
+    hostCheck("output back", *gear.ocr0ra != 0, 1);
+    hostCheck("output at the new level", *gear.ocr0ra, gear.pwmDuty(0));
+    hostBusSend(BROADCAST_DAPC, 150);
+    supplyFails();
+    supplyBack();
+    hostCheck("second dip", gear.dali->actualDimLevel, 150);
+    hostCheck("output after the second dip", *gear.ocr0ra != 0, 1);
+}
+
+
+// Save cut by the end of the hold-up time, other power on levels, RESET
+static void testFallbacks(void)
+{
+    powerUp("fallbacks");
+    store(DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL, DALI_MASK);
+    hostBusSend(BROADCAST_DAPC, 90);
+    supplyFails();
+
+    // The CRC was not written: nothing restored, maximum level
+    gear.eeprom[EEPROM_POWER_FAIL_ADDRESS] = 91;
+    hostGearPowerCycle(&gear);
+    hostCheck("save cut: maximum level", gear.dali->actualDimLevel, 254);
+
+    // powerOnLevel other than MASK ignores the saved level
+    hostBusSend(BROADCAST_DAPC, 90);
+    store(DALI_CMD_STORE_THE_DTR_AS_POWER_ON_LEVEL, 200);
+    hostBusWait(JOURNAL_US);
+    powerCycle();
+    hostCheck("power on level", gear.dali->actualDimLevel, 200);
+
+    // RESET: power on level 254
+    hostBusSend(BROADCAST_DAPC, 90);
+    hostBusSend(BROADCAST, DALI_CMD_RESET);
+    hostBusSend(BROADCAST, DALI_CMD_RESET);
+    hostBusWait(JOURNAL_US);
+    powerCycle();
+    hostCheck("power on level after RESET", gear.dali->actualDimLevel, 254);
+}
+
+
+int main(void)
+{
+    hostGearLoad(&gear, 0);
+    hostBusAttach(&gear);
+
+    testLastActiveLevel();
+    testBootTime();
+    testInterruptedFade();
+    testDip();
+    testFallbacks();
+
+    hostGearUnload(&gear);
+    fprintf(stderr, "powerFailTest: %lu checks, %lu failures\n", (unsigned long)hostChecks, (unsigned long)hostFailures);
+    return hostFailures != 0;
+}
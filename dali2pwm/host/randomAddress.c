@@ -0,0 +1,401 @@
+// Random address collisions of gear powered up together
+//
+// N gear (see hostGear.h) are powered up at the same time, then a controller
+// sends INITIALISE and RANDOMISE twice. The gear run the same code: their random
+// addresses only differ by the analog noise collected by entropy.c, modelled
+// below. Each trial powers the gear up again with new parts (tolerances) and new
+// noise, the random addresses of the trial are compared.
+//
+// The trials are run with all the noise sources, with each source alone, without
+// noise (only the clock tolerances remain), and the random address of the
+// previous firmware (srand(TCNT1L), rand() for each byte) is computed for the
+// first case.
+//
+// Build and run (from this directory): make check, or ./randomAddress [trials] [gear count] [seed]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+
+#include "hostGear.h"
+#include "../dali.h"
+#include "../daliCmd.h"
+#include "../current.h"
+#include "../temperature.h"
+#include "../entropy.h"
+
+#define GEAR_MAX                64
+
+// Timing, us (TICK_US: see hostGear.h)
+#define TE_US                   416.667     // DALI half bit
+#define FW_FRAME_TE             38          // Start bit, 16 bits, stop bits
+#define FW_PERIOD_TE            60          // Frame and backward frame window (22 Te)
+#define PWM_PERIOD_US           64.0        // One conversion per PWM cycle (PSC, 15.6kHz)
+#define WATCHDOG_PERIOD_US      16000.0     // 2048 cycles of the 128kHz oscillator
+#define INITIALISE_US           300000.0    // First frame after power up
+
+// Model of the parts and of the noise (per trial and gear: uniform or normal)
+#define START_SPREAD_US         1000.0      // Reset released (supply ramp, brown-out threshold, oscillator start)
+#define CRYSTAL_PPM             50.0        // Crystal tolerance
+#define WATCHDOG_TOLERANCE      0.10        // Watchdog oscillator frequency, part to part
+#define WATCHDOG_JITTER_US      1.0         // Watchdog period jitter, rms
+#define ADC_NOISE_LSB           0.5         // Conversion noise, rms
+#define RX_DELAY_SPREAD_US      10.0        // Bus receiver (optocoupler) delay, part to part
+#define RX_JITTER_US            0.5         // Edge jitter (slope of the bus and noise), rms
+
+// ADC inputs: nominal led current, 32V string, 25 degree C
+#define ADC_CURRENT             CURRENT_NOMINAL
+#define ADC_VOLTAGE             CURRENT_VOLTAGE_ADC(32000)
+#define ADC_TEMPERATURE         1000
+
+// Noise sources of a case
+#define SOURCE_ADC              0x01
+#define SOURCE_WATCHDOG         0x02
+#define SOURCE_RX               0x04
+#define SOURCE_ALL              (SOURCE_ADC | SOURCE_WATCHDOG | SOURCE_RX)
+
+typedef struct {
+    HostGear host;
+    double start;                   // Reset released (us after power up)
+    double clock;                   // Crystal frequency / nominal
+    double watchdogPeriod;          // us
+    double rxDelay;                 // us
+    double nextConversion;          // Times of the next events (us after power up)
+    double nextTick;
+    double nextWatchdog;
+    uint32_t oldAddress;            // Random address of srand(TCNT1L)
+} Gear;
+
+static Gear gear[GEAR_MAX];
+static uint8_t gearCount = 64;
+static uint16_t trials = 100;
+static uint32_t seed = 1;
+static uint8_t sources;             // SOURCE_xxx of the current case
+
+
+static uint32_t hostRandom(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+
+// -1 to 1
+static double uniform(void)
+{
+    return (hostRandom() / 4294967296.0) * 2 - 1;
+}
+
+
+// Normal, rms 1 (Box-Muller)
+static double normal(void)
+{
+    double u = (hostRandom() + 1.0) / 4294967297.0;
+
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * (hostRandom() / 4294967296.0));
+}
+
+
+// Local time (us since the reset, crystal clock)
+static double gearTime(Gear *g, double time)
+{
+    return (time - g->start) * g->clock;
+}
+
+
+// Timer0 (4us) since the last tick, Timer1 (16us) since the reset
+static void gearClock(Gear *g, double time)
+{
+    double local = gearTime(g, time);
+
+    *g->host.tcnt0 = (uint8_t)(fmod(local, TICK_US) / 4);
+    *g->host.tcnt1 = (uint16_t)(uint64_t)(local / 16);
+    *g->host.tcnt1l = (uint8_t)*g->host.tcnt1;
+}
+
+
+// New parts, power up
+static void gearPowerUp(Gear *g)
+{
+    hostGearPowerUp(&g->host);
+    g->start = (uniform() + 1) / 2 * START_SPREAD_US;
+    g->clock = 1 + uniform() * CRYSTAL_PPM / 1e6;
+    g->watchdogPeriod = WATCHDOG_PERIOD_US / (1 + uniform() * WATCHDOG_TOLERANCE);
+    g->rxDelay = (sources & SOURCE_RX) ? (uniform() + 1) / 2 * RX_DELAY_SPREAD_US : 0;
+    g->nextConversion = g->start + PWM_PERIOD_US / g->clock;
+    g->nextTick = g->start + TICK_US / g->clock;
+    g->nextWatchdog = g->start + g->watchdogPeriod;
+}
+
+
+// Conversion of the channel selected by the previous one
+static void gearConvert(Gear *g)
+{
+    double value;
+
+    switch (*g->host.admux & 0x0f) {
+    case CURRENT_ADC_CHANNEL:
+        value = ADC_CURRENT;
+        break;
+    case CURRENT_VOLTAGE_CHANNEL:
+        value = ADC_VOLTAGE;
+        break;
+    default:
+        value = ADC_TEMPERATURE;
+        break;
+    }
+    if (sources & SOURCE_ADC) {
+        value += normal() * ADC_NOISE_LSB;
+    }
+    *g->host.adc = (uint16_t)lround(value);
+    g->host.adcVect();
+}
+
+
+// Run the gear interrupts and main loop until 'time'
+static void gearAdvance(Gear *g, double time)
+{
+    for (;;) {
+        if ((g->nextConversion <= g->nextTick) && (g->nextConversion <= g->nextWatchdog)) {
+            if (g->nextConversion > time) {
+                break;
+            }
+            gearConvert(g);
+            g->nextConversion += PWM_PERIOD_US / g->clock;
+        }
+        else if (g->nextTick <= g->nextWatchdog) {
+            if (g->nextTick > time) {
+                break;
+            }
+            gearClock(g, g->nextTick);
+            *g->host.tcnt0 = 0;
+            g->host.tickVect();
+            hostGearRun(&g->host);
+            g->nextTick += TICK_US / g->clock;
+        }
+        else {
+            if (g->nextWatchdog > time) {
+                break;
+            }
+            if (sources & SOURCE_WATCHDOG) {
+                gearClock(g, g->nextWatchdog);
+                g->host.watchdogVect();
+            }
+            g->nextWatchdog += g->watchdogPeriod + normal() * WATCHDOG_JITTER_US;
+        }
+    }
+}
+
+
+// Forward frame starting at 'time': edges (input capture), then the frame (EUSART)
+static void gearReceive(Gear *g, double time, uint8_t address, uint8_t command)
+{
+    uint32_t bits = (1UL << 16) | ((uint16_t)address << 8) | command;     // Start bit, 16 bits
+    uint8_t level = 1;          // Bus idle (high)
+    uint8_t halfBit;
+    uint8_t bit;
+    double edge;
+
+    // Manchester: 1 is low then high, 0 is high then low
+    for (halfBit = 0; halfBit < 34; halfBit++) {
+        bit = (bits >> (16 - halfBit / 2)) & 1;
+        if (((halfBit & 1) ? bit : !bit) != level) {
+            level = !level;
+            edge = time + halfBit * TE_US + g->rxDelay;
+            if (sources & SOURCE_RX) {
+                edge += normal() * RX_JITTER_US;
+            }
+            gearAdvance(g, edge);
+            *g->host.icr1 = (uint16_t)(uint64_t)(gearTime(g, edge) / 16);
+            *g->host.icr1l = (uint8_t)*g->host.icr1;
+            g->host.captureVect();
+        }
+    }
+
+    time += FW_FRAME_TE * TE_US + g->rxDelay;
+    gearAdvance(g, time);
+    gearClock(g, time);
+    *g->host.eucsrc = (3 << STP0);      // 2 stop bits, no frame error
+    *g->host.eudr = address;
+    *g->host.udr = command;
+    g->host.rxVect();
+    hostGearRun(&g->host);
+}
+
+
+// Random address of the previous firmware, at the end of the last frame
+static uint32_t oldRandomAddress(Gear *g, double time)
+{
+    uint32_t address;
+
+    gearClock(g, time);
+    srand(*g->host.tcnt1l);
+    address = (uint32_t)(rand() & 0xff) << 16;
+    address |= (uint32_t)(rand() & 0xff) << 8;
+    address |= rand() & 0xff;
+    return address;
+}
+
+
+// The gear do not answer INITIALISE and RANDOMISE: each one runs alone
+static void trial(void)
+{
+    uint8_t n;
+    uint8_t frame;
+    double time;
+    Gear *g;
+
+    for (n = 0; n < gearCount; n++) {
+        g = &gear[n];
+        gearPowerUp(g);
+        time = INITIALISE_US;
+        for (frame = 0; frame < 4; frame++) {
+            if (frame < 2) {
+                gearReceive(g, time, DALI_CMD_INITIALIZE, 0x00);    // All gear
+            }
+            else {
+                gearReceive(g, time, DALI_CMD_RANDOMISE, 0x00);
+            }
+            time += FW_PERIOD_TE * TE_US;
+        }
+        g->oldAddress = oldRandomAddress(g, time - (FW_PERIOD_TE - FW_FRAME_TE) * TE_US);
+    }
+}
+
+
+static uint32_t randomAddress(Gear *g)
+{
+    return ((uint32_t)g->host.dali->randomAddressH << 16) |
+           ((uint32_t)g->host.dali->randomAddressM << 8) |
+           g->host.dali->randomAddressL;
+}
+
+
+// Statistics of a case
+typedef struct {
+    const char *name;
+    uint32_t duplicateTrials;       // Trials with at least 2 gear with the same address
+    uint32_t duplicateGear;         // Gear sharing their address with another one
+    uint32_t highBytePairs;         // Pairs of gear with the same address high byte
+} Result;
+
+
+static void count(Result *result, uint8_t old)
+{
+    uint8_t n;
+    uint8_t m;
+    uint32_t a;
+    uint32_t b;
+    uint8_t duplicates = 0;
+    uint8_t shared;
+
+    for (n = 0; n < gearCount; n++) {
+        a = old ? gear[n].oldAddress : randomAddress(&gear[n]);
+        shared = 0;
+        for (m = 0; m < gearCount; m++) {
+            b = old ? gear[m].oldAddress : randomAddress(&gear[m]);
+            if (m == n) {
+                continue;
+            }
+            if (a == b) {
+                shared = 1;
+            }
+            if ((m > n) && ((a >> 16) == (b >> 16))) {
+                result->highBytePairs++;
+            }
+        }
+        duplicates += shared;
+    }
+    result->duplicateGear += duplicates;
+    if (duplicates > 0) {
+        result->duplicateTrials++;
+    }
+}
+
+
+static void report(Result *result)
+{
+    printf("%-32s %5lu/%-4u (%5.1f%%) %12.2f %15.2f\n", result->name,
+           (unsigned long)result->duplicateTrials, trials, 100.0 * result->duplicateTrials / trials,
+           (double)result->duplicateGear / trials, (double)result->highBytePairs / trials);
+}
+
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        uint8_t sources;
+    } cases[] = {
+        { "all sources", SOURCE_ALL },
+        { "ADC noise only", SOURCE_ADC },
+        { "watchdog oscillator only", SOURCE_WATCHDOG },
+        { "RX edges only", SOURCE_RX },
+        { "no noise (clocks only)", 0 },
+    };
+    Result results[sizeof(cases) / sizeof(cases[0])];
+    Result old = { "previous firmware, srand(TCNT1L)", 0, 0, 0 };
+    uint8_t c;
+    uint8_t n;
+    uint16_t t;
+    double pairs;
+
+    if (argc > 1) {
+        trials = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        gearCount = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        seed = strtoul(argv[3], NULL, 0);
+    }
+    if ((trials < 1) || (gearCount < 2) || (gearCount > GEAR_MAX) || (seed == 0)) {
+        fprintf(stderr, "usage: %s [trials] [gear count (2-%u)] [seed (not 0)]\n", argv[0], GEAR_MAX);
+        return 2;
+    }
+
+    printf("random address: %u gear powered up together, %u trials, seed %lu\n",
+           gearCount, trials, (unsigned long)seed);
+    printf("model: reset within %.0f us, crystal +-%.0f ppm, watchdog oscillator +-%.0f%% (jitter %.1f us rms),\n"
+           "       ADC noise %.1f LSB rms, receiver delay 0-%.0f us (jitter %.1f us rms), INITIALISE after %.0f ms\n",
+           START_SPREAD_US, CRYSTAL_PPM, WATCHDOG_TOLERANCE * 100, WATCHDOG_JITTER_US,
+           ADC_NOISE_LSB, RX_DELAY_SPREAD_US, RX_JITTER_US, INITIALISE_US / 1000);
+
+    for (n = 0; n < gearCount; n++) {
+        hostGearLoad(&gear[n].host, n);
+    }
+
+    memset(results, 0, sizeof(results));
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        results[c].name = cases[c].name;
+        sources = cases[c].sources;
+        for (t = 0; t < trials; t++) {
+            trial();
+            count(&results[c], 0);
+            if (sources == SOURCE_ALL) {
+                count(&old, 1);
+            }
+        }
+    }
+
+    printf("\n%-32s %19s %12s %15s\n", "", "trials with", "gear with", "pairs sharing");
+    printf("%-32s %19s %12s %15s\n", "noise", "a duplicate", "a duplicate", "the high byte");
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        report(&results[c]);
+    }
+    report(&old);
+
+    // Independent uniform addresses
+    pairs = gearCount * (gearCount - 1) / 2.0;
+    printf("%-32s %10s (%5.3f%%) %12s %15.2f\n", "ideal (uniform 24 bits)", "",
+           100 * (1 - exp(-pairs / (ENTROPY_RANDOM_MAX + 1.0))), "", pairs / 256);
+
+    for (n = 0; n < gearCount; n++) {
+        hostGearUnload(&gear[n].host);
+    }
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef _HOST_UTIL_ATOMIC_H_
+#define _HOST_UTIL_ATOMIC_H_
+
+// Host build: interrupts are called by the host program, never concurrently
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type)      for (uint8_t hostAtomic = 1; hostAtomic; hostAtomic = 0)
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _HOST_UTIL_CRC16_H_
+#define _HOST_UTIL_CRC16_H_
+
+#include <inttypes.h>
+
+// Same algorithm as avr-libc (1-Wire CRC8, polynomial x^8 + x^5 + x^4 + 1)
+static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data)
+{
+    uint8_t n;
+
+    crc ^= data;
+    for (n = 0; n < 8; n++) {
+        if (crc & 0x01) {
+            crc = (crc >> 1) ^ 0x8C;
+        }
+        else {
+            crc >>= 1;
+        }
+    }
+    return crc;
+}
+
+#endif
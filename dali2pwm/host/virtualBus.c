@@ -0,0 +1,298 @@
+// Virtual DALI bus: commissioning of N gear by a scripted controller
+//
+// Each gear is a private copy of daliGear.so (see hostGear.h). Time is simulated
+// in us; each gear gets its 1ms tick with its own phase and a watchdog interrupt
+// with its own period (the noise of the random address, see randomAddress.c for
+// a model of all the sources), frames follow the DALI timing below. The controller runs the INITIALISE / RANDOMISE / COMPARE /
+// WITHDRAW binary search and reports the commissioning time, the frames and the
+// collisions.
+//
+// Build and run (from this directory): make check, or ./virtualBus [gear count] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+
+#include "hostGear.h"
+#include "../dali.h"
+#include "../daliCmd.h"
+
+#define GEAR_MAX                64
+
+// DALI timing: see hostGear.h
+#define RANDOMISE_US            100000UL                // New random address available after 100ms
+#define WATCHDOG_US             16000UL                 // +-10% from part to part
+
+#define ANSWER_COLLISION        -2      // Several gear answered different data (ANSWER_NONE: none)
+
+typedef struct {
+    HostGear host;
+    uint32_t powerOn;               // Local clock offset (us), Timer1 runs since power up
+    uint32_t nextTick;              // Time of the next 1ms tick
+    uint32_t watchdogPeriod;        // Watchdog oscillator (entropy for RANDOMISE)
+    uint32_t nextWatchdog;
+} Gear;
+
+static Gear gear[GEAR_MAX];
+static uint8_t gearCount = 16;
+static uint32_t now = 0;            // Simulated time (us)
+static uint32_t seed = 1;
+
+// Bus statistics
+static uint32_t forwardFrames = 0;
+static uint32_t backwardFrames = 0;
+static uint32_t collisions = 0;     // Backward frames sent by more than one gear
+
+// Answers of the current backward frame window
+static uint8_t answerCount;
+static uint32_t answerStart;
+static int16_t answerData;
+
+// Search address known to be in the gear (bytes are sent only when they change)
+static uint32_t searchAddress;
+
+
+static uint32_t hostRandom(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+
+// Power up with a random phase of the clocks and a random watchdog period
+static void gearLoad(Gear *g, uint8_t n)
+{
+    hostGearLoad(&g->host, n);
+    g->powerOn = hostRandom() % 1000000UL;
+    g->nextTick = hostRandom() % TICK_US;
+    g->watchdogPeriod = WATCHDOG_US * 9 / 10 + hostRandom() % (WATCHDOG_US / 5);
+    g->nextWatchdog = g->watchdogPeriod;
+}
+
+
+// Timer1 runs at F_CLKIO / 256 (16us) since power up, Timer0 (4us) since the last tick
+static void gearClock(Gear *g, uint32_t time)
+{
+    *g->host.tcnt1 = (uint16_t)((time + g->powerOn) / 16);
+    *g->host.tcnt1l = (uint8_t)*g->host.tcnt1;
+    *g->host.tcnt0 = (uint8_t)(((time + TICK_US - g->nextTick) % TICK_US) / 4);
+}
+
+
+// Run the gear ticks until 'time', collecting the backward frames started
+static void advance(uint32_t time)
+{
+    uint8_t n;
+    Gear *g;
+    uint8_t state;
+
+    for (n = 0; n < gearCount; n++) {
+        g = &gear[n];
+        while (g->nextTick <= time) {
+            gearClock(g, g->nextTick);
+            state = *g->host.txState;
+            g->host.tickVect();
+            if ((state == DALI_TX_WAIT) && (*g->host.txState == DALI_TX_SENDING)) {
+                if ((answerCount == 0) || (g->nextTick < answerStart)) {
+                    answerStart = g->nextTick;
+                }
+                if (answerCount == 0) {
+                    answerData = *g->host.udr;
+                }
+                else if (answerData != *g->host.udr) {
+                    answerData = ANSWER_COLLISION;
+                }
+                answerCount++;
+            }
+            hostGearRun(&g->host);
+            g->nextTick += TICK_US;
+        }
+        while (g->nextWatchdog <= time) {
+            gearClock(g, g->nextWatchdog);
+            g->host.watchdogVect();
+            g->nextWatchdog += g->watchdogPeriod;
+        }
+    }
+    now = time;
+}
+
+
+// Send a forward frame, wait for the backward frame and the settling time
+// Returns the answer, ANSWER_NONE or ANSWER_COLLISION
+static int16_t send(uint8_t address, uint8_t command)
+{
+    uint8_t n;
+    Gear *g;
+    uint32_t end = now + FW_FRAME_US;
+
+    advance(end);
+    answerCount = 0;
+    answerData = ANSWER_NONE;
+    for (n = 0; n < gearCount; n++) {
+        g = &gear[n];
+        gearClock(g, end);
+        *g->host.eucsrc = (3 << STP0);       // 2 stop bits, no frame error
+        *g->host.eudr = address;
+        *g->host.udr = command;
+        g->host.rxVect();
+        hostGearRun(&g->host);
+    }
+    forwardFrames++;
+
+    // No backward frame: the next forward frame is sent at the end of the window
+    advance(end + BW_WINDOW_US);
+    if (answerCount > 0) {
+        backwardFrames++;
+        if (answerCount > 1) {
+            collisions++;
+        }
+        advance(answerStart + BW_FRAME_US + SETTLING_US);
+    }
+    return answerData;
+}
+
+
+static void sendTwice(uint8_t address, uint8_t command)
+{
+    send(address, command);
+    send(address, command);
+}
+
+
+static void setSearchAddress(uint32_t address)
+{
+    if (((address ^ searchAddress) >> 16) & 0xff) {
+        send(DALI_CMD_SEARCH_ADDRESS_H, address >> 16);
+    }
+    if (((address ^ searchAddress) >> 8) & 0xff) {
+        send(DALI_CMD_SEARCH_ADDRESS_M, address >> 8);
+    }
+    if ((address ^ searchAddress) & 0xff) {
+        send(DALI_CMD_SEARCH_ADDRESS_L, address);
+    }
+    searchAddress = address;
+}
+
+
+// At least one gear has a random address <= address (a collision is a yes)
+static uint8_t compare(uint32_t address)
+{
+    setSearchAddress(address);
+    return send(DALI_CMD_COMPARE, 0) != ANSWER_NONE;
+}
+
+
+// Binary search of the random addresses, one short address per gear found
+// Returns the number of short addresses programmed
+static uint8_t commission(void)
+{
+    uint8_t shortAddress = 0;
+    uint32_t low;
+    uint32_t high;
+    uint32_t middle;
+
+    send(DALI_CMD_TERMINATE, 0);
+    sendTwice(DALI_CMD_INITIALIZE, 0x00);       // All gear
+    sendTwice(DALI_CMD_RANDOMISE, 0x00);
+    advance(now + RANDOMISE_US);
+
+    send(DALI_CMD_SEARCH_ADDRESS_H, 0xff);
+    send(DALI_CMD_SEARCH_ADDRESS_M, 0xff);
+    send(DALI_CMD_SEARCH_ADDRESS_L, 0xff);
+    searchAddress = 0xffffff;
+
+    while ((shortAddress < 64) && compare(0xffffff)) {
+        low = 0;
+        high = 0xffffff;
+        while (low < high) {
+            middle = low + (high - low) / 2;
+            if (compare(middle)) {
+                high = middle;
+            }
+            else {
+                low = middle + 1;
+            }
+        }
+        setSearchAddress(low);
+        send(DALI_CMD_PROGRAM_SHORT_ADDRESS, (shortAddress << 1) | 1);
+        if (send(DALI_CMD_VERIFY_SHORT_ADDRESS, (shortAddress << 1) | 1) == ANSWER_NONE) {
+            printf("short address %u: not verified\n", shortAddress);
+        }
+        send(DALI_CMD_WITHDRAW, 0);
+        shortAddress++;
+    }
+    send(DALI_CMD_TERMINATE, 0);
+    return shortAddress;
+}
+
+
+// Gear sharing a short address (same random address) or without one
+static void report(uint8_t programmed)
+{
+    uint8_t users[64];
+    uint8_t n;
+    uint8_t missing = 0;
+    uint8_t shared = 0;
+
+    memset(users, 0, sizeof(users));
+    for (n = 0; n < gearCount; n++) {
+        if (gear[n].host.dali->shortAddress < 64) {
+            users[gear[n].host.dali->shortAddress]++;
+        }
+        else {
+            missing++;
+        }
+    }
+    for (n = 0; n < gearCount; n++) {
+        if ((gear[n].host.dali->shortAddress < 64) && (users[gear[n].host.dali->shortAddress] > 1)) {
+            shared++;
+            printf("short address %u shared: gear %u, random address 0x%02x%02x%02x\n",
+                   gear[n].host.dali->shortAddress, n,
+                   gear[n].host.dali->randomAddressH, gear[n].host.dali->randomAddressM, gear[n].host.dali->randomAddressL);
+        }
+    }
+
+    printf("commissioning: %u short addresses for %u gear in %.1f s (%.0f ms per gear)\n",
+           programmed, gearCount, now / 1e6, now / 1e3 / gearCount);
+    printf("frames: %lu forward, %lu backward, %lu collisions (backward frames from more than one gear)\n",
+           (unsigned long)forwardFrames, (unsigned long)backwardFrames, (unsigned long)collisions);
+    printf("result: %u gear sharing a short address, %u gear without short address\n", shared, missing);
+}
+
+
+int main(int argc, char **argv)
+{
+    uint8_t n;
+    uint8_t programmed;
+    unsigned long count = gearCount;
+
+    // Range checked before gearCount (uint8_t) is set: 257 must not be 1 gear
+    if (argc > 1) {
+        count = strtoul(argv[1], NULL, 0);
+    }
+    if (argc > 2) {
+        seed = strtoul(argv[2], NULL, 0);
+    }
+    if ((count < 1) || (count > GEAR_MAX) || (seed == 0)) {
+        fprintf(stderr, "usage: %s [gear count (1-%u)] [seed (not 0)]\n", argv[0], GEAR_MAX);
+        return 2;
+    }
+    gearCount = count;
+
+    printf("virtual bus: %u gear, seed %lu\n", gearCount, (unsigned long)seed);
+    for (n = 0; n < gearCount; n++) {
+        gearLoad(&gear[n], n);
+    }
+
+    advance(now + 500000UL);        // Power up
+    programmed = commission();
+    report(programmed);
+
+    for (n = 0; n < gearCount; n++) {
+        hostGearUnload(&gear[n].host);
+    }
+    return 0;
+}
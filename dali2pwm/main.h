@@ -1,7 +1,7 @@
 #ifndef MAIN_H
 #define MAIN_H
 
-#define F_CLKIO     F_CPU / 8   // CPU frequency is divided by 8 (see init() in main.c)
+#define F_CLKIO     (F_CPU)     // CPU clock is not divided (see init() in main.c)
 
 // PWM
 #define PWM_DIVIDER_1       (0 << CS12) | (0 << CS11) | (1 << CS10)     // PWM frequency divider :1
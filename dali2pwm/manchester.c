@@ -0,0 +1,221 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "main.h"
+#include "dali.h"
+#include "manchester.h"
+
+#ifdef DALI_SOFT_MANCHESTER
+
+#define RX_IDLE         0       // Waiting for the falling edge of a start bit
+#define RX_RECEIVING    1
+#define RX_ERROR        2       // Waiting for the end of the frame
+
+extern volatile uint16_t rxErrorCount;
+
+volatile uint16_t manchesterHistogram[MANCHESTER_HISTOGRAM_SIZE];
+
+// Receiver (input capture)
+static uint8_t rxState = RX_IDLE;
+static uint16_t rxLastEdge;             // Time of the last edge (Timer1)
+static uint8_t rxLevel;                 // Bus level since the last edge
+static uint8_t rxHalves;                // Half bits received, start bit included
+static uint8_t rxFirstHalf;             // Level of the first half of the current bit
+static uint16_t rxFrame;                // Bits received, MSB first (the start bit is shifted out)
+
+// Transmitter (compare B)
+static volatile uint8_t txActive = 0;
+static uint16_t txFrame;                // Start bit (bit 8) and data
+static uint8_t txHalf;                  // Next half bit
+
+
+// Timer1 is configured by daliInitBusMonitor(), DALI TX idles high
+void manchesterInit(void)
+{
+    MANCHESTER_TX_PORT |= (1 << MANCHESTER_TX_PIN);
+    MANCHESTER_TX_DDR |= (1 << MANCHESTER_TX_PIN);
+}
+
+
+// End of frame (or of the frame error) at MANCHESTER_STOP_TICKS after the last edge
+static void manchesterArmStop(uint16_t time)
+{
+    OCR1B = time + MANCHESTER_STOP_TICKS;
+    TIFR1 = (1 << OCF1B);
+    TIMSK1 |= (1 << OCIE1B);
+}
+
+
+static void manchesterHistogramAdd(uint16_t halfBit)
+{
+    uint8_t bin;
+
+    if (halfBit < MANCHESTER_HISTOGRAM_FIRST) {
+        bin = 0;
+    }
+    else if (halfBit >= MANCHESTER_HISTOGRAM_FIRST + MANCHESTER_HISTOGRAM_SIZE) {
+        bin = MANCHESTER_HISTOGRAM_SIZE - 1;
+    }
+    else {
+        bin = halfBit - MANCHESTER_HISTOGRAM_FIRST;
+    }
+    if (manchesterHistogram[bin] != 0xffff) {
+        manchesterHistogram[bin]++;
+    }
+}
+
+
+// Next half bit, returns 0 if the frame is invalid
+// A bit is a transition in its middle: low then high is a 1, high then low a 0.
+static uint8_t manchesterHalf(uint8_t level)
+{
+    if (rxHalves >= MANCHESTER_FORWARD_HALVES) {
+        return 0;               // Longer than a forward frame
+    }
+    if ((rxHalves & 1) == 0) {
+        rxFirstHalf = level;
+    }
+    else if (level == rxFirstHalf) {
+        return 0;               // No transition in the middle of the bit
+    }
+    else {
+        rxFrame = (rxFrame << 1) | level;
+    }
+    rxHalves++;
+    return 1;
+}
+
+
+static void manchesterError(void)
+{
+    rxErrorCount++;
+    rxState = RX_ERROR;
+}
+
+
+// Edge on DALI RX at 'time' (Timer1), 'level' is the bus level after the edge
+// Called by TIMER1_CAPT_vect (dali.c)
+void manchesterEdge(uint16_t time, uint8_t level)
+{
+    uint16_t interval = time - rxLastEdge;
+    uint8_t previous = rxLevel;
+
+    rxLastEdge = time;
+    rxLevel = level;
+    if (txActive) {
+        return;                 // Echo of the frame being sent
+    }
+
+    switch (rxState) {
+        case RX_IDLE:
+            if (level == 0) {
+
+                // Start bit: first half low
+                rxHalves = 0;
+                rxFrame = 0;
+                rxState = RX_RECEIVING;
+                manchesterArmStop(time);
+            }
+            break;
+
+        case RX_RECEIVING:
+            manchesterArmStop(time);
+            if ((interval >= MANCHESTER_TE_MIN_TICKS) && (interval <= MANCHESTER_TE_MAX_TICKS)) {
+                manchesterHistogramAdd(interval);
+                if (!manchesterHalf(previous)) {
+                    manchesterError();
+                }
+            }
+            else if ((interval >= 2 * MANCHESTER_TE_MIN_TICKS) && (interval <= 2 * MANCHESTER_TE_MAX_TICKS)) {
+                manchesterHistogramAdd((interval + 1) >> 1);
+                manchesterHistogramAdd(interval >> 1);
+                if (!manchesterHalf(previous) || !manchesterHalf(previous)) {
+                    manchesterError();
+                }
+            }
+            else {
+                manchesterHistogramAdd(interval < 2 * MANCHESTER_TE_MIN_TICKS ? interval : interval >> 1);
+                manchesterError();
+            }
+            break;
+
+        default:
+            manchesterArmStop(time);
+            break;
+    }
+}
+
+
+// Bus high since the last edge: the frame ends
+static void manchesterStop(void)
+{
+    if (rxState == RX_RECEIVING) {
+
+        // The last bit ends high (1) with the stop bits, without an edge
+        if ((rxHalves & 1) && ((rxLevel == 0) || !manchesterHalf(1))) {
+            manchesterError();
+        }
+        else if (rxHalves == MANCHESTER_FORWARD_HALVES) {
+            daliReceive(rxFrame >> 8, rxFrame);
+        }
+        else if (rxHalves != MANCHESTER_BACKWARD_HALVES) {
+            manchesterError();
+        }
+    }
+    rxState = RX_IDLE;
+}
+
+
+// Next half bit of the frame being sent: start bit, 8 bits, 2 stop bits (4 half bits high)
+static void manchesterTxHalf(void)
+{
+    uint8_t level = 1;
+    uint8_t bit;
+
+    if (txHalf < MANCHESTER_BACKWARD_HALVES) {
+        bit = (txFrame >> (8 - (txHalf >> 1))) & 1;
+        level = (txHalf & 1) ? bit : !bit;
+    }
+    if (level) {
+        MANCHESTER_TX_PORT |= (1 << MANCHESTER_TX_PIN);
+    }
+    else {
+        MANCHESTER_TX_PORT &= ~(1 << MANCHESTER_TX_PIN);
+    }
+    txHalf++;
+}
+
+
+// Send a backward frame, called by daliTick() (interrupt)
+// The frame lasts 22 half bits (9.2ms), less than DALI_BW_FRAME_DURATION.
+void manchesterSend(uint8_t data)
+{
+    txFrame = (1 << 8) | data;
+    txHalf = 0;
+    txActive = 1;
+    rxState = RX_IDLE;
+    manchesterTxHalf();
+    OCR1B = TCNT1 + MANCHESTER_TE_TICKS;
+    TIFR1 = (1 << OCF1B);
+    TIMSK1 |= (1 << OCIE1B);
+}
+
+
+// Half bit of the frame sent, or end of the frame received
+ISR(TIMER1_COMPB_vect)
+{
+    if (txActive) {
+        if (txHalf < MANCHESTER_BACKWARD_HALVES + 4) {
+            manchesterTxHalf();
+            OCR1B += MANCHESTER_TE_TICKS;
+            return;
+        }
+        txActive = 0;
+    }
+    else {
+        manchesterStop();
+    }
+    TIMSK1 &= ~(1 << OCIE1B);
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _MANCHESTER_H_
+#define _MANCHESTER_H_
+
+#include <inttypes.h>
+
+#include "main.h"
+
+// Software Manchester codec, built with DALI_SOFT_MANCHESTER instead of the EUSART
+// Needs Timer1 with input capture and a GPIO only (ATtiny/ATmega parts without EUSART).
+//
+// Receive: Timer1 input capture on DALI RX (ICP1A, shared with the bus failure
+// detection, see TIMER1_CAPT_vect in dali.c) timestamps every edge. The time
+// between two edges is one half bit (Te) or two; the levels of the half bits are
+// paired into bits (a bit has an edge in its middle). The frame ends when the bus
+// stays high longer than any valid interval (Timer1 compare B): start bit + 16 bits
+// is a forward frame, passed to daliReceive() like the EUSART ones; start bit +
+// 8 bits is a backward frame of another gear, ignored. Anything else, or an
+// interval out of tolerance, is a frame error (rxErrorCount).
+//
+// Transmit: Timer1 compare B sets DALI TX every half bit (start bit, 8 bits, 2 stop
+// bits). The receiver ignores the edges of its own frame.
+//
+// Diagnostics: histogram of the half bits measured during the frames (memory bank
+// 3, see daliMemory.h). A bus with marginal wiring (capacitance, weak supply)
+// shows a spread or offset distribution long before frames are lost.
+
+// Timer1 clock (see BUS_TIMER_DIVIDER in dali.h), 16us at 16MHz
+#define MANCHESTER_TICK_US          (256 * 1000000UL / F_CLKIO)
+#define MANCHESTER_TICKS(us)        (((us) + MANCHESTER_TICK_US / 2) / MANCHESTER_TICK_US)
+
+// Half bit (Te = 416.67us at 1200 bauds)
+#define MANCHESTER_TE_US            417
+#define MANCHESTER_TE_TICKS         MANCHESTER_TICKS(MANCHESTER_TE_US)
+
+// Receive tolerance of a half bit, a full bit is twice (IEC 62386-101: 333 to 500us)
+// Narrower limits reject more noise, wider ones accept a worse bus.
+#ifndef MANCHESTER_TE_MIN_US
+    #define MANCHESTER_TE_MIN_US    333
+#endif
+#ifndef MANCHESTER_TE_MAX_US
+    #define MANCHESTER_TE_MAX_US    500
+#endif
+#define MANCHESTER_TE_MIN_TICKS     MANCHESTER_TICKS(MANCHESTER_TE_MIN_US)
+#define MANCHESTER_TE_MAX_TICKS     MANCHESTER_TICKS(MANCHESTER_TE_MAX_US)
+
+#if MANCHESTER_TE_MAX_TICKS >= 2 * MANCHESTER_TE_MIN_TICKS
+    #error "A half bit and a full bit must not overlap (MANCHESTER_TE_MIN_US, MANCHESTER_TE_MAX_US)"
+#endif
+
+// End of frame: bus high longer than a full bit
+#define MANCHESTER_STOP_TICKS       (2 * MANCHESTER_TE_MAX_TICKS + 1)
+
+// Frame lengths, in half bits (start bit included)
+#define MANCHESTER_FORWARD_HALVES   34
+#define MANCHESTER_BACKWARD_HALVES  18
+
+// Half bit histogram: one bin per Timer1 tick, centred on Te. Full bits count as two
+// half bits of half their length. The first and the last bins also count the half
+// bits below and above.
+#define MANCHESTER_HISTOGRAM_SIZE   16
+#define MANCHESTER_HISTOGRAM_FIRST  (MANCHESTER_TE_TICKS - MANCHESTER_HISTOGRAM_SIZE / 2)
+
+// DALI TX (idle: high, the bus is released)
+#define MANCHESTER_TX_PORT          PORTD
+#define MANCHESTER_TX_DDR           DDRD
+#define MANCHESTER_TX_PIN           PD3
+
+extern volatile uint16_t manchesterHistogram[MANCHESTER_HISTOGRAM_SIZE];
+
+void manchesterInit(void);
+void manchesterEdge(uint16_t time, uint8_t level);
+void manchesterSend(uint8_t data);
+
+#endif
@@ -0,0 +1,49 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "main.h"
+#include "dali.h"
+#include "pwm.h"
+#include "powerFail.h"
+
+volatile uint16_t powerFailCount = 0;   // Power failures detected since power up (see daliMemory.h)
+
+#ifdef POWER_FAIL_SENSE
+
+static volatile uint8_t powerFailActive = 0;
+
+
+// Analog comparator 0 on PD7 (ACMP0), interrupt on both edges of its output
+// Interrupts must be disabled
+void powerFailInit(void)
+{
+    AC0CON = (1 << AC0EN) |                 // Enable comparator 0
+             (0 << AC0IS1) | (0 << AC0IS0) |    // Interrupt on output toggle
+             POWER_FAIL_REFERENCE;
+    ACSR = (1 << AC0IF);
+    AC0CON |= (1 << AC0IE);
+}
+
+
+// Supply crossed the threshold: failure (comparator output low) or recovery
+// Saving takes a few ms with the interrupts disabled: an edge meanwhile runs this
+// interrupt again, and the comparator output tells the last state.
+ISR(ANALOG_COMP_0_vect)
+{
+    if ((ACSR & (1 << AC0O)) == 0) {
+        if (powerFailActive == 0) {
+
+            // Shed the load first, then save
+            powerFailActive = 1;
+            powerFailCount++;
+            pwmSetEnable(0);
+            daliPowerFail();
+        }
+    }
+    else if (powerFailActive == 1) {
+        powerFailActive = 0;
+        pwmSetEnable(1);
+    }
+}
+
+#endif
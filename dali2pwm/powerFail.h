@@ -0,0 +1,29 @@
+#ifndef _POWER_FAIL_H_
+#define _POWER_FAIL_H_
+
+#include <inttypes.h>
+
+#include "eepromCache.h"
+
+// Power failure early warning (built with POWER_FAIL_SENSE)
+// The supply of the gear, divided down to PD7 (ACMP0), is compared by analog
+// comparator 0 to a fraction of the ADC reference (internal 2.56V, see current.h).
+// When it falls below the threshold, the outputs are switched off at once: the bulk
+// capacitor then supplies the MCU alone, and daliPowerFail() saves the level and the
+// fade target of each instance (see EEPROM_POWER_FAIL_xxx in eepromCache.h). They are
+// restored at power on when powerOnLevel is MASK (DALI-2 last active level).
+// If the supply comes back (dip), the outputs resume at the levels reached meanwhile.
+//
+// The divider must reach the threshold while the MCU supply still lasts
+// POWER_FAIL_HOLD_UP_US: all the saved bytes changed, after the byte of a journal
+// record being written. That record is not completed: the registers stored by the
+// commands of the last ~120ms (EEPROM_RECORD_SIZE * EEPROM_WRITE_US) are lost, the
+// previous record is loaded at power on. Without POWER_FAIL_SENSE nothing is saved,
+// powerOnLevel MASK powers on at the maximum level.
+
+#define POWER_FAIL_REFERENCE    (2 << AC0M0)    // Vref / 2.13 = 1.20V (AC0M: 0 Vref/6.40 to 3 Vref/1.60)
+#define POWER_FAIL_HOLD_UP_US   ((EEPROM_POWER_FAIL_SIZE + 1) * EEPROM_WRITE_US)    // 13.6ms, 27.2ms with 3 gear
+
+void powerFailInit(void);
+
+#endif
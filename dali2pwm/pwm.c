@@ -0,0 +1,243 @@
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "main.h"
+#include "dali.h"
+#include "pwm.h"
+#include "colour.h"
+
+static uint16_t pwmValues[DALI_GEAR_COUNT];             // Last dimming curve output of each channel
+static uint16_t pwmGain = PWM_GAIN_ONE;                 // Correction of the led current regulation
+static uint16_t pwmLimit = PWM_TOP;                     // Maximum duty (thermal derating)
+static uint8_t pwmEnabled = 1;                          // 0: outputs off (power failure)
+static volatile uint16_t pwmDutyCycles[DALI_GEAR_COUNT];    // Duty written in the PWM, [0-PWM_TOP]
+
+#ifdef DALI_DT8
+static uint16_t pwmMix = COLOUR_MIX_WARM;   // Share of the warm string (see colour.h)
+static volatile uint16_t pwmDutyWarmCycle = 0;
+
+static void pwmWrite(uint16_t warm, uint16_t cool);
+#else
+static void pwmWrite(uint8_t channel, uint16_t duty);
+#endif
+
+
+// Duty cycle of a channel for its last value, corrected by the gain and limited
+// Only the current of channel 0 is measured (see current.c): the gain applies to it alone.
+static void pwmUpdate(uint8_t channel)
+{
+    uint32_t duty;
+
+    duty = pwmValues[channel] >> (16 - PWM_BITS);
+    if (channel == 0) {
+        duty = (duty * pwmGain) >> PWM_GAIN_SHIFT;
+    }
+    if (duty > pwmLimit) {
+        duty = pwmLimit;
+    }
+    if (pwmEnabled == 0) {
+        duty = 0;
+    }
+    pwmDutyCycles[channel] = duty;
+#ifdef DALI_DT8
+    {
+        // The strings share the duty, rounded: a mix of 0xffff is the warm string only
+        uint16_t warm = ((duty * pwmMix) + 0x8000) >> 16;
+
+        pwmDutyWarmCycle = warm;
+        pwmWrite(warm, duty - warm);
+    }
+#else
+    pwmWrite(channel, duty);
+#endif
+}
+
+
+// Set the led output of a channel
+// value is the 16-bit output of the dimming curve
+void pwmSet(uint8_t channel, uint16_t value)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pwmValues[channel] = value;
+        pwmUpdate(channel);
+    }
+}
+
+
+// Set the duty correction (PWM_GAIN_ONE: none), called by the current regulation
+void pwmSetGain(uint16_t gain)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pwmGain = gain;
+        pwmUpdate(0);
+    }
+}
+
+
+// Set the maximum duty [0-PWM_TOP] of all the channels, called by the thermal derating
+void pwmSetLimit(uint16_t limit)
+{
+    uint8_t n;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pwmLimit = limit;
+        for (n = 0; n < DALI_GEAR_COUNT; n++) {
+            pwmUpdate(n);
+        }
+    }
+}
+
+
+// Switch all the outputs off (0) or back on (1), called by the power failure detection
+// The values set meanwhile are applied when the outputs are back on.
+void pwmSetEnable(uint8_t enable)
+{
+    uint8_t n;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pwmEnabled = enable;
+        for (n = 0; n < DALI_GEAR_COUNT; n++) {
+            pwmUpdate(n);
+        }
+    }
+}
+
+
+// Duty of the output of a channel, [0-PWM_TOP]
+// Tunable white: sum of the duties of the two strings
+uint16_t pwmDuty(uint8_t channel)
+{
+    return pwmDutyCycles[channel];
+}
+
+
+#ifdef DALI_DT8
+
+// Set the share of the warm string (see colour.h), called by the colour fade
+void pwmSetMix(uint16_t mix)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pwmMix = mix;
+        pwmUpdate(0);
+    }
+}
+
+
+// Duty of the warm string (PSCOUT00, the ADC is synchronised to its on phase)
+uint16_t pwmDutyWarm(void)
+{
+    return pwmDutyWarmCycle;
+}
+
+#endif
+
+
+#ifndef PWM_USE_TIMER1
+
+// PSC0 in one ramp mode, PSCOUT00 is active from OCR0SA to OCR0RA, cycle ends at OCR0RB.
+// PSCOUT01 is not used.
+// Tunable white: PSC2 has the same configuration for PSCOUT20 (cool string). PSC0
+// starts with PSC2 (PARUN0): the cycles of both strings end on the same PLL clock.
+// Several instances: same for PSCOUT20 (channel 1) and PSCOUT21 (channel 2), PSCOUT21
+// is active from OCR2SB to the end of the cycle (OCR2RB).
+void pwmInit(void)
+{
+
+    // Start PLL at 64MHz and wait for lock
+    PLLCSR = (1 << PLLF) | (1 << PLLE);
+    while ((PLLCSR & (1 << PLOCK)) == 0) {
+    }
+
+    PCNF0 = PSC_CLOCK_PLL | PSC_ONE_RAMP | PSC_ACTIVE_LOW;
+
+    // Cycle length (TOP value)
+    OCR0SA = 0;
+    OCR0RA = 0;             // Led off
+    OCR0SB = PWM_TOP;
+    OCR0RB = PWM_TOP;
+
+    PSOC0 = PSC_SYNC_ON_START | // ADC trigger (PSC0ASY) at the start of the on phase
+            (1 << POEN0A);      // PSCOUT00 output enabled
+#if defined(DALI_DT8) || (DALI_GEAR_COUNT > 1)
+    PCNF2 = PSC_CLOCK_PLL | PSC_ONE_RAMP | PSC_ACTIVE_LOW;
+    OCR2SA = 0;
+    OCR2RA = 0;
+    OCR2SB = PWM_TOP;           // PSCOUT21 off
+    OCR2RB = PWM_TOP;
+#if DALI_GEAR_COUNT > 2
+    PSOC2 = (1 << POEN2A) | (1 << POEN2B);  // PSCOUT20 and PSCOUT21 outputs enabled
+#else
+    PSOC2 = (1 << POEN2A);      // PSCOUT20 output enabled
+#endif
+
+    PCTL0 = PSC_DIVIDER_1 | (1 << PARUN0);
+    PCTL2 = PSC_DIVIDER_1 | (1 << PRUN2);   // Starts both PSC
+#else
+    PCTL0 = PSC_DIVIDER_1 | (1 << PRUN0);
+#endif
+}
+
+
+#ifdef DALI_DT8
+
+// New duties are loaded by the PSC at the end of the cycle, the same one for both strings
+static void pwmWrite(uint16_t warm, uint16_t cool)
+{
+    PCNF0 |= (1 << PLOCK0);     // Hold updates until both OCRnRA are written
+    PCNF2 |= (1 << PLOCK2);
+    OCR0RA = warm;
+    OCR2RA = cool;
+    PCNF0 &= ~(1 << PLOCK0);
+    PCNF2 &= ~(1 << PLOCK2);
+}
+
+#else
+
+// New duty of a channel is loaded by the PSC at the end of the cycle
+static void pwmWrite(uint8_t channel, uint16_t duty)
+{
+    switch (channel) {
+        case 0:
+            PCNF0 |= (1 << PLOCK0);     // Hold update until OCR0RA is written
+            OCR0RA = duty;
+            PCNF0 &= ~(1 << PLOCK0);
+            break;
+#if DALI_GEAR_COUNT > 1
+        case 1:
+            PCNF2 |= (1 << PLOCK2);
+            OCR2RA = duty;
+            PCNF2 &= ~(1 << PLOCK2);
+            break;
+#endif
+#if DALI_GEAR_COUNT > 2
+        case 2:
+            PCNF2 |= (1 << PLOCK2);
+            OCR2SB = PWM_TOP - duty;
+            PCNF2 &= ~(1 << PLOCK2);
+            break;
+#endif
+    }
+}
+
+#endif
+
+#else
+
+// Timer1 fast PWM (mode 14), TOP = ICR1
+void pwmInit(void)
+{
+    ICR1 = PWM_TOP;
+    OCR1A = 0;
+
+    TCCR1A = PWM_INVERT | PWM_MODE_FAST_PWM_16BITS_A;
+    TCCR1B = PWM_MODE_FAST_PWM_16BITS_B | PWM_DIVIDER_1;    // PWM ~ 3.9kHz
+}
+
+
+// OCR1A is double buffered and loaded at TOP (one channel)
+static void pwmWrite(uint8_t channel, uint16_t duty)
+{
+    OCR1A = duty;
+}
+
+#endif
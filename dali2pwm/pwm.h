@@ -0,0 +1,50 @@
+#ifndef _PWM_H_
+#define _PWM_H_
+
+#include <inttypes.h>
+
+// Output engine
+// Default : PSC0 clocked by the 64MHz PLL, led output on PSCOUT00 (PD0)
+// If PWM_USE_TIMER1 is defined : Timer1 fast PWM, led output on OC1A (PD2)
+// If DALI_DT8 is defined (tunable white, see colour.h) : warm string on PSCOUT00 (PD0),
+// cool string on PSCOUT20 (PB0), PSC2 runs in phase with PSC0
+// With DALI_GEAR_COUNT instances (see dali.h), one output channel per instance:
+// channel 0 on PSCOUT00 (PD0), 1 on PSCOUT20 (PB0), 2 on PSCOUT21 (PB1)
+#define PWM_BITS            12                          // Output resolution
+#define PWM_TOP             ((1 << PWM_BITS) - 1)
+
+#ifdef PWM_USE_TIMER1
+    #define F_PWM_CLK       (F_CLKIO)                   // Timer1 clock, no prescaler
+#else
+    #define F_PWM_CLK       64000000UL                  // PLL output
+#endif
+
+#define F_PWM               (F_PWM_CLK / (PWM_TOP + 1)) // PSC: 15.6kHz, Timer1: 3.9kHz
+
+#if defined(DALI_DT8) && defined(PWM_USE_TIMER1)
+    #error "DALI_DT8 needs the PSC outputs (Timer1 drives one string only)"
+#endif
+
+// PSC0 configuration (same bits in PCNF2 and PCTL2 for PSC2)
+#define PSC_CLOCK_PLL       (1 << PCLKSEL0)             // PSC clocked by PLL (64MHz)
+#define PSC_ONE_RAMP        (0 << PMODE01) | (0 << PMODE00)
+#define PSC_ACTIVE_LOW      (0 << POP0)                 // Same polarity as Timer1 PWM_INVERT
+#define PSC_DIVIDER_1       (0 << PPRE01) | (0 << PPRE00)
+#define PSC_SYNC_ON_START   (0 << PSYNC01) | (0 << PSYNC00)     // PSC0ASY on the leading edge of PSCOUT00 (OCR0SA)
+
+// Duty correction (led current regulation), 4.12 fixed point
+#define PWM_GAIN_SHIFT      12
+#define PWM_GAIN_ONE        (1 << PWM_GAIN_SHIFT)
+
+void pwmInit(void);
+void pwmSet(uint8_t channel, uint16_t value);
+void pwmSetGain(uint16_t gain);
+void pwmSetLimit(uint16_t limit);
+void pwmSetEnable(uint8_t enable);
+uint16_t pwmDuty(uint8_t channel);
+#ifdef DALI_DT8
+void pwmSetMix(uint16_t mix);
+uint16_t pwmDutyWarm(void);
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+#include <util/atomic.h>
+
+#include "scheduler.h"
+
+volatile uint16_t schedulerTime = 0;
+
+static uint16_t schedulerDeadlines[SCHEDULER_TIMER_COUNT];
+static uint16_t schedulerPeriods[SCHEDULER_TIMER_COUNT];    // 0: one-shot
+static volatile uint8_t schedulerActive = 0;                // 1 bit per running timer
+static volatile uint8_t schedulerDue = 0;                   // 1 bit per expired timer, for the main loop
+static uint16_t schedulerNext;                              // Earliest deadline of the running timers
+
+
+// Earliest deadline of the running timers
+// Interrupts must be disabled
+static void schedulerUpdateNext(void)
+{
+    uint8_t n;
+    uint8_t first = 1;
+    int16_t delay;
+    int16_t nextDelay = 0;
+
+    for (n = 0; n < SCHEDULER_TIMER_COUNT; n++) {
+        if (schedulerActive & SCHEDULER_MASK(n)) {
+            delay = (int16_t)(schedulerDeadlines[n] - schedulerTime);
+            if (first || (delay < nextDelay)) {
+                nextDelay = delay;
+                schedulerNext = schedulerDeadlines[n];
+                first = 0;
+            }
+        }
+    }
+}
+
+
+// Called every ms from the tick interrupt
+// Returns the timers which expired at this tick
+uint8_t schedulerTick(void)
+{
+    uint8_t n;
+    uint8_t due = 0;
+
+    schedulerTime++;
+
+    // Nothing to do until the next deadline
+    if ((schedulerActive == 0) || ((int16_t)(schedulerTime - schedulerNext) < 0)) {
+        return 0;
+    }
+
+    for (n = 0; n < SCHEDULER_TIMER_COUNT; n++) {
+        if ((schedulerActive & SCHEDULER_MASK(n)) &&
+            ((int16_t)(schedulerTime - schedulerDeadlines[n]) >= 0)) {
+            due |= SCHEDULER_MASK(n);
+            if (schedulerPeriods[n] != 0) {
+                schedulerDeadlines[n] += schedulerPeriods[n];
+            }
+            else {
+                schedulerActive &= ~SCHEDULER_MASK(n);
+            }
+        }
+    }
+    schedulerUpdateNext();
+
+    schedulerDue |= due & ~SCHEDULER_ISR_TIMERS;
+    return due;
+}
+
+
+// Start (or restart) a timer, expiring in 'delay' ms, then every 'period' ms if not 0
+void schedulerStart(uint8_t timer, uint16_t delay, uint16_t period)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        schedulerStartAt(timer, schedulerTime + delay, period);
+    }
+}
+
+
+// Start (or restart) a timer, expiring at schedulerTime == 'deadline'
+// A deadline already passed expires at the next tick.
+void schedulerStartAt(uint8_t timer, uint16_t deadline, uint16_t period)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        schedulerDeadlines[timer] = deadline;
+        schedulerPeriods[timer] = period;
+        schedulerActive |= SCHEDULER_MASK(timer);
+        schedulerDue &= ~SCHEDULER_MASK(timer);
+        schedulerUpdateNext();
+    }
+}
+
+
+void schedulerStop(uint8_t timer)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        schedulerActive &= ~SCHEDULER_MASK(timer);
+        schedulerDue &= ~SCHEDULER_MASK(timer);
+        schedulerUpdateNext();
+    }
+}
+
+
+uint8_t schedulerIsRunning(uint8_t timer)
+{
+    return (schedulerActive & SCHEDULER_MASK(timer)) != 0;
+}
+
+
+uint16_t schedulerDeadline(uint8_t timer)
+{
+    uint16_t deadline;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        deadline = schedulerDeadlines[timer];
+    }
+    return deadline;
+}
+
+
+// Set the due bit of a timer (event detected by another interrupt)
+void schedulerPost(uint8_t timer)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        schedulerDue |= SCHEDULER_MASK(timer);
+    }
+}
+
+
+// At least one timer expired, the main loop has something to do
+uint8_t schedulerIsDue(void)
+{
+    return schedulerDue != 0;
+}
+
+
+// Expired timers (main loop), cleared when read
+uint8_t schedulerTakeDue(void)
+{
+    uint8_t due;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        due = schedulerDue;
+        schedulerDue = 0;
+    }
+    return due;
+}
@@ -0,0 +1,36 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <inttypes.h>
+
+// Millisecond timers, driven by the DALI tick (TIMER0_COMP_A_vect)
+// Each timer is one-shot (period 0) or periodic. When a timer expires, its bit is
+// set in the due mask read by the main loop, except for the timers in
+// SCHEDULER_ISR_TIMERS which are handled in the tick interrupt.
+#define SCHEDULER_TX                0       // Backward frame start and end
+#define SCHEDULER_SEND_TWICE        1       // Send twice window (SEND_TWICE_WINDOW)
+#define SCHEDULER_SPECIAL_MODE      2       // 1/4s period while special mode is enabled
+#define SCHEDULER_BUS_FAILURE       3       // Bus low for BUS_FAILURE_TIMEOUT (posted by Timer1 without PWM_USE_TIMER1)
+#define SCHEDULER_FADE              4       // Level update while fading
+#define SCHEDULER_TEMPERATURE       5       // Thermal derating update (TEMPERATURE_UPDATE_PERIOD)
+#define SCHEDULER_LAMP_FAILURE      6       // Lamp failure changed (posted by the ADC interrupt)
+#define SCHEDULER_BOOT              7       // Background work after the first light (BOOT_BACKGROUND_DELAY)
+#define SCHEDULER_TIMER_COUNT       8       // 8 at most (uint8_t masks)
+
+#define SCHEDULER_ISR_TIMERS        (1 << SCHEDULER_TX)
+
+#define SCHEDULER_MASK(timer)       (1 << (timer))
+
+extern volatile uint16_t schedulerTime;     // Free running, incremented every ms
+
+uint8_t schedulerTick(void);
+void schedulerStart(uint8_t timer, uint16_t delay, uint16_t period);
+void schedulerStartAt(uint8_t timer, uint16_t deadline, uint16_t period);
+void schedulerStop(uint8_t timer);
+uint8_t schedulerIsRunning(uint8_t timer);
+uint16_t schedulerDeadline(uint8_t timer);
+void schedulerPost(uint8_t timer);
+uint8_t schedulerIsDue(void);
+uint8_t schedulerTakeDue(void);
+
+#endif
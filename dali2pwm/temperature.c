@@ -0,0 +1,94 @@
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "main.h"
+#include "temperature.h"
+#include "scheduler.h"
+#include "pwm.h"
+
+#define TEMPERATURE_LIMIT_MIN       ((uint16_t)((uint32_t)PWM_TOP * TEMPERATURE_DERATING_MIN / 100))
+
+static volatile uint16_t temperatureFiltered;   // ADC << TEMPERATURE_FILTER_SHIFT
+int16_t temperature = 0;                        // 1/16 degree C, read in bank 2 (see daliMemory.h)
+uint16_t temperatureState = TEMPERATURE_NORMAL;
+
+
+// New conversion of the TEMPERATURE input, from the ADC interrupt
+void temperatureSample(uint16_t adc)
+{
+    temperatureFiltered += adc - (temperatureFiltered >> TEMPERATURE_FILTER_SHIFT);
+}
+
+
+// ADC to 1/16 degree C: table lookup and linear interpolation
+static int16_t temperatureConvert(uint16_t adc)
+{
+    uint8_t index = adc >> TEMPERATURE_TABLE_SHIFT;
+    uint8_t fraction = adc & ((1 << TEMPERATURE_TABLE_SHIFT) - 1);
+    int16_t low;
+    int16_t high;
+
+    low = pgm_read_word(&TEMPERATURE_TABLE[index]);
+    high = pgm_read_word(&TEMPERATURE_TABLE[index + 1]);
+    return low + (((high - low) * fraction) >> TEMPERATURE_TABLE_SHIFT);
+}
+
+
+// Output limit for the temperature, [0-PWM_TOP]
+static uint16_t temperatureLimit(void)
+{
+    if (temperatureState == TEMPERATURE_OVERHEAT) {
+        if (temperature >= (TEMPERATURE_SHUTDOWN - TEMPERATURE_HYSTERESIS) * TEMPERATURE_UNIT) {
+            return 0;
+        }
+    }
+    else if (temperature >= TEMPERATURE_SHUTDOWN * TEMPERATURE_UNIT) {
+        temperatureState = TEMPERATURE_OVERHEAT;
+        return 0;
+    }
+
+    if (temperature <= TEMPERATURE_DERATING_START * TEMPERATURE_UNIT) {
+        temperatureState = TEMPERATURE_NORMAL;
+        return PWM_TOP;
+    }
+
+    temperatureState = TEMPERATURE_DERATING;
+    if (temperature >= TEMPERATURE_DERATING_END * TEMPERATURE_UNIT) {
+        return TEMPERATURE_LIMIT_MIN;
+    }
+    return PWM_TOP - (uint32_t)(PWM_TOP - TEMPERATURE_LIMIT_MIN) *
+                     (temperature - TEMPERATURE_DERATING_START * TEMPERATURE_UNIT) /
+                     ((TEMPERATURE_DERATING_END - TEMPERATURE_DERATING_START) * TEMPERATURE_UNIT);
+}
+
+
+// The ADC conversions are started by the led current regulation (see currentInit())
+void temperatureInit(void)
+{
+    DIDR0 |= (1 << ADC3D);      // Analog input, digital buffer off
+    temperatureFiltered = 1023 << TEMPERATURE_FILTER_SHIFT;     // Coldest, until the first samples
+    schedulerStart(SCHEDULER_TEMPERATURE, TEMPERATURE_UPDATE_PERIOD, TEMPERATURE_UPDATE_PERIOD);
+}
+
+
+// Apply the derating curve, called every TEMPERATURE_UPDATE_PERIOD
+// Returns the thermal state (TEMPERATURE_xxx)
+uint8_t temperatureUpdate(void)
+{
+    uint16_t filtered;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        filtered = temperatureFiltered;
+    }
+    temperature = temperatureConvert(filtered >> TEMPERATURE_FILTER_SHIFT);
+    pwmSetLimit(temperatureLimit());
+    return temperatureState;
+}
+
+
+// Last temperature, 1/16 degree C
+int16_t temperatureValue(void)
+{
+    return temperature;
+}
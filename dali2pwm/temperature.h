@@ -0,0 +1,51 @@
+#ifndef _TEMPERATURE_H_
+#define _TEMPERATURE_H_
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+
+// Led temperature (TEMPERATURE input, PD6/ADC3) and thermal derating
+// The ADC converts the temperature between two led current samples (see current.c),
+// the output is limited by the derating curve in the main loop.
+//
+// Output limit (fraction of full power)
+//   100% |------.
+//        |       `.
+//        |         `.______  TEMPERATURE_DERATING_MIN
+//        |                 |
+//     0% +------+-----+----+----> temperature
+//            START   END  SHUTDOWN
+
+// Derating curve, degree C
+#define TEMPERATURE_DERATING_START  70          // Output is limited above
+#define TEMPERATURE_DERATING_END    90          // Limit reaches TEMPERATURE_DERATING_MIN
+#define TEMPERATURE_DERATING_MIN    25          // % of full power, from END to SHUTDOWN
+#define TEMPERATURE_SHUTDOWN        105         // Output is switched off above
+#define TEMPERATURE_HYSTERESIS      5           // Output is switched on again below SHUTDOWN - HYSTERESIS
+
+#define TEMPERATURE_UPDATE_PERIOD   250         // Derating update (ms, SCHEDULER_TEMPERATURE)
+#define TEMPERATURE_SAMPLE_PERIOD   256         // PWM cycles between 2 conversions (16ms with the PSC)
+#define TEMPERATURE_FILTER_SHIFT    4           // Low-pass filter, 1 / 2^n of a new sample (~0.25s)
+
+// ADC channel (same reference as the led current, see CURRENT_ADC_REFERENCE)
+#define TEMPERATURE_ADC_CHANNEL     ((0 << MUX3) | (0 << MUX2) | (1 << MUX1) | (1 << MUX0)) // ADC3
+
+// Thermistor table generated by genThermistorTable.py (see THERMISTOR_xxx in the Makefile)
+// Temperatures in 1/16 degree C, one entry every 2^TEMPERATURE_TABLE_SHIFT ADC counts
+#define TEMPERATURE_TABLE_SHIFT     5
+#define TEMPERATURE_TABLE_SIZE      ((1024 >> TEMPERATURE_TABLE_SHIFT) + 1)
+#define TEMPERATURE_UNIT            16
+extern const int16_t TEMPERATURE_TABLE[TEMPERATURE_TABLE_SIZE] PROGMEM;
+
+// Thermal state (see dali.failureStatus, and bank 2 in daliMemory.h for the
+// device type 8 build which has no thermal queries)
+#define TEMPERATURE_NORMAL          0
+#define TEMPERATURE_DERATING        1           // Output limited
+#define TEMPERATURE_OVERHEAT        2           // Output off
+
+void temperatureInit(void);
+void temperatureSample(uint16_t adc);
+uint8_t temperatureUpdate(void);
+int16_t temperatureValue(void);
+
+#endif